@@ -0,0 +1,85 @@
+#include <stdio.h>
+
+#include "common.h"
+#include "event.h"
+#include "platform.h"
+
+// Registry cost with LISTENER_COUNT listeners on one event type: registering them,
+// dispatching to all of them, and unregistering them in shuffled order so the
+// swap-removes land all over the list.
+// Build with ./build.sh bench and run bin/event_bench.
+#define LISTENER_COUNT 10000
+#define DISPATCH_COUNT 1000
+#define ROUND_COUNT    16
+
+static u64 handled_count = 0;
+
+static bool count_handler(int event_type, void *listener, Event_Context ctx)
+{
+    ++handled_count;
+    // Not handled, so every listener gets the event
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    event_init();
+
+    static Event_Handle handles[LISTENER_COUNT];
+    u64 register_ns = 0;
+    u64 dispatch_ns = 0;
+    u64 unregister_ns = 0;
+    u32 seed = 0x9e3779b9;
+
+    for (u32 round = 0; round < ROUND_COUNT; ++round) {
+        u64 start = platform_get_time_ns();
+        for (u32 i = 0; i < LISTENER_COUNT; ++i) {
+            handles[i] = event_register(EVENT_KEY_PRESSED, (void *)(size_t)i, count_handler);
+        }
+        u64 end = platform_get_time_ns();
+        register_ns += end - start;
+
+        Event_Context ctx = {0};
+        start = platform_get_time_ns();
+        for (u32 i = 0; i < DISPATCH_COUNT; ++i) {
+            event_dispatch(EVENT_KEY_PRESSED, ctx);
+        }
+        end = platform_get_time_ns();
+        dispatch_ns += end - start;
+
+        // Fisher-Yates with xorshift, the timing shouldn't include it
+        for (u32 i = LISTENER_COUNT - 1; i > 0; --i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            u32 j = seed % (i + 1);
+            Event_Handle handle = handles[i];
+            handles[i] = handles[j];
+            handles[j] = handle;
+        }
+
+        start = platform_get_time_ns();
+        for (u32 i = 0; i < LISTENER_COUNT; ++i) {
+            event_unregister(handles[i]);
+        }
+        end = platform_get_time_ns();
+        unregister_ns += end - start;
+    }
+
+    if (handled_count != (u64)ROUND_COUNT * DISPATCH_COUNT * LISTENER_COUNT) {
+        printf("handled %llu events, expected %llu\n", handled_count,
+               (u64)ROUND_COUNT * DISPATCH_COUNT * LISTENER_COUNT);
+    }
+
+    u64 operation_count = (u64)ROUND_COUNT * LISTENER_COUNT;
+    printf("%u listeners\n", LISTENER_COUNT);
+    printf("register:   %8.2f ns/op\n", (f64)register_ns / operation_count);
+    printf("dispatch:   %8.2f us/op, %.2f ns per listener\n",
+           (f64)dispatch_ns / (ROUND_COUNT * DISPATCH_COUNT) / 1e3,
+           (f64)dispatch_ns / (operation_count * DISPATCH_COUNT));
+    printf("unregister: %8.2f ns/op\n", (f64)unregister_ns / operation_count);
+
+    event_destroy();
+
+    return 0;
+}
\ No newline at end of file
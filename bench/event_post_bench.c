@@ -0,0 +1,164 @@
+#include <stdio.h>
+
+#include "common.h"
+#include "event.h"
+#include "platform.h"
+
+// Contention on event_post: producer threads post as fast as they can while the
+// main thread drains and dispatches, once through the lock-free queue of event.c and
+// once through a queue of the same size behind a lock (a binary semaphore, the only
+// lock the platform layer has). Reports ns per event, from the first post until the
+// last event has been handled. Each producer keeps at most its share of the queue in
+// flight, so neither queue ever fills up and drops.
+// Build with ./build.sh bench and run bin/event_post_bench.
+#define EVENTS_PER_PRODUCER 200000
+#define MAX_PRODUCERS       8
+#define MAX_IN_FLIGHT       (EVENT_THREAD_QUEUE_CAPACITY / MAX_PRODUCERS)
+#define CACHE_LINE_SIZE     64
+
+typedef struct {
+    Platform_Thread thread;
+    u32             index;
+    // Written by the main thread as it handles this producer's events
+    u32             handled_count __attribute__((aligned(CACHE_LINE_SIZE)));
+} __attribute__((aligned(CACHE_LINE_SIZE))) Producer;
+
+static Producer producers[MAX_PRODUCERS];
+static u32 go = 0;
+static u64 handled_count = 0;
+
+static bool count_handler(int event_type, void *listener, Event_Context ctx)
+{
+    Producer *producer = &producers[ctx.data.u32[0]];
+    __atomic_store_n(&producer->handled_count, producer->handled_count + 1, __ATOMIC_RELEASE);
+    ++handled_count;
+    return true;
+}
+
+static void wait_for_go()
+{
+    while (!__atomic_load_n(&go, __ATOMIC_ACQUIRE)) platform_thread_yield();
+}
+
+static void wait_for_room(Producer *producer, u32 posted_count)
+{
+    while (posted_count - __atomic_load_n(&producer->handled_count, __ATOMIC_ACQUIRE) >= MAX_IN_FLIGHT) {
+        platform_thread_yield();
+    }
+}
+
+static u32 lock_free_producer(void *arg)
+{
+    Producer *producer = (Producer *)arg;
+    wait_for_go();
+
+    Event_Context ctx = {0};
+    ctx.data.u32[0] = producer->index;
+    for (u32 i = 0; i < EVENTS_PER_PRODUCER; ++i) {
+        ctx.data.u32[1] = i;
+        wait_for_room(producer, i);
+        event_post(EVENT_KEY_PRESSED, ctx);
+    }
+
+    return 0;
+}
+
+// The same bounded ring, one lock around it
+static struct {
+    Event_Context      slots[EVENT_THREAD_QUEUE_CAPACITY];
+    u64                head;
+    u64                tail;
+    Platform_Semaphore lock;
+} locked_queue;
+
+static void locked_post(Event_Context ctx)
+{
+    platform_semaphore_wait(&locked_queue.lock);
+    locked_queue.slots[locked_queue.tail++ & (EVENT_THREAD_QUEUE_CAPACITY - 1)] = ctx;
+    platform_semaphore_signal(&locked_queue.lock);
+}
+
+static void locked_drain()
+{
+    static Event_Context drained[EVENT_THREAD_QUEUE_CAPACITY];
+
+    platform_semaphore_wait(&locked_queue.lock);
+    u32 count = (u32)(locked_queue.tail - locked_queue.head);
+    for (u32 i = 0; i < count; ++i) {
+        drained[i] = locked_queue.slots[locked_queue.head++ & (EVENT_THREAD_QUEUE_CAPACITY - 1)];
+    }
+    platform_semaphore_signal(&locked_queue.lock);
+
+    // Handled outside the lock, same as event_flush does
+    for (u32 i = 0; i < count; ++i) {
+        count_handler(EVENT_KEY_PRESSED, NULL, drained[i]);
+    }
+}
+
+static u32 locked_producer(void *arg)
+{
+    Producer *producer = (Producer *)arg;
+    wait_for_go();
+
+    Event_Context ctx = {0};
+    ctx.data.u32[0] = producer->index;
+    for (u32 i = 0; i < EVENTS_PER_PRODUCER; ++i) {
+        ctx.data.u32[1] = i;
+        wait_for_room(producer, i);
+        locked_post(ctx);
+    }
+
+    return 0;
+}
+
+// Returns ns per event
+static f64 run(u32 producer_count, Platform_Thread_Proc proc, bool lock_free)
+{
+    u64 total = (u64)producer_count * EVENTS_PER_PRODUCER;
+
+    handled_count = 0;
+    __atomic_store_n(&go, 0, __ATOMIC_RELEASE);
+    for (u32 i = 0; i < producer_count; ++i) {
+        producers[i].index = i;
+        producers[i].handled_count = 0;
+        platform_thread_create(&producers[i].thread, proc, &producers[i]);
+    }
+
+    u64 start = platform_get_time_ns();
+    __atomic_store_n(&go, 1, __ATOMIC_RELEASE);
+    while (handled_count < total) {
+        if (lock_free) {
+            event_flush();
+        } else {
+            locked_drain();
+        }
+    }
+    u64 end = platform_get_time_ns();
+
+    for (u32 i = 0; i < producer_count; ++i) {
+        platform_thread_join(&producers[i].thread);
+    }
+
+    return (f64)(end - start) / total;
+}
+
+int main(int argc, char **argv)
+{
+    event_init();
+    Event_Handle handle = event_register(EVENT_KEY_PRESSED, NULL, count_handler);
+
+    platform_semaphore_create(&locked_queue.lock, 1);
+
+    printf("%10s %16s %16s\n", "producers", "lock-free ns/op", "locked ns/op");
+    for (u32 producer_count = 1; producer_count <= MAX_PRODUCERS; producer_count *= 2) {
+        f64 lock_free = run(producer_count, lock_free_producer, true);
+        f64 locked = run(producer_count, locked_producer, false);
+        printf("%10u %16.1f %16.1f\n", producer_count, lock_free, locked);
+    }
+
+    platform_semaphore_destroy(&locked_queue.lock);
+    event_unregister(handle);
+    event_destroy();
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include <stdio.h>
+
+#include "common.h"
+#include "job.h"
+#include "platform.h"
+
+// Job throughput against the number of workers:
+// - fan out: the main thread queues batches of small jobs and waits for each, the
+//   workers only ever steal from the main thread's deque
+// - nested: every job queues leaf jobs of its own and waits for them, so work sits
+//   in the workers' deques and gets stolen between them
+// Build with ./build.sh bench and run bin/job_bench.
+#define FAN_OUT_BATCH_SIZE 1024
+#define FAN_OUT_JOB_COUNT  (1024 * 1024)
+#define NESTED_PARENT_COUNT 32
+#define NESTED_LEAF_COUNT   64
+#define NESTED_ROUND_COUNT  512
+// Iterations of busy work per leaf job, small enough for scheduling to dominate
+#define LEAF_WORK 256
+
+static void leaf_proc(void *data)
+{
+    u32 x = (u32)(size_t)data | 1;
+    for (u32 i = 0; i < LEAF_WORK; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    volatile u32 result = x;
+    (void)result;
+}
+
+static void parent_proc(void *data)
+{
+    Job jobs[NESTED_LEAF_COUNT];
+    for (u32 i = 0; i < NESTED_LEAF_COUNT; ++i) {
+        jobs[i].proc = leaf_proc;
+        jobs[i].data = (void *)(size_t)i;
+    }
+
+    Job_Counter counter = {0};
+    job_run(jobs, NESTED_LEAF_COUNT, &counter);
+    job_wait(&counter);
+}
+
+// Returns jobs per second
+static f64 bench_fan_out()
+{
+    static Job jobs[FAN_OUT_BATCH_SIZE];
+    for (u32 i = 0; i < FAN_OUT_BATCH_SIZE; ++i) {
+        jobs[i].proc = leaf_proc;
+        jobs[i].data = (void *)(size_t)i;
+    }
+
+    u64 start = platform_get_time_ns();
+    for (u32 i = 0; i < FAN_OUT_JOB_COUNT / FAN_OUT_BATCH_SIZE; ++i) {
+        Job_Counter counter = {0};
+        job_run(jobs, FAN_OUT_BATCH_SIZE, &counter);
+        job_wait(&counter);
+    }
+    u64 end = platform_get_time_ns();
+
+    return FAN_OUT_JOB_COUNT / ((end - start) / 1e9);
+}
+
+static f64 bench_nested()
+{
+    Job jobs[NESTED_PARENT_COUNT];
+    for (u32 i = 0; i < NESTED_PARENT_COUNT; ++i) {
+        jobs[i].proc = parent_proc;
+        jobs[i].data = NULL;
+    }
+
+    u64 start = platform_get_time_ns();
+    for (u32 i = 0; i < NESTED_ROUND_COUNT; ++i) {
+        Job_Counter counter = {0};
+        job_run(jobs, NESTED_PARENT_COUNT, &counter);
+        job_wait(&counter);
+    }
+    u64 end = platform_get_time_ns();
+
+    u64 job_count = (u64)NESTED_ROUND_COUNT * NESTED_PARENT_COUNT * (NESTED_LEAF_COUNT + 1);
+    return job_count / ((end - start) / 1e9);
+}
+
+int main(int argc, char **argv)
+{
+    // Without jobs at all, what the work itself costs
+    u64 start = platform_get_time_ns();
+    for (u32 i = 0; i < FAN_OUT_JOB_COUNT; ++i) {
+        leaf_proc((void *)(size_t)i);
+    }
+    u64 end = platform_get_time_ns();
+    printf("serial: %.2f M calls/s\n\n", FAN_OUT_JOB_COUNT / ((end - start) / 1e9) / 1e6);
+
+    u32 processor_count = platform_get_processor_count();
+    u32 max_worker_count = CLAMP(processor_count - 1, 1, MAX_JOB_THREADS - 1);
+
+    printf("%8s %16s %16s\n", "workers", "fan out M/s", "nested M/s");
+    // Powers of two, always finishing with every core busy
+    for (u32 worker_count = 1; ; worker_count = CLAMP(worker_count * 2, 1, max_worker_count)) {
+        job_system_init(worker_count);
+        f64 fan_out = bench_fan_out();
+        f64 nested = bench_nested();
+        job_system_destroy();
+
+        printf("%8u %16.2f %16.2f\n", worker_count, fan_out / 1e6, nested / 1e6);
+
+        if (worker_count == max_worker_count) break;
+    }
+
+    return 0;
+}
\ No newline at end of file
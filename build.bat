@@ -18,6 +18,20 @@ set compile_flags=-g -Wvarargs -Wall -Werror
 set includes=-Isrc -I%VULKAN_SDK%/Include
 set links=-luser32 -lvulkan-1 -L%VULKAN_SDK%/Lib
 
+:: build.bat bench builds every bench\*.c instead, each against the engine sources
+:: without main.c
+if "%1"=="bench" (
+    set engine_files=
+    for /R "src" %%f in (*.c) do (
+        if /I not "%%~nxf"=="main.c" set engine_files=!engine_files! %%f
+    )
+    for %%f in (bench\*.c) do (
+        echo Building %%~nf...
+        call clang %%f !engine_files! %compile_flags% -O2 -o %bin_path%/%%~nf.exe %includes% %links%
+    )
+    exit /b 0
+)
+
 echo Building %bin_name%...
 
 call clang %source_files% %compile_flags% -o %bin_path%/%bin_name%.exe %includes% %links%
\ No newline at end of file
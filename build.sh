@@ -0,0 +1,30 @@
+#!/bin/sh
+set -e
+
+source_files=$(find src -name "*.c")
+
+bin_name=app
+
+bin_path=bin
+mkdir -p $bin_path
+
+# compile config
+compile_flags="-g -Wvarargs -Wall -Werror"
+includes="-Isrc"
+links="-lvulkan -lxcb -lpthread"
+
+# ./build.sh bench builds every bench/*.c instead, each against the engine sources
+# without main.c
+if [ "$1" = "bench" ]; then
+    engine_files=$(find src -name "*.c" ! -name "main.c")
+    for bench_file in bench/*.c; do
+        bench_name=$(basename "$bench_file" .c)
+        echo "Building $bench_name..."
+        ${CC:-clang} $bench_file $engine_files $compile_flags -O2 -o $bin_path/$bench_name $includes $links
+    done
+    exit 0
+fi
+
+echo "Building $bin_name..."
+
+${CC:-clang} $source_files $compile_flags -o $bin_path/$bin_name $includes $links
@@ -6,5 +6,6 @@ set SCRIPT_DIR=%~dp0
 
 call "glslc.exe" "%SCRIPT_DIR%shader.vert" -o "%SCRIPT_DIR%vert.spv"
 call "glslc.exe" "%SCRIPT_DIR%shader.frag" -o "%SCRIPT_DIR%frag.spv"
+call "glslc.exe" "%SCRIPT_DIR%animate.comp" -o "%SCRIPT_DIR%animate.spv"
 
 endlocal
\ No newline at end of file
@@ -0,0 +1,9 @@
+#!/bin/sh
+set -e
+
+# Get the directory of the current script
+script_dir=$(dirname "$0")
+
+glslc "$script_dir/shader.vert" -o "$script_dir/vert.spv"
+glslc "$script_dir/shader.frag" -o "$script_dir/frag.spv"
+glslc "$script_dir/animate.comp" -o "$script_dir/animate.spv"
@@ -3,13 +3,12 @@
 #include "memory.h"
 #include "log.h"
 
+// The data isn't zeroed, everything up to the length gets written before it's read
 void *_array_create(size_t length, size_t stride)
 {
     size_t size = ARRAY_HEADERS_SIZE + length * stride;
     size_t *array = memory_alloc(size, MEMORY_TAG_ARRAY);
 
-    memory_zero(array, size);
-    
     array[ARRAY_HEADER_CAPACITY] = length;
     array[ARRAY_HEADER_LENGTH] = 0;
     array[ARRAY_HEADER_STRIDE] = stride;
@@ -22,17 +21,47 @@ void _array_destroy(void *array)
     memory_free(array_header(array), array_size(array), MEMORY_TAG_ARRAY);
 }
 
+// realloc can often grow in place, and even when it can't it only copies the used part
+static void *array_set_capacity_exact(void *array, size_t capacity)
+{
+    size_t old_size = array_size(array);
+    size_t new_size = ARRAY_HEADERS_SIZE + capacity * array_stride(array);
+
+    size_t *header = memory_realloc(array_header(array), old_size, new_size, MEMORY_TAG_ARRAY);
+    header[ARRAY_HEADER_CAPACITY] = capacity;
+
+    return (void *)(header + MAX_ARRAY_HEADERS);
+}
+
+// Grows by ARRAY_RESIZE_FACTOR, or more if that's not enough for min_capacity
+static void *array_grow(void *array, size_t min_capacity)
+{
+    size_t capacity = array_capacity(array);
+    size_t new_capacity = (size_t)(capacity * ARRAY_RESIZE_FACTOR);
+    if (new_capacity <= capacity) new_capacity = capacity + 1;
+    if (new_capacity < min_capacity) new_capacity = min_capacity;
+
+    return array_set_capacity_exact(array, new_capacity);
+}
+
 void *_array_resize(void *array)
 {
-    size_t length = array_length(array);
-    size_t stride = array_stride(array);
-    void *new_array = _array_create(ARRAY_RESIZE_FACTOR * array_capacity(array), stride);
-    memory_copy(new_array, array, length * stride);
-    
-    array_set_length(new_array, length);
-    
-    _array_destroy(array);
-    return new_array;
+    return array_grow(array, array_capacity(array) + 1);
+}
+
+void *_array_reserve_more(void *array, size_t count)
+{
+    size_t required = array_length(array) + count;
+    if (required <= array_capacity(array)) return array;
+
+    return array_set_capacity_exact(array, required);
+}
+
+void *_array_shrink(void *array)
+{
+    if (array_capacity(array) == array_length(array)) return array;
+
+    return array_set_capacity_exact(array, array_length(array));
 }
 
 void *_array_push(void *array, const void *data)
@@ -53,6 +82,24 @@ void *_array_push(void *array, const void *data)
     return array;
 }
 
+void *_array_push_n(void *array, const void *data, size_t count)
+{
+    size_t length = array_length(array);
+    size_t stride = array_stride(array);
+
+    if (length + count > array_capacity(array)) {
+        array = array_grow(array, length + count);
+    }
+
+    size_t addr = (size_t)array;
+    addr += (length * stride);
+    memory_copy((void *)addr, data, count * stride);
+
+    array_set_length(array, length + count);
+
+    return array;
+}
+
 void _array_pop(void *array, void *dest)
 {
     size_t length = array_length(array);
@@ -70,7 +117,7 @@ void *_array_pop_at(void *array, size_t index, void *dest)
     size_t stride = array_stride(array);
 
     if (index >= length) {
-        LOG_ERROR("Array index out of bounds. Length: %llu, index: %llu", length, index);
+        LOG_ERROR("Array index out of bounds. Length: %zu, index: %zu\n", length, index);
         return array;
     }
 
@@ -78,10 +125,10 @@ void *_array_pop_at(void *array, size_t index, void *dest)
     memory_copy(dest, (void *)(addr + (index * stride)), stride);
 
     if (index != length - 1) {
-        memory_copy(
+        memory_move(
             (void *)(addr + (index * stride)),
             (void *)(addr + ((index + 1) * stride)),
-            stride * (length - index));
+            stride * (length - index - 1));
     }
 
     array_set_length(array, length - 1);
@@ -89,13 +136,14 @@ void *_array_pop_at(void *array, size_t index, void *dest)
     return array;
 }
 
+// index == length appends
 void *_array_insert_at(void *array, size_t index, void *data)
 {
     size_t length = array_length(array);
     size_t stride = array_stride(array);
 
-    if (index >= length) {
-        LOG_ERROR("Array index out of bounds. Length: %llu, index: %llu", length, index);
+    if (index > length) {
+        LOG_ERROR("Array index out of bounds. Length: %zu, index: %zu\n", length, index);
         return array;
     }
 
@@ -105,8 +153,8 @@ void *_array_insert_at(void *array, size_t index, void *data)
 
     size_t addr = (size_t)array;
 
-    if (index != length - 1) {
-        memory_copy(
+    if (index != length) {
+        memory_move(
             (void *)(addr + ((index + 1) * stride)),
             (void *)(addr + (index * stride)),
             stride * (length - index));
@@ -117,4 +165,4 @@ void *_array_insert_at(void *array, size_t index, void *data)
     array_set_length(array, length + 1);
 
     return array;
-}
\ No newline at end of file
+}
@@ -16,8 +16,10 @@ typedef enum {
 // Used in "array" macro
 #define ARRAY_DEFAULT_CAPACITY 1
 
-// Used in _array_resize function
+// How much the capacity grows when a push runs out of room, can be fractional (e.g. 1.5)
+#ifndef ARRAY_RESIZE_FACTOR
 #define ARRAY_RESIZE_FACTOR 2
+#endif
 
 #define array_header(a)         ((size_t *)(a) - MAX_ARRAY_HEADERS)
 #define array_capacity(a)       (array_header((a))[ARRAY_HEADER_CAPACITY])
@@ -31,7 +33,10 @@ typedef enum {
 void *_array_create(size_t length, size_t stride);
 void _array_destroy(void *array);
 void *_array_resize(void *array);
+void *_array_reserve_more(void *array, size_t count);
+void *_array_shrink(void *array);
 void *_array_push(void *array, const void *data);
+void *_array_push_n(void *array, const void *data, size_t count);
 void _array_pop(void *array, void *dest);
 void *_array_pop_at(void *array, size_t index, void *dest);
 void *_array_insert_at(void *array, size_t index, void *data);
@@ -44,6 +49,13 @@ void *_array_insert_at(void *array, size_t index, void *data);
         typeof(v) temp = (v);          \
         (a) = _array_push((a), &temp); \
     } while (0)
+// Room for exactly n more elements without reallocating
+#define array_reserve_more(a,n) ((a) = _array_reserve_more((a), (n)))
+// Drop unused capacity
+#define array_shrink(a)        ((a) = _array_shrink((a)))
+#define array_push_n(a,ptr,n)  ((a) = _array_push_n((a), (ptr), (n)))
+// Push every element of array b, which must have the same stride
+#define array_append(a,b)      ((a) = _array_push_n((a), (b), array_length((b))))
 #define array_pop(a,ptr)       _array_pop((a), (ptr))
 #define array_insert_at(a,i,v)                   \
     do {                                         \
@@ -51,6 +63,6 @@ void *_array_insert_at(void *array, size_t index, void *data);
         (a) = _array_insert_at((a), (i), &temp); \
     } while (0)
 #define array_pop_at(a,i,ptr)  _array_pop_at((a), (i), (ptr))
-#define array_clear(a)         _array_field_set((a), ARRAY_HEADER_LENGTH, 0)
+#define array_clear(a)         array_set_length((a), 0)
 
 #endif
\ No newline at end of file
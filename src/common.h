@@ -19,6 +19,11 @@ typedef float f32;
 typedef double f64;
 
 #define DEBUG_MODE
+// CPU profiling zones (profile.h), remove to compile them out
+#define PROFILE_MODE
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 #define CLAMP(value, min, max) \
     ((value) <= (min) ? (min) : ((value) >= (max) ? (max) : (value)))
@@ -3,30 +3,98 @@
 #include "memory.h"
 #include "array.h"
 #include "log.h"
+#include "profile.h"
 
+// Listeners of one event type, stored as parallel arrays so dispatch only walks
+// what it needs. Unregistering swaps the last entry into the hole.
 typedef struct {
-    void          *listener;
-    Event_Handler  callback;
-} Event;
+    void          **listeners;
+    Event_Handler  *callbacks;
+    u32            *slots; // Handle slot of every entry, to fix it up after a swap
+} Listener_List;
 
-// TODO: should we change it?
-// 
-// Raylib is also using 16384 for max events that can be handled. It seems that
-// people use 16384 because it's a power of two (2^14) and align with binary memory
-// allocation stuff. But I'm still wondering why people specifically use the number!?
-#define MAX_EVENT_LIST 16384
+// Indirection between handles and the dense arrays. The generation is bumped every
+// time the slot is freed, so stale handles don't match anymore.
+typedef struct {
+    u32 type;
+    u32 index;     // In the type's Listener_List, or the next free slot when unused
+    u32 generation;
+} Handle_Slot;
+
+#define NO_FREE_SLOT 0xFFFFFFFF
+
+// One entry per event type, the built-in ones first, then event_register_type
+static Listener_List *types = NULL;
+static u32 type_count = 0;
+
+static Handle_Slot *handle_slots = NULL;
+static u32 first_free_slot = NO_FREE_SLOT;
+
+typedef struct {
+    Event_Type    type;
+    Event_Context ctx;
+} Posted_Event;
+
+// Filled by event_post, event_flush sorts them by type into grouped_events
+static Posted_Event *posted_events = NULL;
+static Posted_Event *grouped_events = NULL;
+static bool flushing = false;
+
+#define CACHE_LINE_SIZE 64
+
+// Bounded MPSC queue for posts from other threads (same scheme as the log ring).
+// A slot's sequence equals the position when it's free and position + 1 once written.
+typedef struct {
+    u64          sequence;
+    Posted_Event event;
+} Queued_Event;
 
 static struct {
-    Event *events;
-} list[MAX_EVENT_LIST];
+    Queued_Event slots[EVENT_THREAD_QUEUE_CAPACITY];
+    u64 enqueue_pos __attribute__((aligned(CACHE_LINE_SIZE)));
+    u64 dequeue_pos __attribute__((aligned(CACHE_LINE_SIZE)));
+    u64 dropped_count __attribute__((aligned(CACHE_LINE_SIZE)));
+} thread_queue;
+
+// Set on the thread that owns the listeners and flushes
+static _Thread_local bool is_owner_thread = false;
 
 static bool initialized = false;
 
+static void add_type()
+{
+    Listener_List list = {
+        .listeners = array_create(void *),
+        .callbacks = array_create(Event_Handler),
+        .slots = array_create(u32),
+    };
+    array_push(types, list);
+    __atomic_store_n(&type_count, type_count + 1, __ATOMIC_RELEASE);
+}
+
 void event_init()
 {
     if (!initialized) {
-        list->events = NULL;
-        memory_zero(list, sizeof(list));
+        types = array_reserve(Listener_List, MAX_EVENT_TYPES);
+        type_count = 0;
+        for (u32 i = 0; i < MAX_EVENT_TYPES; ++i) {
+            add_type();
+        }
+
+        handle_slots = array_create(Handle_Slot);
+        first_free_slot = NO_FREE_SLOT;
+
+        posted_events = array_create(Posted_Event);
+        grouped_events = array_create(Posted_Event);
+
+        for (u64 i = 0; i < EVENT_THREAD_QUEUE_CAPACITY; ++i) {
+            thread_queue.slots[i].sequence = i;
+        }
+        thread_queue.enqueue_pos = 0;
+        thread_queue.dequeue_pos = 0;
+        thread_queue.dropped_count = 0;
+        is_owner_thread = true;
+
         initialized = true;
     } else {
         LOG_WARNING("Event list is already initialized\n");
@@ -40,57 +108,114 @@ void event_destroy()
         return;
     }
 
-    for (size_t i = 0; i < MAX_EVENT_LIST; ++i) {
-        if (list[i].events != NULL) {
-            array_destroy(list[i].events);
-            list[i].events = NULL;
-        }
+    for (u32 i = 0; i < type_count; ++i) {
+        array_destroy(types[i].listeners);
+        array_destroy(types[i].callbacks);
+        array_destroy(types[i].slots);
     }
+    array_destroy(types);
+    types = NULL;
+    type_count = 0;
+
+    array_destroy(handle_slots);
+    handle_slots = NULL;
+
+    array_destroy(posted_events);
+    array_destroy(grouped_events);
+    posted_events = NULL;
+    grouped_events = NULL;
+
+    initialized = false;
 }
 
-bool event_register(int type, void *listener, Event_Handler callback)
+Event_Type event_register_type()
 {
     if (!initialized) {
         LOG_WARNING("Event list is not initialized yet\n");
-        return false;
+        return MAX_EVENT_TYPES;
     }
 
-    if (list[type].events == NULL) {
-        list[type].events = array_create(Event);
+    add_type();
+    return (Event_Type)(type_count - 1);
+}
+
+Event_Handle event_register(Event_Type type, void *listener, Event_Handler callback)
+{
+    Event_Handle handle = {0};
+
+    if (!initialized) {
+        LOG_WARNING("Event list is not initialized yet\n");
+        return handle;
     }
 
-    size_t n = array_length(list[type].events);
-    for (size_t i = 0; i < n; ++i) {
-        Event e = list[type].events[i];
-        if (e.listener == listener) return false;
+    if ((u32)type >= type_count) {
+        LOG_WARNING("Can't register to unknown event type %d\n", type);
+        return handle;
     }
 
-    Event event = {
-        .listener = listener,
-        .callback = callback,
-    };
-    array_push(list[type].events, event);
+    u32 slot_index;
+    if (first_free_slot != NO_FREE_SLOT) {
+        slot_index = first_free_slot;
+        first_free_slot = handle_slots[slot_index].index;
+    } else {
+        Handle_Slot slot = {.generation = 1};
+        array_push(handle_slots, slot);
+        slot_index = (u32)array_length(handle_slots) - 1;
+    }
 
-    return true;
+    Listener_List *list = &types[type];
+    Handle_Slot *slot = &handle_slots[slot_index];
+    slot->type = type;
+    slot->index = (u32)array_length(list->listeners);
+
+    array_push(list->listeners, listener);
+    array_push(list->callbacks, callback);
+    array_push(list->slots, slot_index);
+
+    handle.index = slot_index;
+    handle.generation = slot->generation;
+    return handle;
 }
 
-bool event_unregister(Event_Type type, void *listener, Event_Handler callback)
+bool event_unregister(Event_Handle handle)
 {
     if (!initialized) {
         LOG_WARNING("Event list is not initialized yet\n");
         return false;
     }
 
-    if (list[type].events == NULL) return false;
+    if (handle.generation == 0 || handle.index >= array_length(handle_slots)) return false;
 
-    size_t n = array_length(list[type].events);
-    for (size_t i = 0; i < n; ++i) {
-        Event e = list[type].events[i];
-        if (e.listener == listener && e.callback == callback) {
-            Event unreg;
-            array_pop_at(list[type].events, i, &unreg);
-            return true;
-        }
+    Handle_Slot *slot = &handle_slots[handle.index];
+    if (slot->generation != handle.generation) return false;
+
+    // Move the last listener into the hole
+    Listener_List *list = &types[slot->type];
+    u32 last = (u32)array_length(list->listeners) - 1;
+    if (slot->index != last) {
+        list->listeners[slot->index] = list->listeners[last];
+        list->callbacks[slot->index] = list->callbacks[last];
+        list->slots[slot->index] = list->slots[last];
+        handle_slots[list->slots[slot->index]].index = slot->index;
+    }
+    array_set_length(list->listeners, last);
+    array_set_length(list->callbacks, last);
+    array_set_length(list->slots, last);
+
+    ++slot->generation;
+    if (slot->generation == 0) slot->generation = 1; // 0 marks the invalid handle
+    slot->index = first_free_slot;
+    first_free_slot = handle.index;
+
+    return true;
+}
+
+static bool dispatch(Event_Type type, Event_Context ctx)
+{
+    // Re-read the list every time, a handler may (un)register listeners
+    Listener_List *list = &types[type];
+    for (size_t i = 0; i < array_length(list->callbacks); ++i) {
+        if (list->callbacks[i](type, list->listeners[i], ctx)) return true;
     }
 
     return false;
@@ -98,18 +223,147 @@ bool event_unregister(Event_Type type, void *listener, Event_Handler callback)
 
 bool event_dispatch(Event_Type type, Event_Context ctx)
 {
+    PROFILE_ZONE("event_dispatch");
+
     if (!initialized) {
         LOG_WARNING("Event list is not initialized yet\n");
         return false;
     }
 
-    if (list[type].events == NULL) return false;
+    if ((u32)type >= type_count) return false;
+
+    return dispatch(type, ctx);
+}
 
-    size_t n = array_length(list[type].events);
+static bool thread_queue_push(const Posted_Event *event)
+{
+    Queued_Event *slot = NULL;
+    u64 pos = __atomic_load_n(&thread_queue.enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &thread_queue.slots[pos & (EVENT_THREAD_QUEUE_CAPACITY - 1)];
+        u64 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        i64 diff = (i64)sequence - (i64)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(
+                    &thread_queue.enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = __atomic_load_n(&thread_queue.enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->event = *event;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+// Move everything other threads posted into posted_events, in queue order. Stops
+// at a slot that's claimed but not written yet, the rest comes next flush.
+static void thread_queue_drain()
+{
+    u64 pos = thread_queue.dequeue_pos;
+    for (;;) {
+        Queued_Event *slot = &thread_queue.slots[pos & (EVENT_THREAD_QUEUE_CAPACITY - 1)];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1) break;
+
+        array_push(posted_events, slot->event);
+
+        __atomic_store_n(&slot->sequence, pos + EVENT_THREAD_QUEUE_CAPACITY, __ATOMIC_RELEASE);
+        ++pos;
+    }
+    thread_queue.dequeue_pos = pos;
+
+    u64 dropped = __atomic_exchange_n(&thread_queue.dropped_count, 0, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        LOG_WARNING("Event queue was full, dropped %llu events from other threads\n", dropped);
+    }
+}
+
+bool event_post(Event_Type type, Event_Context ctx)
+{
+    if (!initialized) {
+        LOG_WARNING("Event list is not initialized yet\n");
+        return false;
+    }
+
+    if ((u32)type >= __atomic_load_n(&type_count, __ATOMIC_ACQUIRE)) {
+        LOG_WARNING("Can't post unknown event type %d\n", type);
+        return false;
+    }
+
+    Posted_Event event = {
+        .type = type,
+        .ctx = ctx,
+    };
+
+    if (is_owner_thread) {
+        array_push(posted_events, event);
+        return true;
+    }
+
+    if (!thread_queue_push(&event)) {
+        // Reported on the next flush, logging here would just make it worse
+        __atomic_fetch_add(&thread_queue.dropped_count, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    return true;
+}
+
+void event_flush()
+{
+    PROFILE_ZONE("event_flush");
+
+    if (!initialized) {
+        LOG_WARNING("Event list is not initialized yet\n");
+        return;
+    }
+
+    if (flushing) {
+        LOG_WARNING("event_flush called from an event handler\n");
+        return;
+    }
+
+    thread_queue_drain();
+
+    size_t n = array_length(posted_events);
+    if (n == 0) return;
+
+    // Counting sort by type, stable so every type keeps its posting order
+    u32 count = type_count;
+    size_t offsets[count + 1];
+    memory_zero(offsets, sizeof(offsets));
     for (size_t i = 0; i < n; ++i) {
-        Event e = list[type].events[i];
-        if (e.callback(type, e.listener, ctx)) return true;
+        ++offsets[posted_events[i].type + 1];
+    }
+    for (u32 type = 0; type < count; ++type) {
+        offsets[type + 1] += offsets[type];
     }
 
-    return false;
+    array_clear(grouped_events);
+    array_reserve_more(grouped_events, n);
+    array_set_length(grouped_events, n);
+
+    size_t cursors[count];
+    memory_copy(cursors, offsets, sizeof(cursors));
+    for (size_t i = 0; i < n; ++i) {
+        grouped_events[cursors[posted_events[i].type]++] = posted_events[i];
+    }
+
+    // Handlers may post again, those go to the next flush
+    array_clear(posted_events);
+
+    flushing = true;
+    for (u32 type = 0; type < count; ++type) {
+        if (array_length(types[type].callbacks) == 0) continue;
+
+        for (size_t i = offsets[type]; i < offsets[type + 1]; ++i) {
+            dispatch(type, grouped_events[i].ctx);
+        }
+    }
+    flushing = false;
 }
\ No newline at end of file
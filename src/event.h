@@ -3,6 +3,9 @@
 
 #include "common.h"
 
+// Events other threads can post between two event_flush calls, power of two
+#define EVENT_THREAD_QUEUE_CAPACITY 4096
+
 typedef struct {
     union {
         i64 i64[2];
@@ -34,17 +37,42 @@ typedef enum {
     EVENT_MOUSE_BUTTON_PRESSED,
     EVENT_MOUSE_BUTTON_RELEASED,
 
+    // Window, new size in data.u32[0] (width) and data.u32[1] (height)
+    EVENT_WINDOW_RESIZED,
+
     MAX_EVENT_TYPES
 } Event_Type;
 
 typedef bool (*Event_Handler)(int event_type, void *listener, Event_Context ctx);
 
+// Returned by event_register, a zeroed handle is never valid
+typedef struct {
+    u32 index;
+    u32 generation;
+} Event_Handle;
+
+// Everything except event_post belongs to the thread that called event_init
 void event_init();
 void event_destroy();
 
-bool event_register(Event_Type type, void *listener, Event_Handler callback);
-bool event_unregister(Event_Type type, void *listener, Event_Handler callback);
+// New event type for the application, numbered after the built-in ones
+Event_Type event_register_type();
+
+// Handlers run in registration order until one returns true. Unregistering moves
+// the type's last listener into the freed spot, so that order isn't kept.
+Event_Handle event_register(Event_Type type, void *listener, Event_Handler callback);
+bool event_unregister(Event_Handle handle);
 
+// Calls the handlers right away, for events that can't wait
 bool event_dispatch(Event_Type type, Event_Context ctx);
 
+// Queue the event for the next event_flush. Safe to call from any thread, posts
+// from other threads than the one that called event_init go through a lock-free
+// queue and fail (return false) only when that queue is full.
+bool event_post(Event_Type type, Event_Context ctx);
+// Dispatch everything posted since the last flush, grouped by type. Events of the
+// same type keep the order they were posted in, across types it isn't kept.
+// Events posted by handlers during the flush wait for the next one.
+void event_flush();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "frame_pacer.h"
+
+#include <string.h>
+
+#include "log.h"
+#include "memory.h"
+#include "platform.h"
+#include "profile.h"
+
+#define NS_PER_MS 1000000ull
+#define BUCKET_NS (FRAME_PACER_BUCKET_US * 1000ull)
+#define HISTOGRAM_BAR_WIDTH 40
+
+static u64 target_frame_ns = 0;
+static u64 last_frame_end = 0;
+static u64 next_deadline = 0;
+
+// How much longer than asked platform_sleep_ms tends to take. Anything closer to the
+// deadline than that gets spun out instead of slept.
+static u64 sleep_overshoot_ns = NS_PER_MS;
+
+static Frame_Pacer_Stats stats;
+
+static bool initialized = false;
+
+void frame_pacer_init(u32 target_fps)
+{
+    if (initialized) {
+        LOG_WARNING("Frame pacer is already initialized\n");
+        return;
+    }
+
+    initialized = true;
+
+    frame_pacer_reset_stats();
+    frame_pacer_set_target_fps(target_fps);
+    frame_pacer_restart();
+}
+
+void frame_pacer_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Frame pacer is not initialized yet\n");
+        return;
+    }
+
+    frame_pacer_log_histogram();
+
+    initialized = false;
+}
+
+void frame_pacer_set_target_fps(u32 target_fps)
+{
+    target_frame_ns = target_fps > 0 ? 1000000000ull / target_fps : 0;
+    next_deadline = last_frame_end + target_frame_ns;
+}
+
+void frame_pacer_restart()
+{
+    last_frame_end = platform_get_time_ns();
+    next_deadline = last_frame_end + target_frame_ns;
+}
+
+static void wait_until(u64 deadline)
+{
+    PROFILE_ZONE("frame_pacer_wait");
+
+    for (;;) {
+        u64 now = platform_get_time_ns();
+        if (now >= deadline) return;
+
+        if (deadline - now > NS_PER_MS + sleep_overshoot_ns) {
+            platform_sleep_ms(1);
+
+            u64 slept = platform_get_time_ns() - now;
+            u64 overshoot = slept > NS_PER_MS ? slept - NS_PER_MS : 0;
+            // Take a bad sleep into account right away, forget it slowly
+            sleep_overshoot_ns = overshoot > sleep_overshoot_ns
+                ? overshoot
+                : sleep_overshoot_ns - (sleep_overshoot_ns - overshoot) / 16;
+        } else {
+            platform_thread_yield();
+        }
+    }
+}
+
+static void record_frame(u64 frame_ns, u64 work_ns)
+{
+    if (stats.frame_count == 0 || frame_ns < stats.min_ns) stats.min_ns = frame_ns;
+    if (frame_ns > stats.max_ns) stats.max_ns = frame_ns;
+
+    ++stats.frame_count;
+    stats.total_ns += frame_ns;
+    stats.work_total_ns += work_ns;
+
+    u64 bucket = frame_ns / BUCKET_NS;
+    ++stats.buckets[MIN(bucket, FRAME_PACER_BUCKET_COUNT - 1)];
+}
+
+void frame_pacer_end_frame()
+{
+    if (!initialized) return;
+
+    u64 work_end = platform_get_time_ns();
+
+    if (target_frame_ns > 0) {
+        // More than a whole frame late: start over from here instead of rushing out
+        // a few frames to catch up
+        if (work_end > next_deadline + target_frame_ns) {
+            next_deadline = work_end;
+        }
+
+        wait_until(next_deadline);
+        next_deadline += target_frame_ns;
+    }
+
+    u64 now = platform_get_time_ns();
+    record_frame(now - last_frame_end, work_end - last_frame_end);
+    last_frame_end = now;
+
+#if FRAME_PACER_SUMMARY_INTERVAL > 0
+    if (stats.frame_count >= FRAME_PACER_SUMMARY_INTERVAL) {
+        frame_pacer_log_histogram();
+    }
+#endif
+}
+
+const Frame_Pacer_Stats *frame_pacer_get_stats()
+{
+    return &stats;
+}
+
+void frame_pacer_reset_stats()
+{
+    memory_zero(&stats, sizeof(Frame_Pacer_Stats));
+}
+
+// Upper edge of the bucket the given fraction of frames falls in, in milliseconds
+static f64 get_percentile_ms(f64 fraction)
+{
+    u64 threshold = (u64)(stats.frame_count * fraction);
+    u64 count = 0;
+    for (u32 i = 0; i < FRAME_PACER_BUCKET_COUNT; ++i) {
+        count += stats.buckets[i];
+        if (count > threshold) return (i + 1) * FRAME_PACER_BUCKET_US / 1000.0;
+    }
+    return FRAME_PACER_BUCKET_COUNT * FRAME_PACER_BUCKET_US / 1000.0;
+}
+
+// Logs the histogram and starts a new one
+void frame_pacer_log_histogram()
+{
+    if (!initialized || stats.frame_count == 0) return;
+
+    f64 average_ms = (f64)stats.total_ns / stats.frame_count / NS_PER_MS;
+    LOG_INFO("Frame times over %llu frames (target %s%.2f ms):\n",
+        stats.frame_count,
+        target_frame_ns > 0 ? "" : "none, ",
+        (f64)target_frame_ns / NS_PER_MS);
+    LOG_INFO("  avg %.2f ms (%.1f fps), busy %.2f ms, min %.2f ms, max %.2f ms\n",
+        average_ms,
+        1000.0 / average_ms,
+        (f64)stats.work_total_ns / stats.frame_count / NS_PER_MS,
+        (f64)stats.min_ns / NS_PER_MS,
+        (f64)stats.max_ns / NS_PER_MS);
+    LOG_INFO("  p50 < %.1f ms, p95 < %.1f ms, p99 < %.1f ms\n",
+        get_percentile_ms(0.50),
+        get_percentile_ms(0.95),
+        get_percentile_ms(0.99));
+
+    u64 largest_bucket = 0;
+    for (u32 i = 0; i < FRAME_PACER_BUCKET_COUNT; ++i) {
+        largest_bucket = MAX(largest_bucket, stats.buckets[i]);
+    }
+
+    for (u32 i = 0; i < FRAME_PACER_BUCKET_COUNT; ++i) {
+        if (stats.buckets[i] == 0) continue;
+
+        char bar[HISTOGRAM_BAR_WIDTH + 1];
+        u32 width = (u32)(stats.buckets[i] * HISTOGRAM_BAR_WIDTH / largest_bucket);
+        memset(bar, '#', width);
+        bar[width] = '\0';
+
+        f64 low_ms = i * FRAME_PACER_BUCKET_US / 1000.0;
+        f64 percent = 100.0 * stats.buckets[i] / stats.frame_count;
+        if (i == FRAME_PACER_BUCKET_COUNT - 1) {
+            LOG_INFO("  %5.1f+        ms %6.2f%% %s\n", low_ms, percent, bar);
+        } else {
+            LOG_INFO("  %5.1f - %5.1f ms %6.2f%% %s\n",
+                low_ms, low_ms + FRAME_PACER_BUCKET_US / 1000.0, percent, bar);
+        }
+    }
+
+    frame_pacer_reset_stats();
+}
@@ -0,0 +1,44 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include "common.h"
+
+// CPU side frame limiter and frame time statistics. Call frame_pacer_end_frame once
+// per frame, after presenting: with a target set it sleeps (then spins for the last
+// bit, sleeps aren't precise) until the frame's deadline, either way it records the
+// time since the previous frame into a histogram.
+
+// Histogram resolution, frame times past the last bucket are counted in it
+#define FRAME_PACER_BUCKET_US 500
+#define FRAME_PACER_BUCKET_COUNT 80
+
+// Frames between two histograms in the log, 0 turns them off
+#ifndef FRAME_PACER_SUMMARY_INTERVAL
+#define FRAME_PACER_SUMMARY_INTERVAL 1800
+#endif
+
+typedef struct {
+    u64 frame_count;
+    u64 total_ns;
+    u64 work_total_ns; // Part of total_ns not spent waiting in the pacer
+    u64 min_ns;
+    u64 max_ns;
+    u64 buckets[FRAME_PACER_BUCKET_COUNT];
+} Frame_Pacer_Stats;
+
+// target_fps 0 doesn't limit anything, frame times are still recorded
+void frame_pacer_init(u32 target_fps);
+void frame_pacer_destroy();
+
+void frame_pacer_set_target_fps(u32 target_fps);
+void frame_pacer_end_frame();
+// Start timing from now without recording anything, after the loop was paused
+// (e.g. minimized) so the pause doesn't show up as one very long frame
+void frame_pacer_restart();
+
+// Everything recorded since the last reset
+const Frame_Pacer_Stats *frame_pacer_get_stats();
+void frame_pacer_reset_stats();
+void frame_pacer_log_histogram();
+
+#endif
@@ -0,0 +1,338 @@
+#include "hash_map.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HASH_MAP_SSE2 1
+#endif
+
+// Control bytes: full slots hold the low 7 bits of the hash (high bit clear)
+#define CONTROL_EMPTY   0x80
+#define CONTROL_DELETED 0xFE
+
+#define MIN_CAPACITY HASH_MAP_GROUP_WIDTH
+
+// Keep the load under 7/8
+static size_t max_count(size_t capacity)
+{
+    return capacity - capacity / 8;
+}
+
+static u64 mix(u64 h)
+{
+    // murmur3 finalizer, spreads the bits so both H1 and H2 are usable
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+u64 hash_bytes(const void *data, size_t size)
+{
+    // FNV-1a
+    const u8 *bytes = (const u8 *)data;
+    u64 h = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001B3ull;
+    }
+    return mix(h);
+}
+
+u64 hash_string(const char *string)
+{
+    u64 h = 0xCBF29CE484222325ull;
+    for (const u8 *c = (const u8 *)string; *c; ++c) {
+        h ^= *c;
+        h *= 0x100000001B3ull;
+    }
+    return mix(h);
+}
+
+static u64 hash_key_bytes(const void *key, size_t key_size)
+{
+    return hash_bytes(key, key_size);
+}
+
+static bool equal_key_bytes(const void *a, const void *b, size_t key_size)
+{
+    return memcmp(a, b, key_size) == 0;
+}
+
+static u64 hash_key_string(const void *key, size_t key_size)
+{
+    return hash_string(*(const char **)key);
+}
+
+static bool equal_key_string(const void *a, const void *b, size_t key_size)
+{
+    return strcmp(*(const char **)a, *(const char **)b) == 0;
+}
+
+// Bit i is set when control byte i of the group matches
+#ifdef HASH_MAP_SSE2
+static inline u32 group_match(const u8 *group, u8 h2)
+{
+    __m128i control = _mm_loadu_si128((const __m128i *)group);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char)h2)));
+}
+
+static inline u32 group_match_empty(const u8 *group)
+{
+    return group_match(group, CONTROL_EMPTY);
+}
+
+static inline u32 group_match_empty_or_deleted(const u8 *group)
+{
+    // Only empty and deleted have the high bit set
+    __m128i control = _mm_loadu_si128((const __m128i *)group);
+    return (u32)_mm_movemask_epi8(control);
+}
+#else
+static inline u32 group_match(const u8 *group, u8 h2)
+{
+    u32 mask = 0;
+    for (u32 i = 0; i < HASH_MAP_GROUP_WIDTH; ++i) {
+        if (group[i] == h2) mask |= 1u << i;
+    }
+    return mask;
+}
+
+static inline u32 group_match_empty(const u8 *group)
+{
+    return group_match(group, CONTROL_EMPTY);
+}
+
+static inline u32 group_match_empty_or_deleted(const u8 *group)
+{
+    u32 mask = 0;
+    for (u32 i = 0; i < HASH_MAP_GROUP_WIDTH; ++i) {
+        if (group[i] & 0x80) mask |= 1u << i;
+    }
+    return mask;
+}
+#endif
+
+static inline u8 *slot_at(Hash_Map *map, size_t index)
+{
+    return map->slots + index * map->slot_size;
+}
+
+static inline size_t group_count(Hash_Map *map)
+{
+    return map->capacity / HASH_MAP_GROUP_WIDTH;
+}
+
+static void allocate(Hash_Map *map, size_t capacity)
+{
+    map->capacity = capacity;
+    map->control = memory_alloc(capacity, map->tag);
+    map->slots = memory_alloc(capacity * map->slot_size, map->tag);
+    memset(map->control, CONTROL_EMPTY, capacity);
+    map->count = 0;
+    map->growth_left = max_count(capacity);
+}
+
+static void release(Hash_Map *map)
+{
+    memory_free(map->control, map->capacity, map->tag);
+    memory_free(map->slots, map->capacity * map->slot_size, map->tag);
+}
+
+static size_t capacity_for(size_t count)
+{
+    size_t capacity = MIN_CAPACITY;
+    while (max_count(capacity) < count) capacity *= 2;
+    return capacity;
+}
+
+static void init(
+    Hash_Map *map,
+    size_t key_size,
+    size_t value_size,
+    size_t capacity,
+    Memory_Tag tag,
+    Hash_Map_Hash_Proc hash,
+    Hash_Map_Equal_Proc equal)
+{
+    map->key_size = (u32)key_size;
+    map->value_size = (u32)value_size;
+    map->slot_size = (u32)(key_size + value_size);
+    map->hash = hash;
+    map->equal = equal;
+    map->tag = tag;
+    allocate(map, capacity_for(capacity));
+}
+
+void hash_map_create(Hash_Map *map, size_t key_size, size_t value_size, size_t capacity, Memory_Tag tag)
+{
+    init(map, key_size, value_size, capacity, tag, hash_key_bytes, equal_key_bytes);
+}
+
+void hash_map_create_string(Hash_Map *map, size_t value_size, size_t capacity, Memory_Tag tag)
+{
+    init(map, sizeof(const char *), value_size, capacity, tag, hash_key_string, equal_key_string);
+}
+
+void hash_map_create_custom(
+    Hash_Map *map,
+    size_t key_size,
+    size_t value_size,
+    size_t capacity,
+    Hash_Map_Hash_Proc hash,
+    Hash_Map_Equal_Proc equal,
+    Memory_Tag tag)
+{
+    init(map, key_size, value_size, capacity, tag, hash, equal);
+}
+
+void hash_map_destroy(Hash_Map *map)
+{
+    release(map);
+    memory_zero(map, sizeof(Hash_Map));
+}
+
+// Index of the slot holding key, or capacity when there is none
+static size_t find(Hash_Map *map, const void *key, u64 hash)
+{
+    u8 h2 = (u8)(hash & 0x7F);
+    size_t mask = group_count(map) - 1;
+    size_t group = (hash >> 7) & mask;
+
+    // Triangular probing visits every group once when the group count is a power of two
+    for (size_t step = 1; step <= group_count(map); ++step) {
+        const u8 *control = map->control + group * HASH_MAP_GROUP_WIDTH;
+
+        u32 matches = group_match(control, h2);
+        while (matches) {
+            size_t index = group * HASH_MAP_GROUP_WIDTH + __builtin_ctz(matches);
+            if (map->equal(slot_at(map, index), key, map->key_size)) return index;
+            matches &= matches - 1;
+        }
+
+        // An empty slot means the key would have been placed in this group
+        if (group_match_empty(control)) break;
+
+        group = (group + step) & mask;
+    }
+
+    return map->capacity;
+}
+
+// First empty or deleted slot along the key's probe sequence
+static size_t find_insert_slot(Hash_Map *map, u64 hash)
+{
+    size_t mask = group_count(map) - 1;
+    size_t group = (hash >> 7) & mask;
+
+    for (size_t step = 1;; ++step) {
+        u32 available = group_match_empty_or_deleted(map->control + group * HASH_MAP_GROUP_WIDTH);
+        if (available) return group * HASH_MAP_GROUP_WIDTH + __builtin_ctz(available);
+
+        group = (group + step) & mask;
+    }
+}
+
+static void rehash(Hash_Map *map, size_t new_capacity)
+{
+    Hash_Map old = *map;
+    allocate(map, new_capacity);
+
+    for (size_t i = 0; i < old.capacity; ++i) {
+        if (old.control[i] & 0x80) continue;
+
+        u8 *slot = slot_at(&old, i);
+        u64 hash = map->hash(slot, map->key_size);
+        size_t index = find_insert_slot(map, hash);
+        map->control[index] = (u8)(hash & 0x7F);
+        memcpy(slot_at(map, index), slot, map->slot_size);
+    }
+    map->count = old.count;
+    map->growth_left -= old.count;
+
+    release(&old);
+}
+
+void *hash_map_get(Hash_Map *map, const void *key)
+{
+    size_t index = find(map, key, map->hash(key, map->key_size));
+    if (index == map->capacity) return NULL;
+
+    return slot_at(map, index) + (map->value_size ? map->key_size : 0);
+}
+
+void *hash_map_insert(Hash_Map *map, const void *key, const void *value)
+{
+    u64 hash = map->hash(key, map->key_size);
+
+    size_t index = find(map, key, hash);
+    if (index == map->capacity) {
+        index = find_insert_slot(map, hash);
+        if (map->growth_left == 0 && map->control[index] == CONTROL_EMPTY) {
+            // Out of room. If it's mostly tombstones the same size is enough.
+            size_t new_capacity = map->count + 1 > max_count(map->capacity) / 2
+                ? map->capacity * 2
+                : map->capacity;
+            rehash(map, new_capacity);
+            index = find_insert_slot(map, hash);
+        }
+
+        if (map->control[index] == CONTROL_EMPTY) --map->growth_left;
+        map->control[index] = (u8)(hash & 0x7F);
+        ++map->count;
+        memcpy(slot_at(map, index), key, map->key_size);
+    }
+
+    u8 *value_ptr = slot_at(map, index) + map->key_size;
+    if (value && map->value_size) {
+        memcpy(value_ptr, value, map->value_size);
+    }
+
+    return map->value_size ? value_ptr : slot_at(map, index);
+}
+
+bool hash_map_remove(Hash_Map *map, const void *key)
+{
+    size_t index = find(map, key, map->hash(key, map->key_size));
+    if (index == map->capacity) return false;
+
+    // Probes stop at a group with an empty slot, so if this group already has one
+    // nobody probes past it and the slot can go back to empty. Otherwise leave a
+    // tombstone to keep the chain intact.
+    const u8 *group = map->control + (index / HASH_MAP_GROUP_WIDTH) * HASH_MAP_GROUP_WIDTH;
+    if (group_match_empty(group)) {
+        map->control[index] = CONTROL_EMPTY;
+        ++map->growth_left;
+    } else {
+        map->control[index] = CONTROL_DELETED;
+    }
+    --map->count;
+
+    return true;
+}
+
+void hash_map_clear(Hash_Map *map)
+{
+    memset(map->control, CONTROL_EMPTY, map->capacity);
+    map->count = 0;
+    map->growth_left = max_count(map->capacity);
+}
+
+bool hash_map_next(Hash_Map *map, size_t *iterator, void **key, void **value)
+{
+    for (size_t i = *iterator; i < map->capacity; ++i) {
+        if (map->control[i] & 0x80) continue;
+
+        u8 *slot = slot_at(map, i);
+        if (key) *key = slot;
+        if (value) *value = map->value_size ? slot + map->key_size : NULL;
+        *iterator = i + 1;
+        return true;
+    }
+
+    *iterator = map->capacity;
+    return false;
+}
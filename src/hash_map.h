@@ -0,0 +1,63 @@
+#ifndef HASH_MAP_H
+#define HASH_MAP_H
+
+#include "common.h"
+#include "memory.h"
+
+// Open addressing hash map in the style of Swiss tables: one control byte per
+// slot (empty, deleted or 7 bits of the hash), slots are probed a group of 16 at
+// a time, with SSE2 when it's available. Keys and values are copied in as raw
+// bytes, a value_size of 0 makes it a set.
+//
+// Pointers returned by get/insert are invalidated by the next insert.
+
+#define HASH_MAP_GROUP_WIDTH 16
+
+typedef u64 (*Hash_Map_Hash_Proc)(const void *key, size_t key_size);
+typedef bool (*Hash_Map_Equal_Proc)(const void *a, const void *b, size_t key_size);
+
+typedef struct {
+    u8     *control;
+    u8     *slots;
+    size_t  capacity;    // Power of two, multiple of the group width
+    size_t  count;
+    size_t  growth_left; // Inserts left before a rehash, deleted slots count as used
+
+    u32 key_size;
+    u32 value_size;
+    u32 slot_size;
+
+    Hash_Map_Hash_Proc  hash;
+    Hash_Map_Equal_Proc equal;
+    Memory_Tag          tag;
+} Hash_Map;
+
+// Keys are compared and hashed byte by byte
+void hash_map_create(Hash_Map *map, size_t key_size, size_t value_size, size_t capacity, Memory_Tag tag);
+// Keys are const char * and compared by content, the strings aren't copied
+void hash_map_create_string(Hash_Map *map, size_t value_size, size_t capacity, Memory_Tag tag);
+// For keys that point at their data, hash has to agree with equal
+void hash_map_create_custom(
+    Hash_Map *map,
+    size_t key_size,
+    size_t value_size,
+    size_t capacity,
+    Hash_Map_Hash_Proc hash,
+    Hash_Map_Equal_Proc equal,
+    Memory_Tag tag);
+void hash_map_destroy(Hash_Map *map);
+
+// Pointer to the value (or to the key for sets), NULL when it's not there
+void *hash_map_get(Hash_Map *map, const void *key);
+// Inserts or overwrites, value may be NULL to leave it uninitialized
+void *hash_map_insert(Hash_Map *map, const void *key, const void *value);
+bool hash_map_remove(Hash_Map *map, const void *key);
+void hash_map_clear(Hash_Map *map);
+
+// Start with *iterator = 0, key and value may be NULL
+bool hash_map_next(Hash_Map *map, size_t *iterator, void **key, void **value);
+
+u64 hash_bytes(const void *data, size_t size);
+u64 hash_string(const char *string);
+
+#endif
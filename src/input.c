@@ -4,6 +4,7 @@
 #include "memory.h"
 #include "event.h"
 #include "log.h"
+#include "profile.h"
 
 typedef struct {
     bool keys[MAX_INPUT_KEYS];
@@ -34,6 +35,8 @@ void input_destroy()
 
 void input_update()
 {
+    PROFILE_ZONE("input_update");
+
     if (!initialized) return;
 
     memory_copy(&state.prev.keys, &state.current.keys, sizeof(state.prev.keys));
@@ -54,7 +57,7 @@ void input_process_key(Input_Key key, bool pressed)
 
         Event_Context ctx = {0};
         ctx.data.u16[0] = key;
-        event_dispatch(pressed ? EVENT_KEY_PRESSED : EVENT_KEY_RELEASED, ctx);
+        event_post(pressed ? EVENT_KEY_PRESSED : EVENT_KEY_RELEASED, ctx);
     }
 }
 
@@ -94,7 +97,7 @@ void input_process_mouse_button(Input_Mouse_Button mb, bool pressed)
 
         Event_Context ctx = {0};
         ctx.data.u16[0] = mb;
-        event_dispatch(pressed ? EVENT_MOUSE_BUTTON_PRESSED : EVENT_MOUSE_BUTTON_RELEASED, ctx);
+        event_post(pressed ? EVENT_MOUSE_BUTTON_PRESSED : EVENT_MOUSE_BUTTON_RELEASED, ctx);
     }
 }
 
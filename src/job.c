@@ -0,0 +1,326 @@
+#include "job.h"
+
+#include <stdio.h>
+
+#include "log.h"
+#include "memory.h"
+#include "platform.h"
+#include "profile.h"
+
+// Both must be powers of two. A thread can't have more than JOB_POOL_SIZE jobs
+// in flight, the pool is a ring that wraps around.
+#define JOB_DEQUE_CAPACITY 4096
+#define JOB_POOL_SIZE      4096
+
+// Spin this many times without finding work before a worker goes to sleep
+#define JOB_IDLE_SPIN_COUNT 64
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct {
+    Job          job;
+    Job_Counter *counter;
+} Queued_Job;
+
+// Chase-Lev work-stealing deque. The owner pushes and pops at the bottom,
+// other threads steal from the top.
+typedef struct {
+    i64         top __attribute__((aligned(CACHE_LINE_SIZE)));
+    i64         bottom __attribute__((aligned(CACHE_LINE_SIZE)));
+    Queued_Job *entries[JOB_DEQUE_CAPACITY];
+} Job_Deque;
+
+typedef struct {
+    Job_Deque       deque;
+    Queued_Job      pool[JOB_POOL_SIZE];
+    u32             pool_index;
+    u32             random_state; // For picking steal victims
+    Platform_Thread thread;
+} Job_Thread;
+
+static Job_Thread *threads = NULL;
+static u32 thread_count = 0;
+
+static Platform_Semaphore wakeup;
+static u32 sleeping_count = 0;
+static u32 pending_count = 0; // Queued but not taken yet, only used to decide whether to sleep
+static bool running = false;
+
+static _Thread_local u32 thread_index = 0;
+
+static bool initialized = false;
+
+static bool deque_push(Job_Deque *deque, Queued_Job *job)
+{
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= JOB_DEQUE_CAPACITY) return false;
+
+    __atomic_store_n(&deque->entries[bottom & (JOB_DEQUE_CAPACITY - 1)], job, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static Queued_Job *deque_pop(Job_Deque *deque)
+{
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        // Empty
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    Queued_Job *job = __atomic_load_n(&deque->entries[bottom & (JOB_DEQUE_CAPACITY - 1)], __ATOMIC_RELAXED);
+    if (top == bottom) {
+        // Last one, race the thieves for it
+        if (!__atomic_compare_exchange_n(
+                &deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            job = NULL;
+        }
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+
+    return job;
+}
+
+static Queued_Job *deque_steal(Job_Deque *deque)
+{
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) return NULL;
+
+    Queued_Job *job = __atomic_load_n(&deque->entries[top & (JOB_DEQUE_CAPACITY - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(
+            &deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        // Lost to the owner or another thief
+        return NULL;
+    }
+
+    return job;
+}
+
+static void execute(Queued_Job *job)
+{
+    job->job.proc(job->job.data);
+    if (job->counter) {
+        __atomic_fetch_sub(&job->counter->value, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static u32 next_random(Job_Thread *thread)
+{
+    // xorshift32
+    u32 x = thread->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    thread->random_state = x;
+    return x;
+}
+
+static Queued_Job *take_job()
+{
+    Job_Thread *self = &threads[thread_index];
+
+    Queued_Job *job = deque_pop(&self->deque);
+    if (!job && thread_count > 1) {
+        // Try every other thread once, starting somewhere random
+        u32 start = next_random(self) % thread_count;
+        for (u32 i = 0; i < thread_count && !job; ++i) {
+            u32 victim = (start + i) % thread_count;
+            if (victim == thread_index) continue;
+            job = deque_steal(&threads[victim].deque);
+        }
+    }
+
+    if (job) {
+        __atomic_fetch_sub(&pending_count, 1, __ATOMIC_RELAXED);
+    }
+
+    return job;
+}
+
+static void wake_worker()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    u32 sleeping = __atomic_load_n(&sleeping_count, __ATOMIC_RELAXED);
+    while (sleeping > 0) {
+        if (__atomic_compare_exchange_n(
+                &sleeping_count, &sleeping, sleeping - 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            platform_semaphore_signal(&wakeup);
+            return;
+        }
+    }
+}
+
+static void worker_sleep()
+{
+    __atomic_fetch_add(&sleeping_count, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    bool has_work = __atomic_load_n(&pending_count, __ATOMIC_RELAXED) > 0;
+    bool stopping = !__atomic_load_n(&running, __ATOMIC_ACQUIRE);
+    if (has_work || stopping) {
+        // Take ourselves off the sleeping list again. If someone beat us to it they
+        // also signaled, consume that so the count stays right.
+        u32 sleeping = __atomic_load_n(&sleeping_count, __ATOMIC_RELAXED);
+        while (sleeping > 0) {
+            if (__atomic_compare_exchange_n(
+                    &sleeping_count, &sleeping, sleeping - 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                return;
+            }
+        }
+    }
+
+    platform_semaphore_wait(&wakeup);
+}
+
+static u32 worker_proc(void *arg)
+{
+    thread_index = (u32)(size_t)arg;
+
+    char name[32];
+    snprintf(name, sizeof(name), "job worker %u", thread_index);
+    profile_set_thread_name(name);
+
+    u32 idle_spins = 0;
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        Queued_Job *job = take_job();
+        if (job) {
+            execute(job);
+            idle_spins = 0;
+        } else if (++idle_spins < JOB_IDLE_SPIN_COUNT) {
+            platform_thread_yield();
+        } else {
+            worker_sleep();
+            idle_spins = 0;
+        }
+    }
+
+    return 0;
+}
+
+void job_system_init(u32 worker_count)
+{
+    if (initialized) {
+        LOG_WARNING("Job system is already initialized\n");
+        return;
+    }
+
+    if (worker_count == 0) {
+        u32 processor_count = platform_get_processor_count();
+        worker_count = processor_count > 1 ? processor_count - 1 : 0;
+    }
+    thread_count = CLAMP(worker_count + 1, 1, MAX_JOB_THREADS);
+
+    threads = memory_alloc(sizeof(Job_Thread) * thread_count, MEMORY_TAG_JOB);
+    memory_zero(threads, sizeof(Job_Thread) * thread_count);
+    for (u32 i = 0; i < thread_count; ++i) {
+        threads[i].random_state = 0x9E3779B9u * (i + 1);
+    }
+
+    platform_semaphore_create(&wakeup, 0);
+    sleeping_count = 0;
+    pending_count = 0;
+    running = true;
+
+    thread_index = 0;
+    for (u32 i = 1; i < thread_count; ++i) {
+        platform_thread_create(&threads[i].thread, worker_proc, (void *)(size_t)i);
+    }
+
+    LOG_INFO("Job system running with %u threads\n", thread_count);
+
+    initialized = true;
+}
+
+void job_system_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Job system is not initialized yet\n");
+        return;
+    }
+
+    // Whatever is still queued gets run first
+    while (__atomic_load_n(&pending_count, __ATOMIC_ACQUIRE) > 0) {
+        Queued_Job *job = take_job();
+        if (job) execute(job);
+    }
+
+    __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+    for (u32 i = 1; i < thread_count; ++i) {
+        platform_semaphore_signal(&wakeup);
+    }
+    for (u32 i = 1; i < thread_count; ++i) {
+        platform_thread_join(&threads[i].thread);
+    }
+
+    platform_semaphore_destroy(&wakeup);
+    memory_free(threads, sizeof(Job_Thread) * thread_count, MEMORY_TAG_JOB);
+    threads = NULL;
+    thread_count = 0;
+
+    initialized = false;
+}
+
+void job_run(const Job *jobs, u32 count, Job_Counter *counter)
+{
+    if (!initialized) {
+        LOG_WARNING("Job system is not initialized yet\n");
+        return;
+    }
+
+    if (counter) {
+        __atomic_fetch_add(&counter->value, count, __ATOMIC_RELAXED);
+    }
+
+    Job_Thread *self = &threads[thread_index];
+    for (u32 i = 0; i < count; ++i) {
+        Queued_Job *job = &self->pool[self->pool_index++ & (JOB_POOL_SIZE - 1)];
+        job->job = jobs[i];
+        job->counter = counter;
+
+        // Count it before it becomes visible, a thief decrements right after stealing
+        __atomic_fetch_add(&pending_count, 1, __ATOMIC_RELAXED);
+        if (deque_push(&self->deque, job)) {
+            wake_worker();
+        } else {
+            // Deque is full, no point in queueing more
+            __atomic_fetch_sub(&pending_count, 1, __ATOMIC_RELAXED);
+            execute(job);
+        }
+    }
+}
+
+void job_wait(Job_Counter *counter)
+{
+    if (!initialized) {
+        LOG_WARNING("Job system is not initialized yet\n");
+        return;
+    }
+
+    while (__atomic_load_n(&counter->value, __ATOMIC_ACQUIRE) > 0) {
+        Queued_Job *job = take_job();
+        if (job) {
+            execute(job);
+        } else {
+            platform_thread_yield();
+        }
+    }
+}
+
+u32 job_thread_index()
+{
+    return thread_index;
+}
+
+u32 job_thread_count()
+{
+    return thread_count;
+}
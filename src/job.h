@@ -0,0 +1,36 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include "common.h"
+
+// Upper bound on threads taking part (main thread included)
+#define MAX_JOB_THREADS 64
+
+typedef void (*Job_Proc)(void *data);
+
+typedef struct {
+    Job_Proc  proc;
+    void     *data;
+} Job;
+
+// Number of unfinished jobs in a batch, zero-initialize before the first job_run.
+// Waiting on one counter inside a job is how dependencies are expressed.
+typedef struct {
+    u32 value;
+} Job_Counter;
+
+// worker_count == 0 means one worker per core besides the calling (main) thread
+void job_system_init(u32 worker_count);
+void job_system_destroy();
+
+// Queue jobs on the calling thread's deque, idle workers steal from it. Only call
+// this from the main thread or from inside a job. counter may be NULL for fire and forget.
+void job_run(const Job *jobs, u32 count, Job_Counter *counter);
+// Runs queued jobs on this thread until the counter reaches zero
+void job_wait(Job_Counter *counter);
+
+// 0 is the thread that called job_system_init, workers are 1..count-1
+u32 job_thread_index();
+u32 job_thread_count();
+
+#endif
@@ -7,48 +7,269 @@
 #include "common.h"
 #include "platform.h"
 
-void log_output_fmt(Log_Level level, const char *fmt, ...)
-{
-    size_t max_length = 4 * 1024; // 4 KiB
-    char buffer[max_length];
+// Messages longer than this (prefix included) get truncated
+#define LOG_MESSAGE_MAX_LENGTH 1024
+// Must be a power of two
+#define LOG_RING_CAPACITY 1024
+
+#define CACHE_LINE_SIZE 64
+
+// One message in the ring. The sequence tells whose turn it is: it equals the
+// position when the slot is free to write and position + 1 once it's written.
+typedef struct {
+    u64       sequence;
+    Log_Level level;
+    char      message[LOG_MESSAGE_MAX_LENGTH];
+} Log_Slot;
+
+// Bounded multi-producer single-consumer ring (Vyukov style). Producers only
+// contend on enqueue_pos, the consumer thread owns dequeue_pos.
+static struct {
+    Log_Slot slots[LOG_RING_CAPACITY];
 
-    // Initialize the buffer to empty
-    buffer[0] = '\0';
+    u64 enqueue_pos __attribute__((aligned(CACHE_LINE_SIZE)));
+    u64 dequeue_pos __attribute__((aligned(CACHE_LINE_SIZE)));
+    u64 dropped_count __attribute__((aligned(CACHE_LINE_SIZE)));
 
+    bool sleeping __attribute__((aligned(CACHE_LINE_SIZE)));
+    bool running;
+
+    Platform_Semaphore wakeup;
+    Platform_Thread    thread;
+    FILE              *file;
+} logger;
+
+static bool initialized = false;
+
+static size_t format_message(char *buffer, size_t max_length, Log_Level level, const char *fmt, va_list args)
+{
+    const char *prefix = NULL;
     switch (level) {
         case LOG_LEVEL_INFO:
-            strcat_s(buffer, max_length, "[INFO] ");
+            prefix = "[INFO] ";
             break;
             
         case LOG_LEVEL_DEBUG:
-            strcat_s(buffer, max_length, "[DEBUG] ");
+            prefix = "[DEBUG] ";
             break;
             
         case LOG_LEVEL_WARNING:
-            strcat_s(buffer, max_length, "[WARNING] ");
+            prefix = "[WARNING] ";
             break;
             
         case LOG_LEVEL_ERROR:
-            strcat_s(buffer, max_length, "[ERROR] ");
+            prefix = "[ERROR] ";
             break;
 
         case LOG_LEVEL_FATAL:
-            strcat_s(buffer, max_length, "[FATAL] ");
+            prefix = "[FATAL] ";
             break;
 
         default:
-            return;
+            return 0;
+    }
+
+    // Plain snprintf/vsnprintf so it builds with both the MSVC and glibc runtimes.
+    // Both of them truncate and null-terminate when the message is too long.
+    size_t buffer_length = snprintf(buffer, max_length, "%s", prefix);
+    vsnprintf(buffer + buffer_length, max_length - buffer_length, fmt, args);
+
+    return buffer_length;
+}
+
+static void write_to_sinks(Log_Level level, const char *message)
+{
+    platform_log_output(level, message);
+    if (logger.file) {
+        fputs(message, logger.file);
+    }
+}
+
+// Returns false if the ring is full, never blocks
+static bool ring_push(Log_Level level, const char *fmt, va_list args)
+{
+    Log_Slot *slot = NULL;
+    u64 pos = __atomic_load_n(&logger.enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &logger.slots[pos & (LOG_RING_CAPACITY - 1)];
+        u64 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        i64 diff = (i64)sequence - (i64)pos;
+        if (diff == 0) {
+            // On failure pos gets reloaded with the current value
+            if (__atomic_compare_exchange_n(
+                    &logger.enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The consumer hasn't released this slot yet
+            return false;
+        } else {
+            pos = __atomic_load_n(&logger.enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->level = level;
+    format_message(slot->message, LOG_MESSAGE_MAX_LENGTH, level, fmt, args);
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static bool ring_has_message()
+{
+    u64 pos = __atomic_load_n(&logger.dequeue_pos, __ATOMIC_RELAXED);
+    Log_Slot *slot = &logger.slots[pos & (LOG_RING_CAPACITY - 1)];
+    return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+// Consumer side, writes out everything that's ready. Returns the number of messages.
+static u32 ring_drain()
+{
+    u32 count = 0;
+    u64 pos = __atomic_load_n(&logger.dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        Log_Slot *slot = &logger.slots[pos & (LOG_RING_CAPACITY - 1)];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1) break;
+
+        write_to_sinks(slot->level, slot->message);
+
+        // Hand the slot back to the producers for the next lap
+        __atomic_store_n(&slot->sequence, pos + LOG_RING_CAPACITY, __ATOMIC_RELEASE);
+        ++pos;
+        __atomic_store_n(&logger.dequeue_pos, pos, __ATOMIC_RELEASE);
+        ++count;
+    }
+
+    u64 dropped = __atomic_exchange_n(&logger.dropped_count, 0, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer), "[WARNING] Log ring overflowed, dropped %llu messages\n", dropped);
+        write_to_sinks(LOG_LEVEL_WARNING, buffer);
+    }
+
+    if (count > 0 && logger.file) {
+        fflush(logger.file);
+    }
+
+    return count;
+}
+
+static void wake_consumer()
+{
+    // Pairs with the fence in log_thread_proc, either we see it sleeping or it sees our message
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&logger.sleeping, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&logger.sleeping, false, __ATOMIC_ACQ_REL)) {
+        platform_semaphore_signal(&logger.wakeup);
     }
+}
 
+static u32 log_thread_proc(void *arg)
+{
+    for (;;) {
+        if (ring_drain() > 0) continue;
+        if (!__atomic_load_n(&logger.running, __ATOMIC_ACQUIRE)) break;
+
+        __atomic_store_n(&logger.sleeping, true, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!ring_has_message()) {
+            platform_semaphore_wait(&logger.wakeup);
+        }
+        // A producer that raced with us may have signaled anyway, that only costs a spurious wakeup
+        __atomic_store_n(&logger.sleeping, false, __ATOMIC_RELAXED);
+    }
+
+    // Catch anything that came in while shutting down
+    ring_drain();
+
+    return 0;
+}
+
+void log_init(const char *file_path)
+{
+    if (initialized) {
+        LOG_WARNING("Logger is already initialized\n");
+        return;
+    }
+
+    for (u64 i = 0; i < LOG_RING_CAPACITY; ++i) {
+        logger.slots[i].sequence = i;
+    }
+    logger.enqueue_pos = 0;
+    logger.dequeue_pos = 0;
+    logger.dropped_count = 0;
+    logger.sleeping = false;
+    logger.running = true;
+
+    logger.file = NULL;
+    if (file_path) {
+        logger.file = fopen(file_path, "w");
+        if (!logger.file) {
+            LOG_WARNING("Failed to open log file %s, logging to console only\n", file_path);
+        }
+    }
+
+    platform_semaphore_create(&logger.wakeup, 0);
+    platform_thread_create(&logger.thread, log_thread_proc, NULL);
+
+    initialized = true;
+}
+
+void log_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Logger is not initialized yet\n");
+        return;
+    }
+
+    __atomic_store_n(&logger.running, false, __ATOMIC_RELEASE);
+    platform_semaphore_signal(&logger.wakeup);
+    platform_thread_join(&logger.thread);
+    platform_semaphore_destroy(&logger.wakeup);
+
+    initialized = false;
+
+    if (logger.file) {
+        fclose(logger.file);
+        logger.file = NULL;
+    }
+}
+
+void log_flush()
+{
+    if (!initialized) return;
+
+    u64 target = __atomic_load_n(&logger.enqueue_pos, __ATOMIC_ACQUIRE);
+    wake_consumer();
+    while (__atomic_load_n(&logger.dequeue_pos, __ATOMIC_ACQUIRE) < target) {
+        platform_sleep_ms(1);
+    }
+}
+
+void log_output_fmt(Log_Level level, const char *fmt, ...)
+{
     va_list args;
     va_start(args, fmt);
-    size_t buffer_length = strlen(buffer);
-    vsnprintf_s(
-        buffer + buffer_length,
-        max_length - buffer_length,
-        max_length - buffer_length - 1,
-        fmt, args);
-    va_end(args);
 
-    platform_log_output(level, buffer);
-}
\ No newline at end of file
+    if (initialized && level != LOG_LEVEL_FATAL) {
+        if (ring_push(level, fmt, args)) {
+            wake_consumer();
+        } else {
+            __atomic_fetch_add(&logger.dropped_count, 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        // Not running yet (or about to exit), write it out on this thread. A fatal
+        // message goes after whatever is still queued so the log reads in order.
+        log_flush();
+
+        char buffer[LOG_MESSAGE_MAX_LENGTH];
+        if (format_message(buffer, LOG_MESSAGE_MAX_LENGTH, level, fmt, args) > 0) {
+            write_to_sinks(level, buffer);
+            if (logger.file) {
+                fflush(logger.file);
+            }
+        }
+    }
+
+    va_end(args);
+}
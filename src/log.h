@@ -11,6 +11,16 @@ typedef enum {
     LOG_LEVEL_FATAL,
 } Log_Level;
 
+// Starts the logging thread. Messages go to the console and, if file_path
+// isn't NULL, to that file. Until this is called logging is synchronous.
+void log_init(const char *file_path);
+void log_destroy();
+// Blocks until everything logged so far has been written out
+void log_flush();
+
+// Never blocks once the logger is running: the message is queued for the logging
+// thread, or dropped (and counted) when the queue is full. FATAL is written out
+// synchronously.
 void log_output_fmt(Log_Level level, const char *fmt, ...);
 
 #define LOG_INFO(fmt, ...) log_output_fmt(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__);
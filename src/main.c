@@ -1,15 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "log.h"
+#include "memory.h"
 #include "platform.h"
 #include "array.h"
 #include "event.h"
+#include "frame_pacer.h"
 #include "input.h"
+#include "job.h"
+#include "profile.h"
+#include "string_intern.h"
 #include "vulkan.h"
 
 #define SCREEN_WIDTH  1280
 #define SCREEN_HEIGHT 720
 
+// How many frames to render with --headless before writing out the last one
+#define HEADLESS_FRAME_COUNT 60
+#define HEADLESS_OUTPUT_FILE "frame.ppm"
+
+// How long to idle per loop iteration while there's nothing to draw (minimized)
+#define IDLE_SLEEP_MS 10
+
+#define LOG_FILE "app.log"
+#define PROFILE_FILE "trace.json"
+
 bool is_running = true;
 
+bool handle_exit(int event_type, void *listener, Event_Context ctx)
+{
+    if (event_type != EVENT_EXIT) return false;
+
+    is_running = false;
+    LOG_INFO("Exiting application\n");
+
+    return true;
+}
+
 bool handle_key_pressed(int event_type, void *listener, Event_Context ctx)
 {
     if (event_type != EVENT_KEY_PRESSED) return false;
@@ -38,46 +67,159 @@ bool handle_key_released(int event_type, void *listener, Event_Context ctx)
     return true;
 }
 
-int main(void)
+bool handle_window_resized(int event_type, void *listener, Event_Context ctx)
 {
+    if (event_type != EVENT_WINDOW_RESIZED) return false;
+
+    vulkan_resize(ctx.data.u32[0], ctx.data.u32[1]);
+
+    return true;
+}
+
+// Write the last rendered frame as a binary PPM, good enough for image diffing
+static void save_frame(const char *filename, u32 width, u32 height)
+{
+    size_t size = (size_t)width * height * 4;
+    u8 *pixels = memory_alloc(size, MEMORY_TAG_VULKAN);
+
+    if (vulkan_read_frame(pixels, size)) {
+        FILE *file = fopen(filename, "wb");
+        if (file) {
+            fprintf(file, "P6\n%u %u\n255\n", width, height);
+            for (size_t i = 0; i < size; i += 4) {
+                fwrite(&pixels[i], 1, 3, file); // drop alpha
+            }
+            fclose(file);
+            LOG_INFO("Frame saved to %s\n", filename);
+        } else {
+            LOG_ERROR("Failed to open %s\n", filename);
+        }
+    }
+
+    memory_free(pixels, size, MEMORY_TAG_VULKAN);
+}
+
+int main(int argc, char **argv)
+{
+    log_init(LOG_FILE);
     LOG_INFO("Starting application\n");
 
+    profile_init();
+    profile_set_thread_name("main");
+
+    string_intern_init();
+
+    // --headless, --vsync or --adaptive (low latency otherwise), --fps <limit>,
+    // --images <swapchain image count>
+    bool headless = false;
+    Vulkan_Present_Policy present_policy = VULKAN_PRESENT_POLICY_LOW_LATENCY;
+    u32 target_fps = 0;
+    u32 swapchain_image_count = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--vsync") == 0) {
+            present_policy = VULKAN_PRESENT_POLICY_VSYNC;
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            present_policy = VULKAN_PRESENT_POLICY_ADAPTIVE;
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            target_fps = (u32)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--images") == 0 && i + 1 < argc) {
+            swapchain_image_count = (u32)strtoul(argv[++i], NULL, 10);
+        } else {
+            LOG_WARNING("Unknown argument: %s\n", argv[i]);
+        }
+    }
+
+    LOG_INFO("Initializing job system\n");
+    job_system_init(0);
+
     LOG_INFO("Initializing input system\n");
     input_init();
 
     LOG_INFO("Initializing event list\n");
     event_init();
-    event_register(EVENT_KEY_PRESSED, NULL, handle_key_pressed);
-    event_register(EVENT_KEY_RELEASED, NULL, handle_key_released);
+    Event_Handle exit_handle = event_register(EVENT_EXIT, NULL, handle_exit);
+    Event_Handle key_pressed_handle = event_register(EVENT_KEY_PRESSED, NULL, handle_key_pressed);
+    Event_Handle key_released_handle = event_register(EVENT_KEY_RELEASED, NULL, handle_key_released);
+    Event_Handle window_resized_handle = event_register(EVENT_WINDOW_RESIZED, NULL, handle_window_resized);
+
+    vulkan_set_present_policy(present_policy);
+    vulkan_set_swapchain_image_count(swapchain_image_count);
 
-    LOG_INFO("Initializing window\n");
     Platform_Window window;
-    platform_window_init(&window, "App window", 100, 100, SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (headless) {
+        LOG_INFO("Initializing Vulkan (headless)\n");
+        vulkan_init_headless(SCREEN_WIDTH, SCREEN_HEIGHT);
+    } else {
+        LOG_INFO("Initializing window\n");
+        platform_window_init(&window, "App window", 100, 100, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+        LOG_INFO("Initializing Vulkan\n");
+        vulkan_init(&window, SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
 
-    LOG_INFO("Initializing Vulkan\n");
-    vulkan_init(&window, SCREEN_WIDTH, SCREEN_HEIGHT);
+    frame_pacer_init(target_fps);
 
+    u32 frame_count = 0;
     while (is_running) {
-        platform_window_handle_message(&window);
+        PROFILE_ZONE("frame");
+
+        if (!headless) {
+            platform_window_handle_message(&window);
+        }
+
+        // Input events from the message pump are handled here, all at once
+        event_flush();
 
         input_update(NULL);
 
-        vulkan_draw_frame();
+        if (vulkan_draw_frame()) {
+            frame_pacer_end_frame();
+        } else {
+            platform_sleep_ms(IDLE_SLEEP_MS);
+            frame_pacer_restart();
+        }
+
+        if (headless && ++frame_count >= HEADLESS_FRAME_COUNT) {
+            is_running = false;
+        }
+    }
+
+    if (headless) {
+        save_frame(HEADLESS_OUTPUT_FILE, SCREEN_WIDTH, SCREEN_HEIGHT);
     }
 
     vulkan_wait_idle();
 
+    frame_pacer_destroy();
+
+    memory_log_usage();
+
     // Clean up
     {
-        platform_window_destroy(&window);
-
-        event_unregister(EVENT_KEY_PRESSED, NULL, handle_key_pressed);
-        event_unregister(EVENT_KEY_RELEASED, NULL, handle_key_released);
+        if (!headless) {
+            platform_window_destroy(&window);
+        }
+
+        event_unregister(exit_handle);
+        event_unregister(key_pressed_handle);
+        event_unregister(key_released_handle);
+        event_unregister(window_resized_handle);
         event_destroy();
 
         input_destroy();
 
         vulkan_destroy();
+
+        job_system_destroy();
+
+        profile_dump(PROFILE_FILE);
+        profile_destroy();
+
+        string_intern_destroy();
+
+        log_destroy();
     }
     return 0;
 }
\ No newline at end of file
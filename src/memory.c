@@ -8,6 +8,18 @@
 static size_t total_allocated = 0;
 static size_t tagged_allocations[MAX_MEMORY_TAGS] = {0};
 
+static const char *tag_names[MAX_MEMORY_TAGS] = {
+    "UNKNOWN",
+    "ARRAY",
+    "STRING",
+    "VULKAN",
+    "FRAME",
+    "JOB",
+    "PROFILE",
+    "GPU_BUFFER",
+    "GPU_IMAGE",
+};
+
 // Do malloc and zero out memory
 void *memory_alloc(size_t size, Memory_Tag tag)
 {
@@ -20,8 +32,7 @@ void *memory_alloc(size_t size, Memory_Tag tag)
         LOG_WARNING("Allocating memory with MEMORY_TAG_UNKNOWN\n");
     }
 
-    total_allocated += size;
-    tagged_allocations[tag] += size;
+    memory_track_alloc(size, tag);
 
     return block;
 }
@@ -37,8 +48,7 @@ void memory_free(void *block, size_t size, Memory_Tag tag)
         LOG_WARNING("Freeing memory with MEMORY_TAG_UNKNOWN\n");
     }
 
-    total_allocated -= size;
-    tagged_allocations[tag] -= size;
+    memory_track_free(size, tag);
 
     free(block);
 }
@@ -48,14 +58,202 @@ void *memory_copy(void *dest, const void *src, size_t size)
     return memcpy(dest, src, size);
 }
 
+void *memory_move(void *dest, const void *src, size_t size)
+{
+    return memmove(dest, src, size);
+}
+
+void *memory_realloc(void *block, size_t old_size, size_t new_size, Memory_Tag tag)
+{
+    void *new_block = realloc(block, new_size);
+    if (new_block == NULL) {
+        LOG_FATAL("Failed reallocating memory, tried to allocate %zu bytes", new_size);
+    }
+
+    if (tag == MEMORY_TAG_UNKNOWN) {
+        LOG_WARNING("Reallocating memory with MEMORY_TAG_UNKNOWN\n");
+    }
+
+    memory_track_free(old_size, tag);
+    memory_track_alloc(new_size, tag);
+
+    return new_block;
+}
+
+// Atomic since job threads allocate too
+void memory_track_alloc(size_t size, Memory_Tag tag)
+{
+    __atomic_fetch_add(&total_allocated, size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&tagged_allocations[tag], size, __ATOMIC_RELAXED);
+}
+
+void memory_track_free(size_t size, Memory_Tag tag)
+{
+    __atomic_fetch_sub(&total_allocated, size, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&tagged_allocations[tag], size, __ATOMIC_RELAXED);
+}
+
 // Get allocated memory usage in bytes
 size_t get_total_memory_usage()
 {
-    return total_allocated;
+    return __atomic_load_n(&total_allocated, __ATOMIC_RELAXED);
 }
 
 // Get allocated memory usage in bytes (by tag)
 size_t get_memory_usage_by_tag(Memory_Tag tag)
 {
-    return tagged_allocations[tag];
+    return __atomic_load_n(&tagged_allocations[tag], __ATOMIC_RELAXED);
+}
+
+// Print usage of every tag, CPU and GPU side together
+void memory_log_usage()
+{
+    LOG_INFO("Memory usage:\n");
+    for (u32 i = 0; i < MAX_MEMORY_TAGS; ++i) {
+        LOG_INFO("  %-12s %10.2f KiB\n", tag_names[i], tagged_allocations[i] / 1024.0);
+    }
+    LOG_INFO("  %-12s %10.2f KiB\n", "TOTAL", total_allocated / 1024.0);
+}
+
+// Padding needed to move the address up to the next multiple of alignment (power of two)
+static size_t align_padding(const u8 *address, size_t alignment)
+{
+    size_t misalignment = (size_t)address & (alignment - 1);
+    return misalignment ? alignment - misalignment : 0;
+}
+
+void memory_arena_create(Memory_Arena *arena, size_t capacity, Memory_Tag tag)
+{
+    arena->base = memory_alloc(capacity, tag);
+    arena->capacity = capacity;
+    arena->offset = 0;
+    arena->high_water_mark = 0;
+    arena->tag = tag;
+}
+
+void memory_arena_destroy(Memory_Arena *arena)
+{
+    memory_free(arena->base, arena->capacity, arena->tag);
+    memory_zero(arena, sizeof(Memory_Arena));
+}
+
+void *memory_arena_alloc(Memory_Arena *arena, size_t size, size_t alignment)
+{
+    size_t padding = align_padding(arena->base + arena->offset, alignment);
+    if (arena->offset + padding + size > arena->capacity) {
+        LOG_ERROR("Arena out of memory. Capacity: %zu, requested: %zu\n", arena->capacity, size);
+        return NULL;
+    }
+
+    void *block = arena->base + arena->offset + padding;
+    arena->offset += padding + size;
+    if (arena->offset > arena->high_water_mark) {
+        arena->high_water_mark = arena->offset;
+    }
+
+    return block;
+}
+
+void memory_arena_reset(Memory_Arena *arena)
+{
+    arena->offset = 0;
+}
+
+void memory_pool_create(Memory_Pool *pool, size_t block_size, size_t block_count, Memory_Tag tag)
+{
+    // Every free block stores the pointer to the next one
+    if (block_size < sizeof(void *)) block_size = sizeof(void *);
+    block_size += align_padding((const u8 *)block_size, sizeof(void *));
+
+    pool->base = memory_alloc(block_size * block_count, tag);
+    pool->block_size = block_size;
+    pool->block_count = block_count;
+    pool->used_count = 0;
+    pool->high_water_mark = 0;
+    pool->tag = tag;
+
+    pool->free_list = NULL;
+    for (size_t i = block_count; i > 0; --i) {
+        void **block = (void **)(pool->base + (i - 1) * block_size);
+        *block = pool->free_list;
+        pool->free_list = block;
+    }
+}
+
+void memory_pool_destroy(Memory_Pool *pool)
+{
+    memory_free(pool->base, pool->block_size * pool->block_count, pool->tag);
+    memory_zero(pool, sizeof(Memory_Pool));
+}
+
+void *memory_pool_alloc(Memory_Pool *pool)
+{
+    if (pool->free_list == NULL) {
+        LOG_ERROR("Pool out of blocks. Block count: %zu\n", pool->block_count);
+        return NULL;
+    }
+
+    void **block = (void **)pool->free_list;
+    pool->free_list = *block;
+
+    ++pool->used_count;
+    if (pool->used_count > pool->high_water_mark) {
+        pool->high_water_mark = pool->used_count;
+    }
+
+    return block;
+}
+
+void memory_pool_free(Memory_Pool *pool, void *block)
+{
+    *(void **)block = pool->free_list;
+    pool->free_list = block;
+    --pool->used_count;
+}
+
+void memory_stack_create(Memory_Stack *stack, size_t capacity, Memory_Tag tag)
+{
+    stack->base = memory_alloc(capacity, tag);
+    stack->capacity = capacity;
+    stack->offset = 0;
+    stack->high_water_mark = 0;
+    stack->tag = tag;
+}
+
+void memory_stack_destroy(Memory_Stack *stack)
+{
+    memory_free(stack->base, stack->capacity, stack->tag);
+    memory_zero(stack, sizeof(Memory_Stack));
+}
+
+void *memory_stack_alloc(Memory_Stack *stack, size_t size, size_t alignment)
+{
+    size_t padding = align_padding(stack->base + stack->offset, alignment);
+    if (stack->offset + padding + size > stack->capacity) {
+        LOG_ERROR("Stack out of memory. Capacity: %zu, requested: %zu\n", stack->capacity, size);
+        return NULL;
+    }
+
+    void *block = stack->base + stack->offset + padding;
+    stack->offset += padding + size;
+    if (stack->offset > stack->high_water_mark) {
+        stack->high_water_mark = stack->offset;
+    }
+
+    return block;
+}
+
+Memory_Stack_Marker memory_stack_get_marker(Memory_Stack *stack)
+{
+    return stack->offset;
+}
+
+void memory_stack_free_to_marker(Memory_Stack *stack, Memory_Stack_Marker marker)
+{
+    if (marker > stack->offset) {
+        LOG_ERROR("Invalid stack marker. Offset: %zu, marker: %zu\n", stack->offset, marker);
+        return;
+    }
+
+    stack->offset = marker;
 }
\ No newline at end of file
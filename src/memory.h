@@ -8,6 +8,13 @@ typedef enum {
     MEMORY_TAG_ARRAY,
     MEMORY_TAG_STRING,
     MEMORY_TAG_VULKAN,
+    MEMORY_TAG_FRAME,
+    MEMORY_TAG_JOB,
+    MEMORY_TAG_PROFILE,
+
+    // Device memory, reported by the Vulkan allocator
+    MEMORY_TAG_GPU_BUFFER,
+    MEMORY_TAG_GPU_IMAGE,
 
     MAX_MEMORY_TAGS
 } Memory_Tag;
@@ -16,8 +23,69 @@ void *memory_alloc(size_t size, Memory_Tag tag);
 void memory_zero(void *block, size_t size);
 void memory_free(void *block, size_t size, Memory_Tag tag);
 void *memory_copy(void *dest, const void *src, size_t size);
+// Like memory_copy, but the ranges may overlap
+void *memory_move(void *dest, const void *src, size_t size);
+// Grow or shrink a memory_alloc block, contents up to the smaller size are kept
+void *memory_realloc(void *block, size_t old_size, size_t new_size, Memory_Tag tag);
+
+// For memory that doesn't come from memory_alloc (e.g. GPU memory), so it
+// still shows up in the usage numbers below
+void memory_track_alloc(size_t size, Memory_Tag tag);
+void memory_track_free(size_t size, Memory_Tag tag);
 
 size_t get_total_memory_usage();
 size_t get_memory_usage_by_tag(Memory_Tag tag);
+void memory_log_usage();
+
+// Alignment used when the caller doesn't care, enough for any scalar type
+#define MEMORY_DEFAULT_ALIGNMENT 16
+
+// Linear allocator: allocating is a pointer bump, everything is freed at once
+// with memory_arena_reset. Meant for transient (e.g. per frame) data.
+typedef struct {
+    u8         *base;
+    size_t      capacity;
+    size_t      offset;
+    size_t      high_water_mark;
+    Memory_Tag  tag;
+} Memory_Arena;
+
+void memory_arena_create(Memory_Arena *arena, size_t capacity, Memory_Tag tag);
+void memory_arena_destroy(Memory_Arena *arena);
+void *memory_arena_alloc(Memory_Arena *arena, size_t size, size_t alignment);
+void memory_arena_reset(Memory_Arena *arena);
+
+// Fixed size blocks with an intrusive free list, O(1) alloc and free in any order
+typedef struct {
+    u8         *base;
+    void       *free_list;
+    size_t      block_size;
+    size_t      block_count;
+    size_t      used_count;
+    size_t      high_water_mark; // In blocks
+    Memory_Tag  tag;
+} Memory_Pool;
+
+void memory_pool_create(Memory_Pool *pool, size_t block_size, size_t block_count, Memory_Tag tag);
+void memory_pool_destroy(Memory_Pool *pool);
+void *memory_pool_alloc(Memory_Pool *pool);
+void memory_pool_free(Memory_Pool *pool, void *block);
+
+// Like the arena, but can be unwound to a marker (LIFO)
+typedef struct {
+    u8         *base;
+    size_t      capacity;
+    size_t      offset;
+    size_t      high_water_mark;
+    Memory_Tag  tag;
+} Memory_Stack;
+
+typedef size_t Memory_Stack_Marker;
+
+void memory_stack_create(Memory_Stack *stack, size_t capacity, Memory_Tag tag);
+void memory_stack_destroy(Memory_Stack *stack);
+void *memory_stack_alloc(Memory_Stack *stack, size_t size, size_t alignment);
+Memory_Stack_Marker memory_stack_get_marker(Memory_Stack *stack);
+void memory_stack_free_to_marker(Memory_Stack *stack, Memory_Stack_Marker marker);
 
 #endif
\ No newline at end of file
@@ -28,4 +28,33 @@ void platform_log_output(Log_Level level, const char *msg);
 
 char *platform_getcwd(char *buffer, size_t size);
 
+// Monotonic high resolution clock in nanoseconds, only meaningful as a difference
+u64 platform_get_time_ns();
+void platform_sleep_ms(u32 ms);
+
+// Logical processors available to the process
+u32 platform_get_processor_count();
+
+typedef u32 (*Platform_Thread_Proc)(void *arg);
+
+typedef struct {
+    void *handle;
+} Platform_Thread;
+
+void platform_thread_create(Platform_Thread *thread, Platform_Thread_Proc proc, void *arg);
+// Waits for the thread to return and releases it
+void platform_thread_join(Platform_Thread *thread);
+// Give up the rest of the time slice
+void platform_thread_yield();
+
+// Counting semaphore
+typedef struct {
+    void *handle;
+} Platform_Semaphore;
+
+void platform_semaphore_create(Platform_Semaphore *semaphore, u32 initial_count);
+void platform_semaphore_destroy(Platform_Semaphore *semaphore);
+void platform_semaphore_signal(Platform_Semaphore *semaphore);
+void platform_semaphore_wait(Platform_Semaphore *semaphore);
+
 #endif
\ No newline at end of file
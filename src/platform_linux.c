@@ -2,6 +2,403 @@
 
 #if PLATFORM_LINUX
 
-// TODO: window implementation for Linux
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
-#endif
\ No newline at end of file
+#include <xcb/xcb.h>
+
+#include <vulkan/vulkan_xcb.h>
+#include "vulkan_types.h"
+
+#include "common.h"
+#include "log.h"
+#include "input.h"
+#include "event.h"
+#include "profile.h"
+
+// X11 keycodes are 8 bits
+#define MAX_KEYCODES 256
+
+// From X11/keysymdef.h, the only non-ASCII keysym we care about (for now)
+#define KEYSYM_ESCAPE 0xff1b
+
+typedef struct {
+    xcb_connection_t *connection;
+    xcb_window_t      window;
+    xcb_atom_t        wm_protocols;
+    xcb_atom_t        wm_delete_window;
+    xcb_keysym_t      keysyms[MAX_KEYCODES]; // Unshifted keysym of every keycode
+    u16               width;
+    u16               height;
+    VkSurfaceKHR      surface;
+} Window_Handle;
+
+static xcb_atom_t intern_atom(xcb_connection_t *connection, const char *name)
+{
+    xcb_intern_atom_cookie_t cookie = xcb_intern_atom(connection, 0, strlen(name), name);
+    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(connection, cookie, NULL);
+    if (reply == NULL) {
+        LOG_FATAL("Failed to intern X11 atom: %s\n", name);
+    }
+
+    xcb_atom_t atom = reply->atom;
+    free(reply);
+    return atom;
+}
+
+// Core protocol only, so we don't have to drag xcb-keysyms or xkbcommon along
+static void load_keyboard_mapping(Window_Handle *handle)
+{
+    const xcb_setup_t *setup = xcb_get_setup(handle->connection);
+    xcb_keycode_t min_keycode = setup->min_keycode;
+    xcb_keycode_t max_keycode = setup->max_keycode;
+
+    xcb_get_keyboard_mapping_cookie_t cookie =
+        xcb_get_keyboard_mapping(handle->connection, min_keycode, max_keycode - min_keycode + 1);
+    xcb_get_keyboard_mapping_reply_t *reply =
+        xcb_get_keyboard_mapping_reply(handle->connection, cookie, NULL);
+    if (reply == NULL) {
+        LOG_FATAL("Failed to get keyboard mapping\n");
+    }
+
+    xcb_keysym_t *keysyms = xcb_get_keyboard_mapping_keysyms(reply);
+    u8 keysyms_per_keycode = reply->keysyms_per_keycode;
+
+    memset(handle->keysyms, 0, sizeof(handle->keysyms));
+    for (u32 keycode = min_keycode; keycode <= max_keycode; ++keycode) {
+        handle->keysyms[keycode] = keysyms[(keycode - min_keycode) * keysyms_per_keycode];
+    }
+
+    free(reply);
+}
+
+static Input_Key translate_keysym(xcb_keysym_t keysym)
+{
+    // Latin-1 keysyms are the same as ASCII
+    if (keysym >= 'a' && keysym <= 'z') return KEY_A + (keysym - 'a');
+    if (keysym >= 'A' && keysym <= 'Z') return (Input_Key)keysym;
+    if (keysym >= '0' && keysym <= '9') return (Input_Key)keysym;
+
+    switch (keysym) {
+        case ' ':           return KEY_SPACE;
+        case KEYSYM_ESCAPE: return KEY_ESC;
+        default:            return KEY_NONE;
+    }
+}
+
+void platform_window_init(Platform_Window *window, const char *title, int x, int y, int width, int height)
+{
+    window->handle = malloc(sizeof(Window_Handle));
+
+    Window_Handle *handle = (Window_Handle *)window->handle;
+    memset(handle, 0, sizeof(Window_Handle));
+
+    // Honors $DISPLAY, so this works against Xvfb as well
+    int screen_index = 0;
+    handle->connection = xcb_connect(NULL, &screen_index);
+    if (xcb_connection_has_error(handle->connection)) {
+        LOG_FATAL("Failed to connect to the X server\n");
+    }
+
+    const xcb_setup_t *setup = xcb_get_setup(handle->connection);
+    xcb_screen_iterator_t it = xcb_setup_roots_iterator(setup);
+    for (int i = 0; i < screen_index; ++i) {
+        xcb_screen_next(&it);
+    }
+    xcb_screen_t *screen = it.data;
+
+    handle->width = width;
+    handle->height = height;
+
+    u32 event_mask = XCB_EVENT_MASK_KEY_PRESS
+        | XCB_EVENT_MASK_KEY_RELEASE
+        | XCB_EVENT_MASK_BUTTON_PRESS
+        | XCB_EVENT_MASK_BUTTON_RELEASE
+        | XCB_EVENT_MASK_EXPOSURE
+        | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+    u32 value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
+    u32 value_list[] = {screen->black_pixel, event_mask};
+
+    handle->window = xcb_generate_id(handle->connection);
+    xcb_create_window(
+        handle->connection,
+        XCB_COPY_FROM_PARENT,
+        handle->window,
+        screen->root,
+        x, y, width, height,
+        0, // border width
+        XCB_WINDOW_CLASS_INPUT_OUTPUT,
+        screen->root_visual,
+        value_mask,
+        value_list);
+
+    xcb_change_property(
+        handle->connection,
+        XCB_PROP_MODE_REPLACE,
+        handle->window,
+        XCB_ATOM_WM_NAME,
+        XCB_ATOM_STRING,
+        8,
+        strlen(title),
+        title);
+
+    // Ask the window manager to send us a message instead of killing the connection
+    // when the window gets closed
+    handle->wm_protocols = intern_atom(handle->connection, "WM_PROTOCOLS");
+    handle->wm_delete_window = intern_atom(handle->connection, "WM_DELETE_WINDOW");
+    xcb_change_property(
+        handle->connection,
+        XCB_PROP_MODE_REPLACE,
+        handle->window,
+        handle->wm_protocols,
+        XCB_ATOM_ATOM,
+        32,
+        1,
+        &handle->wm_delete_window);
+
+    load_keyboard_mapping(handle);
+
+    xcb_map_window(handle->connection, handle->window);
+
+    if (xcb_flush(handle->connection) <= 0) {
+        LOG_FATAL("Window creation failed\n");
+    }
+}
+
+void platform_window_destroy(Platform_Window *window)
+{
+    Window_Handle *handle = (Window_Handle *)window->handle;
+
+    if (handle->connection) {
+        xcb_destroy_window(handle->connection, handle->window);
+        xcb_disconnect(handle->connection);
+        handle->connection = NULL;
+    }
+
+    free(handle);
+}
+
+static bool is_key_repeat(xcb_generic_event_t *release, xcb_generic_event_t *next)
+{
+    // X11 reports auto-repeat as a release immediately followed by a press of the
+    // same key with the same timestamp
+    if (next == NULL || (next->response_type & ~0x80) != XCB_KEY_PRESS) return false;
+
+    xcb_key_release_event_t *r = (xcb_key_release_event_t *)release;
+    xcb_key_press_event_t *p = (xcb_key_press_event_t *)next;
+    return r->detail == p->detail && r->time == p->time;
+}
+
+// Never blocks, it only drains whatever is already queued
+void platform_window_handle_message(Platform_Window *window)
+{
+    PROFILE_ZONE("platform_window_handle_message");
+
+    Window_Handle *handle = (Window_Handle *)window->handle;
+
+    xcb_generic_event_t *event = xcb_poll_for_event(handle->connection);
+    while (event) {
+        xcb_generic_event_t *next = NULL;
+
+        switch (event->response_type & ~0x80) {
+            case XCB_KEY_PRESS: {
+                xcb_key_press_event_t *e = (xcb_key_press_event_t *)event;
+                input_process_key(translate_keysym(handle->keysyms[e->detail]), true);
+            } break;
+
+            case XCB_KEY_RELEASE: {
+                xcb_key_release_event_t *e = (xcb_key_release_event_t *)event;
+                next = xcb_poll_for_queued_event(handle->connection);
+                if (is_key_repeat(event, next)) {
+                    // Key is still held down, drop both events
+                    free(next);
+                    next = NULL;
+                } else {
+                    input_process_key(translate_keysym(handle->keysyms[e->detail]), false);
+                }
+            } break;
+
+            case XCB_BUTTON_PRESS:
+            case XCB_BUTTON_RELEASE: {
+                xcb_button_press_event_t *e = (xcb_button_press_event_t *)event;
+                bool pressed = (event->response_type & ~0x80) == XCB_BUTTON_PRESS;
+                switch (e->detail) {
+                    case XCB_BUTTON_INDEX_1:
+                        input_process_mouse_button(INPUT_MOUSE_BUTTON_LEFT, pressed);
+                        break;
+                    case XCB_BUTTON_INDEX_2:
+                        input_process_mouse_button(INPUT_MOUSE_BUTTON_MIDDLE, pressed);
+                        break;
+                    case XCB_BUTTON_INDEX_3:
+                        input_process_mouse_button(INPUT_MOUSE_BUTTON_RIGHT, pressed);
+                        break;
+                    default:
+                        // Buttons 4 and 5 are the scroll wheel, not handled yet
+                        break;
+                }
+            } break;
+
+            case XCB_CONFIGURE_NOTIFY: {
+                // Also sent for moves and restacking, only size changes matter
+                xcb_configure_notify_event_t *e = (xcb_configure_notify_event_t *)event;
+                if (e->width != handle->width || e->height != handle->height) {
+                    handle->width = e->width;
+                    handle->height = e->height;
+
+                    Event_Context ctx = {0};
+                    ctx.data.u32[0] = e->width;
+                    ctx.data.u32[1] = e->height;
+                    event_post(EVENT_WINDOW_RESIZED, ctx);
+                }
+            } break;
+
+            case XCB_CLIENT_MESSAGE: {
+                xcb_client_message_event_t *e = (xcb_client_message_event_t *)event;
+                if (e->data.data32[0] == handle->wm_delete_window) {
+                    Event_Context ctx = {0};
+                    event_dispatch(EVENT_EXIT, ctx);
+                }
+            } break;
+
+            default:
+                break;
+        }
+
+        free(event);
+        event = next ? next : xcb_poll_for_event(handle->connection);
+    }
+}
+
+void platform_log_output(Log_Level level, const char *msg)
+{
+    FILE *stream = level < LOG_LEVEL_WARNING ? stdout : stderr;
+
+    // Color order: info, debug, warning, error, fatal
+    const char *colors[5] = {
+        "0",    // default
+        "34",   // blue
+        "33",   // yellow
+        "31",   // red
+        "1;31", // bright red
+    };
+    fprintf(stream, "\033[%sm%s\033[0m", colors[level], msg);
+    fflush(stream);
+}
+
+void platform_window_create_vulkan_surface(Platform_Window *window, Vulkan_Context *context)
+{
+    Window_Handle *handle = (Window_Handle *)window->handle;
+
+    VkXcbSurfaceCreateInfoKHR create_info = {0};
+    create_info.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
+    create_info.connection = handle->connection;
+    create_info.window = handle->window;
+
+    VkResult result = vkCreateXcbSurfaceKHR(context->instance, &create_info, context->allocator, &handle->surface);
+    if (result != VK_SUCCESS) {
+        LOG_FATAL("Failed to create Vulkan surface");
+    }
+
+    context->surface = handle->surface;
+}
+
+char *platform_getcwd(char *buffer, size_t size)
+{
+    return getcwd(buffer, size);
+}
+
+u64 platform_get_time_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000ull + (u64)now.tv_nsec;
+}
+
+void platform_sleep_ms(u32 ms)
+{
+    struct timespec duration;
+    duration.tv_sec = ms / 1000;
+    duration.tv_nsec = (long)(ms % 1000) * 1000000;
+    nanosleep(&duration, NULL);
+}
+
+u32 platform_get_processor_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+typedef struct {
+    pthread_t            thread;
+    Platform_Thread_Proc proc;
+    void                *arg;
+} Thread_Handle;
+
+static void *thread_start(void *arg)
+{
+    Thread_Handle *handle = (Thread_Handle *)arg;
+    handle->proc(handle->arg);
+    return NULL;
+}
+
+void platform_thread_create(Platform_Thread *thread, Platform_Thread_Proc proc, void *arg)
+{
+    Thread_Handle *handle = malloc(sizeof(Thread_Handle));
+    handle->proc = proc;
+    handle->arg = arg;
+
+    if (pthread_create(&handle->thread, NULL, thread_start, handle) != 0) {
+        LOG_FATAL("Failed to create thread\n");
+    }
+
+    thread->handle = handle;
+}
+
+void platform_thread_join(Platform_Thread *thread)
+{
+    Thread_Handle *handle = (Thread_Handle *)thread->handle;
+    pthread_join(handle->thread, NULL);
+    free(handle);
+    thread->handle = NULL;
+}
+
+void platform_thread_yield()
+{
+    sched_yield();
+}
+
+void platform_semaphore_create(Platform_Semaphore *semaphore, u32 initial_count)
+{
+    sem_t *handle = malloc(sizeof(sem_t));
+    if (sem_init(handle, 0, initial_count) != 0) {
+        LOG_FATAL("Failed to create semaphore\n");
+    }
+
+    semaphore->handle = handle;
+}
+
+void platform_semaphore_destroy(Platform_Semaphore *semaphore)
+{
+    sem_destroy((sem_t *)semaphore->handle);
+    free(semaphore->handle);
+    semaphore->handle = NULL;
+}
+
+void platform_semaphore_signal(Platform_Semaphore *semaphore)
+{
+    sem_post((sem_t *)semaphore->handle);
+}
+
+void platform_semaphore_wait(Platform_Semaphore *semaphore)
+{
+    // Retry when a signal handler interrupts the wait
+    while (sem_wait((sem_t *)semaphore->handle) != 0) {}
+}
+
+#endif
@@ -12,6 +12,8 @@
 #include "common.h"
 #include "log.h"
 #include "input.h"
+#include "event.h"
+#include "profile.h"
 
 typedef struct {
     HINSTANCE    h_instance;
@@ -29,6 +31,14 @@ LRESULT CALLBACK _platform_window_handle_message(HWND hwnd, UINT msg, WPARAM w_p
         case WM_DESTROY:
             PostQuitMessage(0);
             break;
+
+        case WM_SIZE: {
+            // 0x0 when minimized
+            Event_Context ctx = {0};
+            ctx.data.u32[0] = LOWORD(l_param);
+            ctx.data.u32[1] = HIWORD(l_param);
+            event_post(EVENT_WINDOW_RESIZED, ctx);
+        } break;
         
         case WM_SYSKEYDOWN:
         case WM_KEYDOWN:
@@ -61,6 +71,8 @@ LRESULT CALLBACK _platform_window_handle_message(HWND hwnd, UINT msg, WPARAM w_p
 
 void platform_window_handle_message(Platform_Window *window)
 {
+    PROFILE_ZONE("platform_window_handle_message");
+
     MSG msg;
     while (PeekMessageA(&msg, NULL, 0, 0, PM_REMOVE)) {
         TranslateMessage(&msg);
@@ -174,4 +186,96 @@ char *platform_getcwd(char *buffer, size_t size)
     return _getcwd(buffer, size);
 }
 
+u64 platform_get_time_ns()
+{
+    static LARGE_INTEGER frequency = {0};
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    // Split it up so the multiplication can't overflow
+    u64 seconds = counter.QuadPart / frequency.QuadPart;
+    u64 remainder = counter.QuadPart % frequency.QuadPart;
+    return seconds * 1000000000ull + remainder * 1000000000ull / frequency.QuadPart;
+}
+
+void platform_sleep_ms(u32 ms)
+{
+    Sleep(ms);
+}
+
+u32 platform_get_processor_count()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+typedef struct {
+    HANDLE               thread;
+    Platform_Thread_Proc proc;
+    void                *arg;
+} Thread_Handle;
+
+static DWORD WINAPI thread_start(LPVOID arg)
+{
+    Thread_Handle *handle = (Thread_Handle *)arg;
+    return handle->proc(handle->arg);
+}
+
+void platform_thread_create(Platform_Thread *thread, Platform_Thread_Proc proc, void *arg)
+{
+    Thread_Handle *handle = malloc(sizeof(Thread_Handle));
+    handle->proc = proc;
+    handle->arg = arg;
+
+    handle->thread = CreateThread(NULL, 0, thread_start, handle, 0, NULL);
+    if (handle->thread == NULL) {
+        LOG_FATAL("Failed to create thread\n");
+    }
+
+    thread->handle = handle;
+}
+
+void platform_thread_join(Platform_Thread *thread)
+{
+    Thread_Handle *handle = (Thread_Handle *)thread->handle;
+    WaitForSingleObject(handle->thread, INFINITE);
+    CloseHandle(handle->thread);
+    free(handle);
+    thread->handle = NULL;
+}
+
+void platform_thread_yield()
+{
+    SwitchToThread();
+}
+
+void platform_semaphore_create(Platform_Semaphore *semaphore, u32 initial_count)
+{
+    semaphore->handle = CreateSemaphoreA(NULL, initial_count, LONG_MAX, NULL);
+    if (semaphore->handle == NULL) {
+        LOG_FATAL("Failed to create semaphore\n");
+    }
+}
+
+void platform_semaphore_destroy(Platform_Semaphore *semaphore)
+{
+    CloseHandle((HANDLE)semaphore->handle);
+    semaphore->handle = NULL;
+}
+
+void platform_semaphore_signal(Platform_Semaphore *semaphore)
+{
+    ReleaseSemaphore((HANDLE)semaphore->handle, 1, NULL);
+}
+
+void platform_semaphore_wait(Platform_Semaphore *semaphore)
+{
+    WaitForSingleObject((HANDLE)semaphore->handle, INFINITE);
+}
+
 #endif
\ No newline at end of file
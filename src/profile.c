@@ -0,0 +1,182 @@
+#include "profile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+#include "memory.h"
+#include "platform.h"
+
+typedef struct {
+    const char *name;
+    u64         start;
+    u64         end;
+} Profile_Event;
+
+typedef struct {
+    Profile_Event events[PROFILE_EVENTS_PER_THREAD];
+    u64           count; // Total recorded, the ring holds the last PROFILE_EVENTS_PER_THREAD
+    char          name[32];
+} Profile_Thread;
+
+static Profile_Thread *threads[MAX_PROFILE_THREADS];
+static u32 thread_count = 0;
+
+static _Thread_local Profile_Thread *current_thread = NULL;
+static _Thread_local bool thread_rejected = false;
+
+// Pair of readings to convert timestamps to microseconds with
+static u64 start_timestamp;
+static u64 start_time_ns;
+
+static bool initialized = false;
+
+u64 profile_clock_ns()
+{
+    return platform_get_time_ns();
+}
+
+void profile_init()
+{
+#ifdef PROFILE_MODE
+    if (initialized) {
+        LOG_WARNING("Profiler is already initialized\n");
+        return;
+    }
+
+    start_timestamp = profile_timestamp();
+    start_time_ns = platform_get_time_ns();
+
+    initialized = true;
+#endif
+}
+
+void profile_destroy()
+{
+#ifdef PROFILE_MODE
+    if (!initialized) {
+        LOG_WARNING("Profiler is not initialized yet\n");
+        return;
+    }
+
+    initialized = false;
+    current_thread = NULL;
+
+    for (u32 i = 0; i < thread_count; ++i) {
+        memory_free(threads[i], sizeof(Profile_Thread), MEMORY_TAG_PROFILE);
+        threads[i] = NULL;
+    }
+    thread_count = 0;
+#endif
+}
+
+// First zone on a thread, the only slow path
+static Profile_Thread *register_thread()
+{
+    if (!initialized || thread_rejected) return NULL;
+
+    u32 index = __atomic_load_n(&thread_count, __ATOMIC_RELAXED);
+    for (;;) {
+        if (index == MAX_PROFILE_THREADS) {
+            thread_rejected = true;
+            LOG_WARNING("Too many threads to profile, ignoring this one\n");
+            return NULL;
+        }
+        if (__atomic_compare_exchange_n(
+                &thread_count, &index, index + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    Profile_Thread *thread = memory_alloc(sizeof(Profile_Thread), MEMORY_TAG_PROFILE);
+    thread->count = 0;
+    snprintf(thread->name, sizeof(thread->name), "thread %u", index);
+    __atomic_store_n(&threads[index], thread, __ATOMIC_RELEASE);
+
+    current_thread = thread;
+    return thread;
+}
+
+void profile_record(const char *name, u64 start, u64 end)
+{
+    if (!initialized) return;
+
+    Profile_Thread *thread = current_thread;
+    if (thread == NULL) {
+        thread = register_thread();
+        if (thread == NULL) return;
+    }
+
+    Profile_Event *event = &thread->events[thread->count & (PROFILE_EVENTS_PER_THREAD - 1)];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+    __atomic_store_n(&thread->count, thread->count + 1, __ATOMIC_RELEASE);
+}
+
+void profile_set_thread_name(const char *name)
+{
+#ifdef PROFILE_MODE
+    Profile_Thread *thread = current_thread ? current_thread : register_thread();
+    if (thread == NULL) return;
+
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+#endif
+}
+
+bool profile_dump(const char *path)
+{
+#ifdef PROFILE_MODE
+    if (!initialized) {
+        LOG_WARNING("Profiler is not initialized yet\n");
+        return false;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        LOG_ERROR("Failed to open %s\n", path);
+        return false;
+    }
+
+    // Calibrate over the whole run, long enough for the TSC rate to be accurate
+    u64 end_timestamp = profile_timestamp();
+    u64 end_time_ns = platform_get_time_ns();
+    f64 ticks_per_us = (f64)(end_timestamp - start_timestamp) / ((end_time_ns - start_time_ns) / 1000.0);
+    if (ticks_per_us <= 0.0) ticks_per_us = 1.0;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    bool first = true;
+    u32 count = __atomic_load_n(&thread_count, __ATOMIC_ACQUIRE);
+    for (u32 i = 0; i < count; ++i) {
+        Profile_Thread *thread = __atomic_load_n(&threads[i], __ATOMIC_ACQUIRE);
+        if (thread == NULL) continue;
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", i, thread->name);
+        first = false;
+
+        u64 event_count = __atomic_load_n(&thread->count, __ATOMIC_ACQUIRE);
+        u64 first_event = event_count > PROFILE_EVENTS_PER_THREAD ? event_count - PROFILE_EVENTS_PER_THREAD : 0;
+        for (u64 j = first_event; j < event_count; ++j) {
+            Profile_Event *event = &thread->events[j & (PROFILE_EVENTS_PER_THREAD - 1)];
+            // Zones from before profile_init would come out negative
+            if (event->start < start_timestamp) continue;
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                event->name,
+                i,
+                (event->start - start_timestamp) / ticks_per_us,
+                (event->end - event->start) / ticks_per_us);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    LOG_INFO("Profile written to %s\n", path);
+    return true;
+#else
+    return false;
+#endif
+}
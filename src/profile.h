@@ -0,0 +1,74 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "common.h"
+
+// CPU profiling zones. Every thread records into its own ring buffer (no locks,
+// no allocations after the first zone), profile_dump writes everything out as
+// Chrome trace JSON, load it in chrome://tracing or ui.perfetto.dev.
+//
+//     void update()
+//     {
+//         PROFILE_ZONE("update");
+//         ...
+//     } // zone ends here
+//
+// Zone names have to be string literals (or otherwise outlive the dump).
+
+// Zones kept per thread, older ones get overwritten. Must be a power of two.
+#define PROFILE_EVENTS_PER_THREAD (1 << 16)
+#define MAX_PROFILE_THREADS 64
+
+typedef struct {
+    const char *name;
+    u64         start;
+} Profile_Zone;
+
+void profile_init();
+void profile_destroy();
+// Name shown for the calling thread in the trace
+void profile_set_thread_name(const char *name);
+// Only call when no other thread is recording, e.g. at shutdown
+bool profile_dump(const char *path);
+
+void profile_record(const char *name, u64 start, u64 end);
+
+u64 profile_clock_ns();
+
+// Raw timestamp, TSC ticks on x86 (converted when dumping), nanoseconds elsewhere
+static inline u64 profile_timestamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return profile_clock_ns();
+#endif
+}
+
+static inline Profile_Zone profile_zone_begin(const char *name)
+{
+    Profile_Zone zone = {name, profile_timestamp()};
+    return zone;
+}
+
+static inline void profile_zone_end(Profile_Zone *zone)
+{
+    profile_record(zone->name, zone->start, profile_timestamp());
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILE_MODE
+// Lasts until the end of the enclosing scope
+#define PROFILE_ZONE(name)                                         \
+    Profile_Zone PROFILE_CONCAT(profile_zone_, __LINE__)           \
+        __attribute__((cleanup(profile_zone_end), unused)) =       \
+            profile_zone_begin(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+
+#endif
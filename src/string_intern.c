@@ -0,0 +1,115 @@
+#include "string_intern.h"
+
+#include <string.h>
+
+#include "array.h"
+#include "hash_map.h"
+#include "log.h"
+#include "memory.h"
+
+// Strings are packed into arenas of this size, longer ones get an arena of their own
+#define STRING_ARENA_SIZE (64 * 1024)
+
+// Looked up by pointer and length, so string_intern_n can search with a slice of
+// a bigger buffer
+typedef struct {
+    const char *data;
+    size_t      length;
+} String_Key;
+
+static Hash_Map strings; // Set of String_Key of the interned strings, compared by content
+static Memory_Arena *arenas = NULL;
+
+static bool initialized = false;
+
+static u64 hash_key(const void *key, size_t key_size)
+{
+    const String_Key *string = (const String_Key *)key;
+    return hash_bytes(string->data, string->length);
+}
+
+static bool equal_key(const void *a, const void *b, size_t key_size)
+{
+    const String_Key *string_a = (const String_Key *)a;
+    const String_Key *string_b = (const String_Key *)b;
+    return string_a->length == string_b->length &&
+        memcmp(string_a->data, string_b->data, string_a->length) == 0;
+}
+
+void string_intern_init()
+{
+    if (initialized) {
+        LOG_WARNING("String interning is already initialized\n");
+        return;
+    }
+
+    hash_map_create_custom(&strings, sizeof(String_Key), 0, 256, hash_key, equal_key, MEMORY_TAG_STRING);
+    arenas = array_create(Memory_Arena);
+
+    initialized = true;
+}
+
+void string_intern_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("String interning is not initialized yet\n");
+        return;
+    }
+
+    for (size_t i = 0; i < array_length(arenas); ++i) {
+        memory_arena_destroy(&arenas[i]);
+    }
+    array_destroy(arenas);
+    arenas = NULL;
+
+    hash_map_destroy(&strings);
+
+    initialized = false;
+}
+
+static char *store(const char *string, size_t length)
+{
+    size_t size = length + 1;
+
+    char *copy = NULL;
+    if (array_length(arenas) > 0) {
+        Memory_Arena *arena = &arenas[array_length(arenas) - 1];
+        if (arena->offset + size <= arena->capacity) {
+            copy = memory_arena_alloc(arena, size, 1);
+        }
+    }
+
+    if (copy == NULL) {
+        Memory_Arena arena;
+        memory_arena_create(&arena, MAX(size, STRING_ARENA_SIZE), MEMORY_TAG_STRING);
+        copy = memory_arena_alloc(&arena, size, 1);
+        array_push(arenas, arena);
+    }
+
+    memory_copy(copy, string, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+const char *string_intern(const char *string)
+{
+    return string_intern_n(string, strlen(string));
+}
+
+const char *string_intern_n(const char *string, size_t length)
+{
+    if (!initialized) {
+        LOG_WARNING("String interning is not initialized yet\n");
+        return NULL;
+    }
+
+    String_Key key = {string, length};
+    String_Key *found = hash_map_get(&strings, &key);
+    if (found) return found->data;
+
+    key.data = store(string, length);
+    hash_map_insert(&strings, &key, NULL);
+
+    return key.data;
+}
\ No newline at end of file
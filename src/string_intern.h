@@ -0,0 +1,16 @@
+#ifndef STRING_INTERN_H
+#define STRING_INTERN_H
+
+#include "common.h"
+
+// Interned strings are stored once and live until string_intern_destroy, so two
+// interned strings are equal exactly when their pointers are. Not thread safe.
+
+void string_intern_init();
+void string_intern_destroy();
+
+const char *string_intern(const char *string);
+// string doesn't have to be null-terminated
+const char *string_intern_n(const char *string, size_t length);
+
+#endif
@@ -11,9 +11,23 @@
 #include "array.h"
 #include "platform.h"
 #include "memory.h"
+#include "job.h"
+#include "hash_map.h"
+#include "profile.h"
+#include "vulkan_allocator.h"
+#include "vulkan_buffer.h"
+#include "vulkan_compute.h"
+#include "vulkan_deferred.h"
+#include "vulkan_draw.h"
+#include "vulkan_profiler.h"
+#include "vulkan_render_graph.h"
+#include "vulkan_timeline.h"
 
 static Vulkan_Context context = {0};
 
+// Relative to the working directory, same as the shaders
+#define PIPELINE_CACHE_FILE "pipeline_cache.bin"
+
 static const char **required_extension_names;
 
 #ifdef DEBUG_MODE
@@ -102,13 +116,16 @@ static void setup_debug_messenger()
 
 static void get_required_extenion_names(const char ***extension_names)
 {
-    array_push(*extension_names, &VK_KHR_SURFACE_EXTENSION_NAME);
-
 #ifdef DEBUG_MODE
     // Other things potentially will be added in the future...
     array_push(*extension_names, &VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 #endif
 
+    // Nothing gets presented in headless mode, so we don't need any surface
+    if (context.headless) return;
+
+    array_push(*extension_names, &VK_KHR_SURFACE_EXTENSION_NAME);
+
 #if PLATFORM_WINDOWS
     array_push(*extension_names, &"VK_KHR_win32_surface");
 #elif PLATFORM_LINUX
@@ -128,7 +145,9 @@ static void create_instance()
     app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     app_info.pEngineName = "No Engine";
     app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    app_info.apiVersion = VK_API_VERSION_1_0;
+    // Timeline semaphores are core in 1.2, dynamic rendering in 1.3. This is only the
+    // highest version the application uses, 1.2 implementations are fine with it.
+    app_info.apiVersion = VK_API_VERSION_1_3;
 
     required_extension_names = array_create(const char *);
     get_required_extenion_names(&required_extension_names);
@@ -157,6 +176,7 @@ static void get_physical_device_queue_family_support(
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families);
 
     u8 min_transfer_score = 255;
+    bool dedicated_compute = false;
     for (u32 i = 0; i < queue_family_count; ++i) {
         u8 current_transfer_score = 0;
         VkQueueFlags flags = queue_families[i].queueFlags;
@@ -166,14 +186,27 @@ static void get_physical_device_queue_family_support(
             ++current_transfer_score;
         }
 
-        VkBool32 present_support = VK_FALSE;
-        VULKAN_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(device, i, context.surface, &present_support));
-        if (present_support) {
-            supported_queue_families->present_queue_family_index = i;
+        if (context.headless) {
+            // There is no surface to present to, the "present" queue is just the graphics queue
+            if (flags & VK_QUEUE_GRAPHICS_BIT) {
+                supported_queue_families->present_queue_family_index = i;
+            }
+        } else {
+            VkBool32 present_support = VK_FALSE;
+            VULKAN_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(device, i, context.surface, &present_support));
+            if (present_support) {
+                supported_queue_families->present_queue_family_index = i;
+            }
         }
 
         if (flags & VK_QUEUE_COMPUTE_BIT) {
-            supported_queue_families->compute_queue_family_index = i;
+            // A family without graphics is where async compute actually runs
+            // alongside the graphics work, prefer that
+            bool dedicated = !(flags & VK_QUEUE_GRAPHICS_BIT);
+            if (dedicated || !dedicated_compute) {
+                supported_queue_families->compute_queue_family_index = i;
+                dedicated_compute = dedicated;
+            }
             ++current_transfer_score;
         }
 
@@ -194,19 +227,30 @@ static bool check_queue_family_support(Vulkan_Queue_Family_Indices supported_que
         && supported_queue_families.transfer_queue_family_index != -1;
 }
 
+static void *scratch_alloc(size_t size)
+{
+    void *block = memory_stack_alloc(&context.scratch_stack, size, MEMORY_DEFAULT_ALIGNMENT);
+    if (!block) {
+        LOG_FATAL("Scratch stack is out of memory, raise VULKAN_SCRATCH_STACK_SIZE\n");
+    }
+
+    return block;
+}
+
+// Lives on the scratch stack until free_swapchain_support, whatever is allocated there
+// in between has to be freed first
 static void get_physical_device_swapchain_support(
     VkPhysicalDevice device, Vulkan_Swapchain_Support_Details *details)
 {
+    details->marker = memory_stack_get_marker(&context.scratch_stack);
+
     VULKAN_CHECK(
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, context.surface, &details->capabilities));
 
     VULKAN_CHECK(
         vkGetPhysicalDeviceSurfaceFormatsKHR(device, context.surface, &details->format_count, NULL));
     if (details->format_count > 0) {
-        if (!details->formats) {
-            details->formats =
-                memory_alloc(sizeof(VkSurfaceFormatKHR) * details->format_count, MEMORY_TAG_VULKAN);
-        }
+        details->formats = scratch_alloc(sizeof(VkSurfaceFormatKHR) * details->format_count);
         VULKAN_CHECK(
             vkGetPhysicalDeviceSurfaceFormatsKHR(
                 device,
@@ -222,10 +266,7 @@ static void get_physical_device_swapchain_support(
             &details->present_mode_count,
             NULL));
     if (details->present_mode_count > 0) {
-        if (!details->present_modes) {
-            details->present_modes =
-                memory_alloc(sizeof(VkPresentModeKHR) * details->present_mode_count, MEMORY_TAG_VULKAN);
-        }
+        details->present_modes = scratch_alloc(sizeof(VkPresentModeKHR) * details->present_mode_count);
         VULKAN_CHECK(
             vkGetPhysicalDeviceSurfacePresentModesKHR(
                 device,
@@ -237,23 +278,14 @@ static void get_physical_device_swapchain_support(
 
 static void free_swapchain_support(Vulkan_Swapchain_Support_Details *details)
 {
-    if (details->formats) {
-        memory_free(
-            details->formats,
-            sizeof(VkSurfaceFormatKHR) * details->format_count,
-            MEMORY_TAG_VULKAN);
-        details->formats = NULL;
-        details->format_count = 0;
-    }
-
-    if (details->present_modes) {
-        memory_free(
-            details->present_modes,
-            sizeof(VkPresentModeKHR) * details->present_mode_count,
-            MEMORY_TAG_VULKAN);
-        details->present_modes = NULL;
-        details->present_mode_count = 0;
-    }
+    // Never queried (headless)
+    if (!details->formats && !details->present_modes) return;
+
+    memory_stack_free_to_marker(&context.scratch_stack, details->marker);
+    details->formats = NULL;
+    details->format_count = 0;
+    details->present_modes = NULL;
+    details->present_mode_count = 0;
 }
 
 static const char *physical_device_extension_names[] = {
@@ -261,38 +293,86 @@ static const char *physical_device_extension_names[] = {
 };
 static const u32 physical_device_extension_count = 1;
 
+static u32 get_physical_device_extension_count()
+{
+    // Headless mode doesn't need a swapchain
+    return context.headless ? 0 : physical_device_extension_count;
+}
+
 static bool check_physical_device_extension_support(VkPhysicalDevice device)
 {
     u32 available_extension_count;
     VULKAN_CHECK(
         vkEnumerateDeviceExtensionProperties(device, NULL, &available_extension_count, NULL));
 
-    if (available_extension_count > 0) {
-        VkExtensionProperties available_extensions[available_extension_count];
-        VULKAN_CHECK(
-            vkEnumerateDeviceExtensionProperties(
-                device,
-                NULL,
-                &available_extension_count,
-                available_extensions));
-
-        for (u32 i = 0; i < physical_device_extension_count; ++i) {
-            bool found = false;
-            for (u32 j = 0; j < available_extension_count; ++j) {
-                if (strcmp(physical_device_extension_names[i], available_extensions[i].extensionName)) {
-                    found = true;
-                    break;
-                }
-            }
+    VkExtensionProperties available_extensions[available_extension_count + 1];
+    VULKAN_CHECK(
+        vkEnumerateDeviceExtensionProperties(
+            device,
+            NULL,
+            &available_extension_count,
+            available_extensions));
+
+    // Drivers expose a few hundred extensions, don't scan them for every required one
+    Hash_Map available_names;
+    hash_map_create_string(&available_names, 0, available_extension_count, MEMORY_TAG_VULKAN);
+    for (u32 i = 0; i < available_extension_count; ++i) {
+        const char *name = available_extensions[i].extensionName;
+        hash_map_insert(&available_names, &name, NULL);
+    }
 
-            if (!found) {
-                LOG_WARNING("Required extension not found: '%s'\n", physical_device_extension_names[i]);
-                return false;
-            }
+    bool supported = true;
+    for (u32 i = 0; i < get_physical_device_extension_count(); ++i) {
+        if (!hash_map_get(&available_names, &physical_device_extension_names[i])) {
+            LOG_WARNING("Required extension not found: '%s'\n", physical_device_extension_names[i]);
+            supported = false;
+            break;
         }
     }
 
-    return true;
+    hash_map_destroy(&available_names);
+
+    return supported;
+}
+
+static bool is_device_extension_supported(VkPhysicalDevice device, const char *name)
+{
+    u32 available_extension_count;
+    VULKAN_CHECK(
+        vkEnumerateDeviceExtensionProperties(device, NULL, &available_extension_count, NULL));
+
+    VkExtensionProperties available_extensions[available_extension_count + 1];
+    VULKAN_CHECK(
+        vkEnumerateDeviceExtensionProperties(
+            device,
+            NULL,
+            &available_extension_count,
+            available_extensions));
+
+    for (u32 i = 0; i < available_extension_count; ++i) {
+        if (strcmp(available_extensions[i].extensionName, name) == 0) return true;
+    }
+    return false;
+}
+
+// Core in 1.3, needs_extension is set when it has to come from VK_KHR_dynamic_rendering
+static bool check_dynamic_rendering_support(VkPhysicalDevice device, bool *needs_extension)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+
+    *needs_extension = properties.apiVersion < VK_API_VERSION_1_3;
+    if (*needs_extension && !is_device_extension_supported(device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+        return false;
+    }
+
+    VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering_features = {0};
+    dynamic_rendering_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+    VkPhysicalDeviceFeatures2 features_2 = {0};
+    features_2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features_2.pNext = &dynamic_rendering_features;
+    vkGetPhysicalDeviceFeatures2(device, &features_2);
+    return dynamic_rendering_features.dynamicRendering;
 }
 
 static u32 rate_physical_device_suitability(VkPhysicalDevice device)
@@ -304,9 +384,21 @@ static u32 rate_physical_device_suitability(VkPhysicalDevice device)
     if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) score += 1000;
     score += properties.limits.maxImageDimension2D; // Maximum possible size of textures affects graphics quality
 
+    // Application can't function without geometry shaders. Headless mode is used on
+    // software rasterizers, so don't be picky there.
     VkPhysicalDeviceFeatures features;
     vkGetPhysicalDeviceFeatures(device, &features);
-    if (!features.geometryShader) return 0; // Application can't function without geometry shaders
+    if (!features.geometryShader && !context.headless) return 0;
+
+    if (properties.apiVersion < VK_API_VERSION_1_2) return 0;
+
+    VkPhysicalDeviceVulkan12Features vulkan_12_features = {0};
+    vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features_2 = {0};
+    features_2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features_2.pNext = &vulkan_12_features;
+    vkGetPhysicalDeviceFeatures2(device, &features_2);
+    if (!vulkan_12_features.timelineSemaphore) return 0;
 
     Vulkan_Queue_Family_Indices supported_queue_families;
     get_physical_device_queue_family_support(device, &supported_queue_families);
@@ -314,6 +406,9 @@ static u32 rate_physical_device_suitability(VkPhysicalDevice device)
 
     if (!check_physical_device_extension_support(device)) return 0;
 
+    // Make sure it has at least 1 point
+    if (context.headless) return score + 1;
+
     Vulkan_Swapchain_Support_Details swapchain_support = {0};
     get_physical_device_swapchain_support(device, &swapchain_support);
     bool swapchain_support_adequate =
@@ -356,51 +451,110 @@ static void pick_physical_device()
 
     context.physical_device = physical_devices[best_picked.index];
     get_physical_device_queue_family_support(context.physical_device, &context.supported_queue_families);
-    get_physical_device_swapchain_support(context.physical_device, &context.swapchain_support);
+    if (!context.headless) {
+        get_physical_device_swapchain_support(context.physical_device, &context.swapchain_support);
+    }
 }
 
 static void create_logical_device()
 {
-    bool shared_present_queue =
-        context.supported_queue_families.graphics_queue_family_index ==
-            context.supported_queue_families.present_queue_family_index;
-    bool shared_transfer_queue =
-        context.supported_queue_families.graphics_queue_family_index ==
-            context.supported_queue_families.transfer_queue_family_index;
-    
-    u32 index_count = 1;
-    if (!shared_present_queue) index_count++;
-    if (!shared_transfer_queue) index_count++;
-
-    u32 indices[index_count];
-    u32 index = 0;
-    indices[index++] = context.supported_queue_families.graphics_queue_family_index;
-    if (!shared_present_queue)
-        indices[index++] = context.supported_queue_families.present_queue_family_index;
-    if (!shared_transfer_queue)
-        indices[index++] = context.supported_queue_families.transfer_queue_family_index;
+    Vulkan_Queue_Family_Indices *families = &context.supported_queue_families;
+
+    // One create info per distinct family. Compute gets a second graphics queue
+    // when it has to share the family and the family has one to spare.
+    u32 indices[4];
+    u32 queue_counts[4];
+    u32 index_count = 0;
+    u32 requested[] = {
+        families->graphics_queue_family_index,
+        families->present_queue_family_index,
+        families->transfer_queue_family_index,
+        families->compute_queue_family_index,
+    };
+    for (u32 i = 0; i < 4; ++i) {
+        bool found = false;
+        for (u32 j = 0; j < index_count; ++j) {
+            if (indices[j] == requested[i]) found = true;
+        }
+        if (!found) {
+            indices[index_count] = requested[i];
+            queue_counts[index_count] = 1;
+            ++index_count;
+        }
+    }
+
+    u32 compute_queue_index = 0;
+    if (families->compute_queue_family_index == families->graphics_queue_family_index) {
+        u32 queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(context.physical_device, &queue_family_count, NULL);
+        VkQueueFamilyProperties queue_family_properties[queue_family_count];
+        vkGetPhysicalDeviceQueueFamilyProperties(
+            context.physical_device, &queue_family_count, queue_family_properties);
+
+        if (queue_family_properties[families->graphics_queue_family_index].queueCount > 1) {
+            queue_counts[0] = 2; // The graphics family always comes first
+            compute_queue_index = 1;
+        }
+    }
+
+    static const float queue_priorities[] = {1.0f, 1.0f};
 
     VkDeviceQueueCreateInfo queue_create_infos[index_count];
     for (u32 i = 0; i < index_count; ++i) {
         queue_create_infos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queue_create_infos[i].queueFamilyIndex = indices[i];
-        queue_create_infos[i].queueCount = 1;
-        float queue_priority = 1.0f;
-        queue_create_infos[i].pQueuePriorities = &queue_priority;
+        queue_create_infos[i].queueCount = queue_counts[i];
+        queue_create_infos[i].pQueuePriorities = queue_priorities;
         queue_create_infos[i].flags = 0;
         queue_create_infos[i].pNext = 0;
     }
 
-    // TODO: I don't know what it is (yet), I'll take a look on it later
+    // Indirect draws get by without any of these, they only save calls (see vulkan_draw.h)
+    VkPhysicalDeviceVulkan12Features supported_12_features = {0};
+    supported_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported_features = {0};
+    supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported_features.pNext = &supported_12_features;
+    vkGetPhysicalDeviceFeatures2(context.physical_device, &supported_features);
+    context.multi_draw_indirect = supported_features.features.multiDrawIndirect;
+    context.draw_indirect_first_instance = supported_features.features.drawIndirectFirstInstance;
+    context.draw_indirect_count = supported_12_features.drawIndirectCount;
+
     VkPhysicalDeviceFeatures device_features = {0};
+    device_features.multiDrawIndirect = context.multi_draw_indirect;
+    device_features.drawIndirectFirstInstance = context.draw_indirect_first_instance;
+
+    // Upload completion is tracked with a timeline semaphore
+    VkPhysicalDeviceVulkan12Features vulkan_12_features = {0};
+    vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan_12_features.timelineSemaphore = VK_TRUE;
+    vulkan_12_features.drawIndirectCount = context.draw_indirect_count;
+
+    const char *extension_names[physical_device_extension_count + 1];
+    u32 extension_count = get_physical_device_extension_count();
+    memory_copy(extension_names, physical_device_extension_names, sizeof(const char *) * extension_count);
+
+    // Optional, the render graph falls back to render passes without it
+    bool needs_extension = false;
+    context.dynamic_rendering = !context.dynamic_rendering_disabled
+        && check_dynamic_rendering_support(context.physical_device, &needs_extension);
+
+    VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering_features = {0};
+    dynamic_rendering_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+    dynamic_rendering_features.dynamicRendering = VK_TRUE;
+    if (context.dynamic_rendering) {
+        vulkan_12_features.pNext = &dynamic_rendering_features;
+        if (needs_extension) extension_names[extension_count++] = VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME;
+    }
 
     VkDeviceCreateInfo device_create_info = {0};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_create_info.pNext = &vulkan_12_features;
     device_create_info.queueCreateInfoCount = index_count;
     device_create_info.pQueueCreateInfos = queue_create_infos;
     device_create_info.pEnabledFeatures = &device_features;
-    device_create_info.enabledExtensionCount = physical_device_extension_count;
-    device_create_info.ppEnabledExtensionNames = physical_device_extension_names;
+    device_create_info.enabledExtensionCount = extension_count;
+    device_create_info.ppEnabledExtensionNames = extension_names;
 
     // Deprecated and ignored
     device_create_info.enabledLayerCount = 0;
@@ -428,32 +582,82 @@ static void create_logical_device()
         context.supported_queue_families.transfer_queue_family_index,
         0,
         &context.transfer_queue);
+    vkGetDeviceQueue(
+        context.logical_device,
+        context.supported_queue_families.compute_queue_family_index,
+        compute_queue_index,
+        &context.compute_queue);
+
+    if (context.dynamic_rendering) {
+        const char *begin_name = needs_extension ? "vkCmdBeginRenderingKHR" : "vkCmdBeginRendering";
+        const char *end_name = needs_extension ? "vkCmdEndRenderingKHR" : "vkCmdEndRendering";
+        context.cmd_begin_rendering =
+            (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(context.logical_device, begin_name);
+        context.cmd_end_rendering =
+            (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(context.logical_device, end_name);
+        if (context.cmd_begin_rendering == NULL || context.cmd_end_rendering == NULL) {
+            LOG_FATAL("Failed to load %s and %s\n", begin_name, end_name);
+        }
+        LOG_INFO("Dynamic rendering%s\n", needs_extension ? " through VK_KHR_dynamic_rendering" : "");
+    } else {
+        LOG_INFO("Rendering through render passes and framebuffers\n");
+    }
+
+    LOG_INFO("Indirect draws: multi draw %s, first instance %s, draw count %s\n",
+        context.multi_draw_indirect ? "yes" : "no",
+        context.draw_indirect_first_instance ? "yes" : "no",
+        context.draw_indirect_count ? "yes" : "no");
+
+    if (families->compute_queue_family_index != families->graphics_queue_family_index) {
+        LOG_INFO("Async compute on queue family %u\n", families->compute_queue_family_index);
+    } else if (compute_queue_index > 0) {
+        LOG_INFO("Async compute on a second graphics queue\n");
+    } else {
+        LOG_INFO("Async compute shares the graphics queue, it won't overlap with graphics work\n");
+    }
 }
 
-static void create_swapchain()
+static void create_image_view(VkImage image, VkFormat format, VkImageView *image_view)
+{
+    VkImageViewCreateInfo create_info = {0};
+    create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    create_info.image = image;
+    create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    create_info.format = format;
+    create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    create_info.subresourceRange.baseMipLevel = 0;
+    create_info.subresourceRange.levelCount = 1;
+    create_info.subresourceRange.baseArrayLayer = 0;
+    create_info.subresourceRange.layerCount = 1;
+
+    VULKAN_CHECK(vkCreateImageView(context.logical_device, &create_info, context.allocator, image_view));
+}
+
+static VkSurfaceFormatKHR choose_surface_format()
 {
-    VkSurfaceFormatKHR surface_format;
-    bool found = false;
+    // Keep the current format on recreation as long as the surface still supports
+    // it, a different one needs a new render pass and pipeline
+    VkFormat preferred_format = context.swapchain_image_format != VK_FORMAT_UNDEFINED
+        ? context.swapchain_image_format
+        : VK_FORMAT_B8G8R8A8_SRGB;
+
     for (u32 i = 0; i < context.swapchain_support.format_count; ++i) {
         VkSurfaceFormatKHR available_format = context.swapchain_support.formats[i];
-        if (available_format.format == VK_FORMAT_B8G8R8A8_SRGB &&
+        if (available_format.format == preferred_format &&
             available_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-            surface_format = available_format;
-            found = true;
-            break;
+            return available_format;
         }
     }
-    if (!found) surface_format = context.swapchain_support.formats[0];
 
-    VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
-    for (u32 i = 0; i < context.swapchain_support.present_mode_count; ++i) {
-        VkPresentModeKHR available_present_mode = context.swapchain_support.present_modes[i];
-        if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            present_mode = available_present_mode;
-            break;
-        }
-    }
+    return context.swapchain_support.formats[0];
+}
 
+static VkExtent2D choose_swapchain_extent()
+{
     VkExtent2D extent = {
         .width = context.framebuffer_width,
         .height = context.framebuffer_height,
@@ -467,12 +671,83 @@ static void create_swapchain()
         extent.height = CLAMP(extent.height, min_extent.height, max_extent.height);
     }
 
-    u32 image_count = context.swapchain_support.capabilities.minImageCount + 1;
-    if (context.swapchain_support.capabilities.maxImageCount > 0 &&
-        image_count > context.swapchain_support.capabilities.maxImageCount) {
-        image_count = context.swapchain_support.capabilities.maxImageCount;
+    return extent;
+}
+
+static bool is_present_mode_supported(VkPresentModeKHR present_mode)
+{
+    for (u32 i = 0; i < context.swapchain_support.present_mode_count; ++i) {
+        if (context.swapchain_support.present_modes[i] == present_mode) return true;
+    }
+    return false;
+}
+
+static VkPresentModeKHR choose_present_mode()
+{
+    switch (context.present_policy) {
+        case VULKAN_PRESENT_POLICY_LOW_LATENCY:
+            // Mailbox doesn't tear, immediate does but is still better than waiting
+            if (is_present_mode_supported(VK_PRESENT_MODE_MAILBOX_KHR)) return VK_PRESENT_MODE_MAILBOX_KHR;
+            if (is_present_mode_supported(VK_PRESENT_MODE_IMMEDIATE_KHR)) return VK_PRESENT_MODE_IMMEDIATE_KHR;
+            break;
+
+        case VULKAN_PRESENT_POLICY_ADAPTIVE:
+            if (is_present_mode_supported(VK_PRESENT_MODE_FIFO_RELAXED_KHR)) return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            break;
+
+        default:
+            break;
     }
 
+    // The only mode every implementation has to support
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+static u32 choose_swapchain_image_count()
+{
+    VkSurfaceCapabilitiesKHR *capabilities = &context.swapchain_support.capabilities;
+
+    u32 image_count = context.requested_image_count > 0
+        ? context.requested_image_count
+        : capabilities->minImageCount + 1;
+
+    // The render graph imports the backbuffer with one variant per image, more than
+    // it has variants still work, at the cost of swapping images into them
+    if (image_count > VULKAN_RENDER_GRAPH_MAX_VARIANTS) {
+        image_count = VULKAN_RENDER_GRAPH_MAX_VARIANTS;
+    }
+    if (image_count < capabilities->minImageCount) {
+        image_count = capabilities->minImageCount;
+    }
+    // 0 means there's no maximum
+    if (capabilities->maxImageCount > 0 && image_count > capabilities->maxImageCount) {
+        image_count = capabilities->maxImageCount;
+    }
+
+    return image_count;
+}
+
+static const char *get_present_mode_name(VkPresentModeKHR present_mode)
+{
+    switch (present_mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:    return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR:      return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR:         return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+        default:                               return "unknown";
+    }
+}
+
+// Replaces context.swapchain if there is one, which then gets retired (not destroyed).
+// The image and image view arrays are always allocated anew.
+static void create_swapchain()
+{
+    VkSurfaceFormatKHR surface_format = choose_surface_format();
+
+    VkPresentModeKHR present_mode = choose_present_mode();
+    VkExtent2D extent = choose_swapchain_extent();
+    u32 image_count = choose_swapchain_image_count();
+
     VkSwapchainCreateInfoKHR create_info = {0};
     create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     create_info.surface = context.surface;
@@ -502,7 +777,9 @@ static void create_swapchain()
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     create_info.presentMode = present_mode;
     create_info.clipped = VK_TRUE;
-    create_info.oldSwapchain = VK_NULL_HANDLE;
+    // Lets the driver hand resources over from the old swapchain, which can still
+    // be presenting while the new one gets set up
+    create_info.oldSwapchain = context.swapchain;
 
     VULKAN_CHECK(
         vkCreateSwapchainKHR(
@@ -517,10 +794,8 @@ static void create_swapchain()
             context.swapchain,
             &context.swapchain_image_count,
             NULL));
-    if (context.swapchain_images == NULL) {
-        context.swapchain_images =
-            (VkImage *)memory_alloc(sizeof(VkImage) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
-    }
+    context.swapchain_images =
+        (VkImage *)memory_alloc(sizeof(VkImage) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
     VULKAN_CHECK(
         vkGetSwapchainImagesKHR(
             context.logical_device,
@@ -528,41 +803,143 @@ static void create_swapchain()
             &context.swapchain_image_count,
             context.swapchain_images));
 
-    if (context.swapchain_image_views == NULL) {
-        context.swapchain_image_views =
-            (VkImageView *)memory_alloc(sizeof(VkImageView) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+    // The format has to be known before creating the image views, otherwise they
+    // end up with VK_FORMAT_UNDEFINED.
+    context.swapchain_image_format = surface_format.format;
+
+    context.swapchain_image_views =
+        (VkImageView *)memory_alloc(sizeof(VkImageView) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+    for (u32 i = 0; i < context.swapchain_image_count; ++i) {
+        create_image_view(
+            context.swapchain_images[i],
+            context.swapchain_image_format,
+            &context.swapchain_image_views[i]);
     }
+
+    context.swapchain_extent = extent;
+    context.present_mode = present_mode;
+
+    LOG_INFO("Swapchain: %ux%u, %u images (%u requested), %s present mode\n",
+        extent.width,
+        extent.height,
+        context.swapchain_image_count,
+        image_count,
+        get_present_mode_name(present_mode));
+}
+
+static void create_offscreen_targets()
+{
+    // One offscreen image per frame in flight, so image index == frame index
+    context.swapchain_image_count = MAX_FRAMES_IN_FLIGHT;
+    context.swapchain_image_format = VK_FORMAT_R8G8B8A8_UNORM;
+    context.swapchain_extent.width = context.framebuffer_width;
+    context.swapchain_extent.height = context.framebuffer_height;
+
+    context.swapchain_images =
+        (VkImage *)memory_alloc(sizeof(VkImage) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+    context.swapchain_image_views =
+        (VkImageView *)memory_alloc(sizeof(VkImageView) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+    context.offscreen_image_allocations = (Vulkan_Allocation *)memory_alloc(
+        sizeof(Vulkan_Allocation) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+
+    VkDeviceSize readback_size =
+        (VkDeviceSize)context.swapchain_extent.width * context.swapchain_extent.height * 4;
+
     for (u32 i = 0; i < context.swapchain_image_count; ++i) {
-        VkImageViewCreateInfo create_info = {0};
-        create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        create_info.image = context.swapchain_images[i];
-        create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        create_info.format = context.swapchain_image_format;
-        create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        create_info.subresourceRange.baseMipLevel = 0;
-        create_info.subresourceRange.levelCount = 1;
-        create_info.subresourceRange.baseArrayLayer = 0;
-        create_info.subresourceRange.layerCount = 1;
+        VkImageCreateInfo image_create_info = {0};
+        image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.imageType = VK_IMAGE_TYPE_2D;
+        image_create_info.format = context.swapchain_image_format;
+        image_create_info.extent.width = context.swapchain_extent.width;
+        image_create_info.extent.height = context.swapchain_extent.height;
+        image_create_info.extent.depth = 1;
+        image_create_info.mipLevels = 1;
+        image_create_info.arrayLayers = 1;
+        image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
         VULKAN_CHECK(
-            vkCreateImageView(
+            vkCreateImage(
                 context.logical_device,
-                &create_info,
+                &image_create_info,
                 context.allocator,
-                &context.swapchain_image_views[i]));
+                &context.swapchain_images[i]));
+
+        if (!vulkan_allocate_image_memory(
+                context.swapchain_images[i],
+                image_create_info.tiling,
+                VULKAN_MEMORY_USAGE_GPU_ONLY,
+                MEMORY_TAG_GPU_IMAGE,
+                &context.offscreen_image_allocations[i])) {
+            LOG_FATAL("Failed to allocate offscreen image memory\n");
+        }
+
+        create_image_view(
+            context.swapchain_images[i],
+            context.swapchain_image_format,
+            &context.swapchain_image_views[i]);
+
+        VkBufferCreateInfo buffer_create_info = {0};
+        buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_create_info.size = readback_size;
+        buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VULKAN_CHECK(
+            vkCreateBuffer(
+                context.logical_device,
+                &buffer_create_info,
+                context.allocator,
+                &context.readback_buffers[i]));
+
+        // Host visible allocations stay mapped, we read from it every frame anyway
+        if (!vulkan_allocate_buffer_memory(
+                context.readback_buffers[i],
+                VULKAN_MEMORY_USAGE_GPU_TO_CPU,
+                MEMORY_TAG_GPU_BUFFER,
+                &context.readback_allocations[i])) {
+            LOG_FATAL("Failed to allocate readback buffer memory\n");
+        }
     }
 
-    context.swapchain_image_format = surface_format.format;
+    context.frame_submitted = false;
+}
 
-    context.swapchain_extent = extent;
+static void destroy_offscreen_targets()
+{
+    for (u32 i = 0; i < context.swapchain_image_count; ++i) {
+        vkDestroyBuffer(context.logical_device, context.readback_buffers[i], context.allocator);
+        vulkan_free_memory(&context.readback_allocations[i]);
+
+        vkDestroyImageView(context.logical_device, context.swapchain_image_views[i], context.allocator);
+        vkDestroyImage(context.logical_device, context.swapchain_images[i], context.allocator);
+        vulkan_free_memory(&context.offscreen_image_allocations[i]);
+    }
+
+    memory_free(
+        context.offscreen_image_allocations,
+        sizeof(Vulkan_Allocation) * context.swapchain_image_count,
+        MEMORY_TAG_VULKAN);
+    memory_free(
+        context.swapchain_image_views, sizeof(VkImageView) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+    memory_free(
+        context.swapchain_images, sizeof(VkImage) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+    context.offscreen_image_allocations = NULL;
+    context.swapchain_image_views = NULL;
+    context.swapchain_images = NULL;
 }
 
+// Only describes the attachments the graphics pipeline is created against, the
+// render passes that get recorded come from the render graph (they're compatible,
+// load/store ops and layouts don't matter for that). Not needed at all with dynamic
+// rendering, so a format change doesn't create anything either.
 static void create_renderpass()
 {
+    if (context.dynamic_rendering) return;
+
     VkAttachmentDescription color_attachment = {0};
     color_attachment.format = context.swapchain_image_format;
     color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -570,8 +947,8 @@ static void create_renderpass()
     color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     color_attachment.flags = 0;
 
     VkAttachmentReference color_attachment_ref = {0};
@@ -583,22 +960,12 @@ static void create_renderpass()
     subpass_desc.colorAttachmentCount = 1;
     subpass_desc.pColorAttachments = &color_attachment_ref;
 
-    VkSubpassDependency subpass_dependency = {0};
-    subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpass_dependency.dstSubpass = 0;
-    subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpass_dependency.srcAccessMask = 0;
-    subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
     VkRenderPassCreateInfo renderpass_create_info = {0};
     renderpass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     renderpass_create_info.attachmentCount = 1;
     renderpass_create_info.pAttachments = &color_attachment;
     renderpass_create_info.subpassCount = 1;
     renderpass_create_info.pSubpasses = &subpass_desc;
-    renderpass_create_info.dependencyCount = 1;
-    renderpass_create_info.pDependencies = &subpass_dependency;
 
     VULKAN_CHECK(
         vkCreateRenderPass(
@@ -608,12 +975,12 @@ static void create_renderpass()
             &context.renderpass));
 }
 
-static char *read_file(const char *filename, size_t *size)
+// Same as read_file, but a missing file is not an error. The contents are on the
+// scratch stack, free them by going back to a marker taken before the call.
+static char *try_read_file(const char *filename, size_t *size)
 {
-    FILE *file = NULL;
-    fopen_s(&file, filename, "rb+");
+    FILE *file = fopen(filename, "rb");
     if (!file) {
-        LOG_FATAL("Failed to open file\n");
         return NULL;
     }
 
@@ -622,10 +989,10 @@ static char *read_file(const char *filename, size_t *size)
     *size = ftell(file);  // get the file size
     fseek(file, 0, SEEK_SET);  // move back to the beginning of the file
 
-    char *buffer = (char *)memory_alloc(*size * sizeof(char), MEMORY_TAG_STRING);
+    char *buffer = (char *)memory_stack_alloc(&context.scratch_stack, *size, MEMORY_DEFAULT_ALIGNMENT);
     if (!buffer) {
         fclose(file);
-        LOG_FATAL("Failed to allocate memory\n");
+        LOG_WARNING("%s doesn't fit in the scratch stack\n", filename);
         return NULL;
     }
 
@@ -636,8 +1003,95 @@ static char *read_file(const char *filename, size_t *size)
     return buffer;
 }
 
+static char *read_file(const char *filename, size_t *size)
+{
+    char *buffer = try_read_file(filename, size);
+    if (!buffer) {
+        LOG_FATAL("Failed to read file: %s\n", filename);
+    }
+
+    return buffer;
+}
+
+// Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE, see the spec of vkGetPipelineCacheData
+typedef struct {
+    u32 header_size;
+    u32 header_version;
+    u32 vendor_id;
+    u32 device_id;
+    u8  uuid[VK_UUID_SIZE];
+} Pipeline_Cache_Header;
+
+static bool validate_pipeline_cache(const char *data, size_t size)
+{
+    if (size < sizeof(Pipeline_Cache_Header)) return false;
+
+    Pipeline_Cache_Header header;
+    memory_copy(&header, data, sizeof(header));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context.physical_device, &properties);
+
+    // A cache from another driver or GPU is useless at best
+    return header.header_size >= sizeof(Pipeline_Cache_Header)
+        && header.header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendor_id == properties.vendorID
+        && header.device_id == properties.deviceID
+        && memcmp(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+static void create_pipeline_cache()
+{
+    Memory_Stack_Marker marker = memory_stack_get_marker(&context.scratch_stack);
+
+    size_t size = 0;
+    char *data = try_read_file(PIPELINE_CACHE_FILE, &size);
+
+    context.pipeline_cache_warm = data && validate_pipeline_cache(data, size);
+    if (data && !context.pipeline_cache_warm) {
+        LOG_INFO("Discarding pipeline cache, it was created for another device or driver\n");
+    }
+
+    VkPipelineCacheCreateInfo create_info = {0};
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = context.pipeline_cache_warm ? size : 0;
+    create_info.pInitialData = context.pipeline_cache_warm ? data : NULL;
+
+    VULKAN_CHECK(
+        vkCreatePipelineCache(
+            context.logical_device,
+            &create_info,
+            context.allocator,
+            &context.pipeline_cache));
+
+    memory_stack_free_to_marker(&context.scratch_stack, marker);
+}
+
+static void save_pipeline_cache()
+{
+    size_t size = 0;
+    VULKAN_CHECK(vkGetPipelineCacheData(context.logical_device, context.pipeline_cache, &size, NULL));
+    if (size == 0) return;
+
+    Memory_Stack_Marker marker = memory_stack_get_marker(&context.scratch_stack);
+    char *data = (char *)scratch_alloc(size);
+    VULKAN_CHECK(vkGetPipelineCacheData(context.logical_device, context.pipeline_cache, &size, data));
+
+    FILE *file = fopen(PIPELINE_CACHE_FILE, "wb");
+    if (file) {
+        fwrite(data, 1, size, file);
+        fclose(file);
+    } else {
+        LOG_WARNING("Failed to write pipeline cache: %s\n", PIPELINE_CACHE_FILE);
+    }
+
+    memory_stack_free_to_marker(&context.scratch_stack, marker);
+}
+
 static void create_graphics_pipeline()
 {
+    Memory_Stack_Marker marker = memory_stack_get_marker(&context.scratch_stack);
+
     size_t vert_shader_size;
     char *vert_shader_code = read_file("shaders/vert.spv", &vert_shader_size);
     VkShaderModuleCreateInfo vert_shader_module_create_info = {0};
@@ -681,12 +1135,39 @@ static void create_graphics_pipeline()
         frag_shader_stage_info,
     };
 
-    // NOTE: we hard code the vertex data directly in the vertex shader,
-    // so we don't have to fill the struct for now.
+    // Binding 0 holds the vertices, the instance binding the offset and scale of each instance
     VkPipelineVertexInputStateCreateInfo vertext_input_create_info = {0};
     vertext_input_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertext_input_create_info.vertexBindingDescriptionCount = 0;
-    vertext_input_create_info.vertexAttributeDescriptionCount = 0;
+    VkVertexInputBindingDescription vertex_bindings[2] = {0};
+    vertex_bindings[0].binding = 0;
+    vertex_bindings[0].stride = sizeof(Vulkan_Vertex);
+    vertex_bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    vertex_bindings[1].binding = VULKAN_DRAW_INSTANCE_BINDING;
+    vertex_bindings[1].stride = sizeof(Vulkan_Instance);
+    vertex_bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    VkVertexInputAttributeDescription vertex_attributes[4] = {0};
+    vertex_attributes[0].location = 0;
+    vertex_attributes[0].binding = 0;
+    vertex_attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+    vertex_attributes[0].offset = offsetof(Vulkan_Vertex, position);
+    vertex_attributes[1].location = 1;
+    vertex_attributes[1].binding = 0;
+    vertex_attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    vertex_attributes[1].offset = offsetof(Vulkan_Vertex, color);
+    vertex_attributes[2].location = 2;
+    vertex_attributes[2].binding = VULKAN_DRAW_INSTANCE_BINDING;
+    vertex_attributes[2].format = VK_FORMAT_R32G32_SFLOAT;
+    vertex_attributes[2].offset = offsetof(Vulkan_Instance, offset);
+    vertex_attributes[3].location = 3;
+    vertex_attributes[3].binding = VULKAN_DRAW_INSTANCE_BINDING;
+    vertex_attributes[3].format = VK_FORMAT_R32_SFLOAT;
+    vertex_attributes[3].offset = offsetof(Vulkan_Instance, scale);
+
+    vertext_input_create_info.vertexBindingDescriptionCount = 2;
+    vertext_input_create_info.pVertexBindingDescriptions = vertex_bindings;
+    vertext_input_create_info.vertexAttributeDescriptionCount = 4;
+    vertext_input_create_info.pVertexAttributeDescriptions = vertex_attributes;
 
     VkPipelineInputAssemblyStateCreateInfo input_assembly_info = {0};
     input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -768,137 +1249,590 @@ static void create_graphics_pipeline()
     pipeline_create_info.layout = context.pipeline_layout;
     pipeline_create_info.renderPass = context.renderpass;
     pipeline_create_info.subpass = 0;
+
+    // Without a render pass the pipeline names the attachment formats itself
+    VkPipelineRenderingCreateInfo rendering_create_info = {0};
+    if (context.dynamic_rendering) {
+        rendering_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        rendering_create_info.colorAttachmentCount = 1;
+        rendering_create_info.pColorAttachmentFormats = &context.swapchain_image_format;
+        rendering_create_info.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+        rendering_create_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+        pipeline_create_info.pNext = &rendering_create_info;
+    }
     pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE; // optional
 
     VULKAN_CHECK(
         vkCreateGraphicsPipelines(
             context.logical_device,
-            VK_NULL_HANDLE,
+            context.pipeline_cache,
             1,
             &pipeline_create_info,
             context.allocator,
             &context.graphics_pipeline));
 
     vkDestroyShaderModule(context.logical_device, frag_shader_module, context.allocator);
-    memory_free(frag_shader_code, frag_shader_size, MEMORY_TAG_STRING);
-
     vkDestroyShaderModule(context.logical_device, vert_shader_module, context.allocator);
-    memory_free(vert_shader_code, vert_shader_size, MEMORY_TAG_STRING);
+
+    memory_stack_free_to_marker(&context.scratch_stack, marker);
 }
 
-static void create_framebuffers()
+static void destroy_image_views(VkImageView *image_views, u32 count)
 {
-    // context.swapchain_framebuffers = array_reserve(VkFramebuffer, context.swapchain_image_count);
-    
-    context.swapchain_framebuffers =
-        (VkFramebuffer *)memory_alloc(sizeof(VkFramebuffer) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
-    for (u32 i = 0; i < context.swapchain_image_count; ++i) {
-        // TODO: we might need depth attachment later
-        u32 attachment_count = 1;
-        VkImageView attachments[] = {context.swapchain_image_views[i]};
-        
-        VkFramebufferCreateInfo create_info = {0};
-        create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        create_info.renderPass = context.renderpass;
-        create_info.attachmentCount = attachment_count;
-        create_info.pAttachments = attachments;
-        create_info.width = context.swapchain_extent.width;
-        create_info.height = context.swapchain_extent.height;
-        create_info.layers = 1;
+    for (u32 i = 0; i < count; ++i) {
+        vkDestroyImageView(context.logical_device, image_views[i], context.allocator);
+    }
+    memory_free(image_views, sizeof(VkImageView) * count, MEMORY_TAG_VULKAN);
+}
 
+// Like the above, but for what submitted frames can still be using
+static void defer_image_views(VkImageView *image_views, u32 count)
+{
+    for (u32 i = 0; i < count; ++i) {
+        vulkan_defer_image_view(image_views[i]);
+    }
+    memory_free(image_views, sizeof(VkImageView) * count, MEMORY_TAG_VULKAN);
+}
+
+static void create_render_finished_semaphores()
+{
+    VkSemaphoreCreateInfo semaphore_create_info = {0};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    context.render_finished_semaphores =
+        (VkSemaphore *)memory_alloc(sizeof(VkSemaphore) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+    for (u32 i = 0; i < context.swapchain_image_count; ++i) {
         VULKAN_CHECK(
-            vkCreateFramebuffer(
+            vkCreateSemaphore(
                 context.logical_device,
-                &create_info,
+                &semaphore_create_info,
                 context.allocator,
-                &context.swapchain_framebuffers[i]));
+                &context.render_finished_semaphores[i]));
+    }
+}
+
+static void create_geometry()
+{
+    static const Vulkan_Vertex vertices[] = {
+        {{ 0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+        {{ 0.5f,  0.5f}, {0.0f, 1.0f, 0.0f}},
+        {{-0.5f,  0.5f}, {0.0f, 0.0f, 1.0f}},
+    };
+    static const u16 indices[] = {0, 1, 2};
+
+    if (!vulkan_buffer_create(&context.vertex_buffer, sizeof(vertices), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) ||
+        !vulkan_buffer_create(&context.index_buffer, sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT)) {
+        LOG_FATAL("Failed to create the geometry buffers\n");
+    }
+
+    // Written by the compute queue every frame, never uploaded
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        if (!vulkan_buffer_create(
+                &context.animated_vertex_buffers[i],
+                sizeof(vertices),
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+            LOG_FATAL("Failed to create the geometry buffers\n");
+        }
     }
+
+    // Goes out with the first frame
+    vulkan_buffer_upload(&context.vertex_buffer, 0, vertices, sizeof(vertices));
+    vulkan_buffer_upload(&context.index_buffer, 0, indices, sizeof(indices));
+    context.vertex_count = sizeof(vertices) / sizeof(vertices[0]);
+    context.index_count = sizeof(indices) / sizeof(indices[0]);
+    context.triangle_mesh = vulkan_draw_register_mesh(0, context.index_count, 0);
+}
+
+static void destroy_geometry()
+{
+    vulkan_buffer_destroy(&context.vertex_buffer);
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        vulkan_buffer_destroy(&context.animated_vertex_buffers[i]);
+    }
+    vulkan_buffer_destroy(&context.index_buffer);
+    context.vertex_count = 0;
+    context.index_count = 0;
 }
 
-static void create_command_pool()
+// Matches the push constants of shaders/animate.comp
+typedef struct {
+    f32 angle;
+    u32 vertex_count;
+} Animate_Constants;
+
+#define ANIMATE_GROUP_SIZE 64
+// Radians per frame, frames rather than time so headless output stays reproducible
+#define ANIMATE_SPEED 0.01f
+
+static void create_compute_pipelines()
 {
+    Memory_Stack_Marker marker = memory_stack_get_marker(&context.scratch_stack);
+
+    size_t shader_size;
+    char *shader_code = read_file("shaders/animate.spv", &shader_size);
+
+    if (!vulkan_compute_pipeline_create(
+            &context.animate_pipeline, shader_code, shader_size, 2, sizeof(Animate_Constants))) {
+        LOG_FATAL("Failed to create the animation pipeline\n");
+    }
+
+    memory_stack_free_to_marker(&context.scratch_stack, marker);
+}
+
+static void destroy_compute_pipelines()
+{
+    vulkan_compute_pipeline_destroy(&context.animate_pipeline);
+}
+
+// Records and submits the frame's async compute work, returns the compute timeline
+// value the graphics submission has to wait for (0 if there's none)
+static u64 record_compute(u32 frame)
+{
+    PROFILE_FUNCTION();
+
+    vulkan_compute_begin_frame(frame);
+
+    Animate_Constants constants = {0};
+    constants.angle = (f32)context.submitted_frame_count * ANIMATE_SPEED;
+    constants.vertex_count = context.vertex_count;
+
+    const Vulkan_Buffer *buffers[] = {&context.vertex_buffer, &context.animated_vertex_buffers[frame]};
+    vulkan_compute_dispatch(
+        &context.animate_pipeline,
+        buffers,
+        &constants,
+        (context.vertex_count + ANIMATE_GROUP_SIZE - 1) / ANIMATE_GROUP_SIZE,
+        1,
+        1);
+
+    return vulkan_compute_submit();
+}
+
+static VkCommandPool create_command_pool()
+{
+    // Transient: everything allocated from it gets re-recorded every frame
     VkCommandPoolCreateInfo create_info = {0};
     create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
     create_info.queueFamilyIndex = context.supported_queue_families.graphics_queue_family_index;
 
-    VULKAN_CHECK(
-        vkCreateCommandPool(
-            context.logical_device,
-            &create_info,
-            context.allocator,
-            &context.command_pool));
+    VkCommandPool pool;
+    VULKAN_CHECK(vkCreateCommandPool(context.logical_device, &create_info, context.allocator, &pool));
+
+    return pool;
+}
+
+static void create_command_pools()
+{
+    context.command_thread_count = job_thread_count() > 0 ? job_thread_count() : 1;
+
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        Vulkan_Frame_Commands *commands = &context.frame_commands[i];
+
+        commands->primary_pool = create_command_pool();
+
+        VkCommandBufferAllocateInfo alloc_info = {0};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = commands->primary_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+        VULKAN_CHECK(vkAllocateCommandBuffers(context.logical_device, &alloc_info, &commands->primary_buffer));
+
+        // Secondary buffers are allocated the first time a thread needs them
+        size_t threads_size = sizeof(Vulkan_Thread_Commands) * context.command_thread_count;
+        commands->threads = memory_alloc(threads_size, MEMORY_TAG_VULKAN);
+        memory_zero(commands->threads, threads_size);
+        for (u32 j = 0; j < context.command_thread_count; ++j) {
+            commands->threads[j].pool = create_command_pool();
+        }
+    }
+}
+
+static void destroy_command_pools()
+{
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        Vulkan_Frame_Commands *commands = &context.frame_commands[i];
+
+        // Destroying a pool frees its command buffers
+        for (u32 j = 0; j < context.command_thread_count; ++j) {
+            vkDestroyCommandPool(context.logical_device, commands->threads[j].pool, context.allocator);
+        }
+        memory_free(
+            commands->threads, sizeof(Vulkan_Thread_Commands) * context.command_thread_count, MEMORY_TAG_VULKAN);
+        commands->threads = NULL;
+
+        vkDestroyCommandPool(context.logical_device, commands->primary_pool, context.allocator);
+    }
+}
+
+// Only call once the frame's timeline value has been reached
+static void reset_command_pools(u32 frame)
+{
+    Vulkan_Frame_Commands *commands = &context.frame_commands[frame];
+
+    VULKAN_CHECK(vkResetCommandPool(context.logical_device, commands->primary_pool, 0));
+    for (u32 i = 0; i < context.command_thread_count; ++i) {
+        VULKAN_CHECK(vkResetCommandPool(context.logical_device, commands->threads[i].pool, 0));
+        commands->threads[i].used_count = 0;
+    }
+}
+
+// Hands out the next secondary command buffer of the calling job thread
+static VkCommandBuffer get_secondary_command_buffer(u32 frame)
+{
+    Vulkan_Thread_Commands *thread = &context.frame_commands[frame].threads[job_thread_index()];
+
+    if (thread->used_count == thread->allocated_count) {
+        if (thread->allocated_count == VULKAN_MAX_RECORDING_JOBS) {
+            LOG_FATAL("Job thread %u ran out of secondary command buffers, raise VULKAN_MAX_RECORDING_JOBS\n",
+                      job_thread_index());
+        }
+
+        VkCommandBufferAllocateInfo alloc_info = {0};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = thread->pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        alloc_info.commandBufferCount = 1;
+        VULKAN_CHECK(
+            vkAllocateCommandBuffers(
+                context.logical_device,
+                &alloc_info,
+                &thread->secondary_buffers[thread->allocated_count]));
+        ++thread->allocated_count;
+    }
+
+    return thread->secondary_buffers[thread->used_count++];
+}
+
+static void record_readback(VkCommandBuffer command_buffer, u32 image_index)
+{
+    // The render graph already moved the image to TRANSFER_SRC_OPTIMAL layout
+    VkBufferImageCopy region = {0};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0; // tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = context.swapchain_extent.width;
+    region.imageExtent.height = context.swapchain_extent.height;
+    region.imageExtent.depth = 1;
+    vkCmdCopyImageToBuffer(
+        command_buffer,
+        context.swapchain_images[image_index],
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        context.readback_buffers[image_index],
+        1,
+        &region);
+
+    // Make the copied pixels visible to the host once the frame's timeline value is reached
+    VkBufferMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = context.readback_buffers[image_index];
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(
+        command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        0, NULL,
+        1, &barrier,
+        0, NULL);
 }
 
-static void create_command_buffer()
+typedef struct {
+    const Vulkan_Render_Pass_Info *pass;
+    u32                            first_batch;
+    u32                            batch_count;
+    VkCommandBuffer               *output;
+} Record_Draws_Job;
+
+// Records a range of draw batches into a secondary command buffer that continues the
+// render pass
+static void record_draws(void *data)
 {
-    VkCommandBufferAllocateInfo alloc_info = {0};
-    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    alloc_info.commandPool = context.command_pool;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandBufferCount = 1;
+    PROFILE_ZONE("record_draws");
+
+    Record_Draws_Job *job = (Record_Draws_Job *)data;
+
+    VkCommandBuffer command_buffer = get_secondary_command_buffer(job->pass->frame);
+
+    VkCommandBufferInheritanceInfo inheritance_info = {0};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.renderPass = job->pass->renderpass;
+    inheritance_info.subpass = 0;
+    inheritance_info.framebuffer = job->pass->framebuffer;
+
+    // Dynamic rendering has no render pass to inherit, only the attachment formats
+    VkCommandBufferInheritanceRenderingInfo inheritance_rendering_info = {0};
+    if (job->pass->renderpass == VK_NULL_HANDLE) {
+        inheritance_rendering_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+        // The secondaries are the contents, they can't say so themselves (VUID-06003)
+        inheritance_rendering_info.flags = 0;
+        inheritance_rendering_info.colorAttachmentCount = job->pass->color_format_count;
+        inheritance_rendering_info.pColorAttachmentFormats = job->pass->color_formats;
+        inheritance_rendering_info.depthAttachmentFormat = job->pass->depth_format;
+        inheritance_rendering_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        inheritance_info.pNext = &inheritance_rendering_info;
+    }
 
-    VULKAN_CHECK(vkAllocateCommandBuffers(context.logical_device, &alloc_info, &context.command_buffer));
+    VkCommandBufferBeginInfo cmd_begin_info = {0};
+    cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_begin_info.flags =
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    cmd_begin_info.pInheritanceInfo = &inheritance_info;
+    VULKAN_CHECK(vkBeginCommandBuffer(command_buffer, &cmd_begin_info));
+
+    // Secondary command buffers don't inherit any state, so every one sets up its own.
+    // The batches bind their pipelines.
+    VkViewport viewport = {0};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)job->pass->extent.width;
+    viewport.height = (float)job->pass->extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor = {0};
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    scissor.extent = job->pass->extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    VkDeviceSize vertex_offset = 0;
+    vkCmdBindVertexBuffers(
+        command_buffer, 0, 1, &context.animated_vertex_buffers[job->pass->frame].buffer, &vertex_offset);
+    vkCmdBindIndexBuffer(command_buffer, context.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+    vulkan_draw_record(command_buffer, job->pass->frame, job->first_batch, job->batch_count);
+
+    VULKAN_CHECK(vkEndCommandBuffer(command_buffer));
+
+    *job->output = command_buffer;
 }
 
-static void record_command_buffer(VkCommandBuffer command_buffer, u32 image_index)
+// The submitted draws are merged into batches, which are split into even ranges and
+// recorded in parallel
+static void record_main_pass(VkCommandBuffer command_buffer, const Vulkan_Render_Pass_Info *info, void *data)
 {
+    // Just the triangle for now, on top of whatever was submitted
+    Vulkan_Draw_Packet triangle = {0};
+    triangle.pipeline = context.graphics_pipeline;
+    triangle.mesh = context.triangle_mesh;
+    triangle.instance.scale = 1.0f;
+    vulkan_draw_submit(&triangle, 1);
+
+    u32 batch_count = vulkan_draw_prepare(info->frame);
+
+    u32 job_count = MIN(MIN(batch_count, context.command_thread_count), VULKAN_MAX_RECORDING_JOBS);
+    VkCommandBuffer secondary_buffers[VULKAN_MAX_RECORDING_JOBS];
+
+    Record_Draws_Job *jobs = vulkan_frame_alloc(sizeof(Record_Draws_Job) * job_count);
+    for (u32 i = 0; i < job_count; ++i) {
+        jobs[i].pass = info;
+        jobs[i].first_batch = batch_count * i / job_count;
+        jobs[i].batch_count = batch_count * (i + 1) / job_count - jobs[i].first_batch;
+        jobs[i].output = &secondary_buffers[i];
+    }
+
+    if (job_count == 1) {
+        // Not worth a trip through the job system
+        record_draws(&jobs[0]);
+    } else if (job_count > 1) {
+        Job job_decls[VULKAN_MAX_RECORDING_JOBS];
+        for (u32 i = 0; i < job_count; ++i) {
+            job_decls[i].proc = record_draws;
+            job_decls[i].data = &jobs[i];
+        }
+
+        Job_Counter counter = {0};
+        job_run(job_decls, job_count, &counter);
+        job_wait(&counter);
+    }
+
+    if (job_count > 0) {
+        vkCmdExecuteCommands(command_buffer, job_count, secondary_buffers);
+    }
+}
+
+static void record_readback_pass(VkCommandBuffer command_buffer, const Vulkan_Render_Pass_Info *info, void *data)
+{
+    // Offscreen image and readback buffer both go by frame, as does the image index
+    record_readback(command_buffer, info->variant);
+}
+
+// Returns the transfer timeline value the submission has to wait for, 0 if none
+static u64 record_command_buffer(u32 frame, u32 image_index)
+{
+    VkCommandBuffer command_buffer = context.frame_commands[frame].primary_buffer;
+
     VkCommandBufferBeginInfo cmd_begin_info = {0};
     cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    cmd_begin_info.flags = 0; // optional
+    cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     cmd_begin_info.pInheritanceInfo = NULL; // optional, only relevant for secondary command buffers
-    VULKAN_CHECK(vkBeginCommandBuffer(context.command_buffer, &cmd_begin_info));
-
-    VkRenderPassBeginInfo render_begin_info = {0};
-    render_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_begin_info.renderPass = context.renderpass;
-    render_begin_info.framebuffer = context.swapchain_framebuffers[image_index];
-    render_begin_info.renderArea.offset.x = 0;
-    render_begin_info.renderArea.offset.y = 0;
-    render_begin_info.renderArea.extent.width = context.swapchain_extent.width;
-    render_begin_info.renderArea.extent.height = context.swapchain_extent.height;
-    render_begin_info.pNext = NULL;
-    u32 clear_value_count = 1;
-    VkClearValue clear_values[1] = {0};
-    clear_values[0].color.float32[0] = 0.0f;
-    clear_values[0].color.float32[1] = 0.0f;
-    clear_values[0].color.float32[2] = 0.0f;
-    clear_values[0].color.float32[3] = 1.0f;
-    render_begin_info.clearValueCount = clear_value_count;
-    render_begin_info.pClearValues = clear_values;
-
-    // // TODO: fix this!
-    // // Render pass does not work and it will produce "Integer division by zero error."
-    // vkCmdBeginRenderPass(context.command_buffer, &render_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-
-    // // Render pass
-    // {
-    //     vkCmdBindPipeline(
-    //         context.command_buffer,
-    //         VK_PIPELINE_BIND_POINT_GRAPHICS,
-    //         context.graphics_pipeline);
-    
-    //     VkViewport viewport = {0};
-    //     viewport.x = 0.0f;
-    //     viewport.y = 0.0f;
-    //     viewport.width = (float)context.swapchain_extent.width;
-    //     viewport.height = (float)context.swapchain_extent.height;
-    //     viewport.minDepth = 0.0f;
-    //     viewport.maxDepth = 1.0f;
-    //     vkCmdSetViewport(context.command_buffer, 0, 1, &viewport);
-    
-    //     VkRect2D scissor = {0};
-    //     scissor.offset.x = 0;
-    //     scissor.offset.y = 0;
-    //     scissor.extent = context.swapchain_extent;
-    //     vkCmdSetScissor(context.command_buffer, 0, 1, &scissor);
-    
-    //     vkCmdDraw(context.command_buffer, 3, 1, 0, 0);
-    // }
+    VULKAN_CHECK(vkBeginCommandBuffer(command_buffer, &cmd_begin_info));
+
+    vulkan_profiler_begin_frame(command_buffer, frame);
+
+    // Buffers uploaded since the last frame change hands before anything reads them
+    u64 upload_wait_value = vulkan_buffer_record_acquires(command_buffer);
+
+    // Only does something when the swapchain has more images than the graph has
+    // variants, the image index wraps around onto them then
+    vulkan_render_graph_set_image_variant(
+        context.backbuffer,
+        image_index,
+        context.swapchain_images[image_index],
+        context.swapchain_image_views[image_index]);
+    vulkan_render_graph_execute(command_buffer, frame, image_index);
 
-    // vkCmdEndRenderPass(context.command_buffer);
+    vulkan_profiler_end_frame(command_buffer);
 
-    VULKAN_CHECK(vkEndCommandBuffer(context.command_buffer));
+    VULKAN_CHECK(vkEndCommandBuffer(command_buffer));
+
+    return upload_wait_value;
+}
+
+// The main pass draws into the swapchain image (the offscreen image when headless),
+// which then gets copied into the readback buffer when headless. Built again for
+// every new swapchain.
+static void build_render_graph()
+{
+    vulkan_render_graph_reset();
+
+    Vulkan_Render_Graph_Image_Import backbuffer_import = {0};
+    backbuffer_import.variant_count = MIN(context.swapchain_image_count, VULKAN_RENDER_GRAPH_MAX_VARIANTS);
+    for (u32 i = 0; i < backbuffer_import.variant_count; ++i) {
+        backbuffer_import.images[i] = context.swapchain_images[i];
+        backbuffer_import.views[i] = context.swapchain_image_views[i];
+    }
+    backbuffer_import.format = context.swapchain_image_format;
+    backbuffer_import.extent = context.swapchain_extent;
+    // Cleared every frame, after the acquire semaphore wait at the color attachment stage
+    backbuffer_import.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    backbuffer_import.initial_stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    backbuffer_import.final_layout = context.headless
+        ? VK_IMAGE_LAYOUT_UNDEFINED
+        : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    u32 backbuffer = vulkan_render_graph_import_image("backbuffer", &backbuffer_import);
+    context.backbuffer = backbuffer;
+
+    VkClearValue clear_value = {0};
+    clear_value.color.float32[0] = 0.0f;
+    clear_value.color.float32[1] = 0.0f;
+    clear_value.color.float32[2] = 0.0f;
+    clear_value.color.float32[3] = 1.0f;
+
+    u32 main_pass = vulkan_render_graph_add_pass(
+        "main pass",
+        VULKAN_RENDER_PASS_GRAPHICS,
+        VULKAN_RENDER_PASS_FLAG_SECONDARY_COMMAND_BUFFERS,
+        record_main_pass,
+        NULL);
+    vulkan_render_graph_clear(main_pass, backbuffer, clear_value);
+
+    if (context.headless) {
+        Vulkan_Render_Graph_Buffer_Import readback_import = {0};
+        readback_import.variant_count = MAX_FRAMES_IN_FLIGHT;
+        for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+            readback_import.buffers[i] = context.readback_buffers[i];
+        }
+        u32 readback = vulkan_render_graph_import_buffer("readback", &readback_import);
+
+        u32 readback_pass = vulkan_render_graph_add_pass(
+            "readback",
+            VULKAN_RENDER_PASS_TRANSFER,
+            VULKAN_RENDER_PASS_FLAG_NONE,
+            record_readback_pass,
+            NULL);
+        vulkan_render_graph_use(readback_pass, backbuffer, VULKAN_RESOURCE_USE_TRANSFER_SRC);
+        vulkan_render_graph_use(readback_pass, readback, VULKAN_RESOURCE_USE_TRANSFER_DST);
+    }
+
+    if (!vulkan_render_graph_compile()) {
+        LOG_FATAL("Failed to compile the render graph\n");
+    }
+}
+
+// Rebuilds the swapchain for the current surface size without waiting for the
+// device: the old swapchain, its image views and the render graph objects go to the
+// deferred destruction queue, which releases them once the frames using them are
+// done. The pipeline only changes along with the surface format. Returns false
+// while the window is minimized.
+static bool recreate_swapchain()
+{
+    PROFILE_FUNCTION();
+
+    u64 start = platform_get_time_ns();
+
+    // The surface capabilities (current extent above all) change with the window
+    free_swapchain_support(&context.swapchain_support);
+    get_physical_device_swapchain_support(context.physical_device, &context.swapchain_support);
+
+    VkExtent2D extent = choose_swapchain_extent();
+    if (context.framebuffer_width == 0 || context.framebuffer_height == 0 ||
+        extent.width == 0 || extent.height == 0) {
+        return false;
+    }
+
+    // Views (and the framebuffers of the render graph) go before the swapchain whose
+    // images they use. The old swapchain itself stays valid until collected,
+    // create_swapchain hands it over.
+    VkSwapchainKHR old_swapchain = context.swapchain;
+    vulkan_render_graph_reset();
+    defer_image_views(context.swapchain_image_views, context.swapchain_image_count);
+
+    // The images belong to the old swapchain, only the array is ours
+    memory_free(
+        context.swapchain_images, sizeof(VkImage) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+    memory_free(
+        context.images_in_flight, sizeof(u64) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+
+    VkSemaphore *old_render_finished_semaphores = context.render_finished_semaphores;
+    u32 old_image_count = context.swapchain_image_count;
+
+    VkFormat old_format = context.swapchain_image_format;
+    create_swapchain();
+    vulkan_defer_swapchain(old_swapchain);
+
+    // Presents to the old swapchain can still be waiting on these, they go after it
+    for (u32 i = 0; i < old_image_count; ++i) {
+        vulkan_defer_semaphore(old_render_finished_semaphores[i]);
+    }
+    memory_free(old_render_finished_semaphores, sizeof(VkSemaphore) * old_image_count, MEMORY_TAG_VULKAN);
+    create_render_finished_semaphores();
+
+    if (context.swapchain_image_format != old_format) {
+        LOG_WARNING("Swapchain format changed, recreating the pipeline\n");
+
+        vulkan_defer_pipeline(context.graphics_pipeline);
+        vulkan_defer_pipeline_layout(context.pipeline_layout);
+        vulkan_defer_render_pass(context.renderpass);
+
+        create_renderpass();
+        create_graphics_pipeline();
+    }
+
+    build_render_graph();
+
+    // Images of the new swapchain haven't been used by any frame yet
+    size_t images_in_flight_size = sizeof(u64) * context.swapchain_image_count;
+    context.images_in_flight = (u64 *)memory_alloc(images_in_flight_size, MEMORY_TAG_VULKAN);
+    memory_zero(context.images_in_flight, images_in_flight_size);
+
+    context.swapchain_dirty = false;
+
+    u64 end = platform_get_time_ns();
+    LOG_INFO("Swapchain recreated in %.3f ms\n", (end - start) / 1000000.0);
+
+    return true;
 }
 
 static void create_sync_objects()
@@ -906,77 +1840,153 @@ static void create_sync_objects()
     VkSemaphoreCreateInfo semaphore_create_info = {0};
     semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VULKAN_CHECK(
-        vkCreateSemaphore(
-            context.logical_device,
-            &semaphore_create_info,
-            context.allocator,
-            &context.image_available_semaphore));
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        VULKAN_CHECK(
+            vkCreateSemaphore(
+                context.logical_device,
+                &semaphore_create_info,
+                context.allocator,
+                &context.image_available_semaphores[i]));
 
-    VULKAN_CHECK(
-        vkCreateSemaphore(
-            context.logical_device,
-            &semaphore_create_info,
-            context.allocator,
-            &context.render_finished_semaphore));
+        // Nothing submitted yet, waiting for 0 returns right away
+        context.frame_values[i] = 0;
+    }
 
-    VkFenceCreateInfo fence_create_info = {0};
-    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    // No swapchain image is owned by a frame yet
+    size_t images_in_flight_size = sizeof(u64) * context.swapchain_image_count;
+    context.images_in_flight = (u64 *)memory_alloc(images_in_flight_size, MEMORY_TAG_VULKAN);
+    memory_zero(context.images_in_flight, images_in_flight_size);
 
-    VULKAN_CHECK(
-        vkCreateFence(
-            context.logical_device,
-            &fence_create_info,
-            context.allocator,
-            &context.in_flight_fence));
+    // Offscreen frames are never presented
+    if (!context.headless) create_render_finished_semaphores();
+
+    context.current_frame = 0;
 }
 
-void vulkan_init(Platform_Window *window, u32 width, u32 height)
+static void init(Platform_Window *window, u32 width, u32 height)
 {
+    u64 init_start = platform_get_time_ns();
+
+    memory_arena_create(&context.frame_arena, VULKAN_FRAME_ARENA_SIZE, MEMORY_TAG_FRAME);
+    memory_stack_create(&context.scratch_stack, VULKAN_SCRATCH_STACK_SIZE, MEMORY_TAG_VULKAN);
+
     context.framebuffer_width = width;
     context.framebuffer_height = height;
 
     create_instance();
     setup_debug_messenger();
-    platform_window_create_vulkan_surface(window, &context);
+    if (!context.headless) {
+        platform_window_create_vulkan_surface(window, &context);
+    }
     pick_physical_device();
     create_logical_device();
-    create_swapchain();
+    vulkan_allocator_init(&context);
+    vulkan_timeline_init(&context);
+    vulkan_deferred_init(&context);
+    create_pipeline_cache();
+    if (context.headless) {
+        create_offscreen_targets();
+    } else {
+        create_swapchain();
+    }
     create_renderpass();
+
+    u64 pipeline_start = platform_get_time_ns();
     create_graphics_pipeline();
-    create_framebuffers();
-    create_command_pool();
-    create_command_buffer();
+    u64 pipeline_end = platform_get_time_ns();
+
+    vulkan_render_graph_init(&context);
+    build_render_graph();
+    create_command_pools();
     create_sync_objects();
+    vulkan_profiler_init(&context);
+    vulkan_buffer_system_init(&context);
+    vulkan_compute_init(&context);
+    vulkan_draw_init(&context);
+    create_geometry();
+    create_compute_pipelines();
+
+    // Compare these between a cold (no pipeline_cache.bin) and a warm start
+    u64 init_end = platform_get_time_ns();
+    LOG_INFO("Pipeline creation took %.3f ms (%s pipeline cache)\n",
+        (pipeline_end - pipeline_start) / 1000000.0,
+        context.pipeline_cache_warm ? "warm" : "cold");
+    LOG_INFO("Vulkan initialization took %.3f ms\n", (init_end - init_start) / 1000000.0);
 }
 
-void vulkan_destroy()
+void vulkan_init(Platform_Window *window, u32 width, u32 height)
 {
-    vkDestroySemaphore(context.logical_device, context.image_available_semaphore, context.allocator);
-    vkDestroySemaphore(context.logical_device, context.render_finished_semaphore, context.allocator);
-    vkDestroyFence(context.logical_device, context.in_flight_fence, context.allocator);
+    context.headless = false;
+    init(window, width, height);
+}
 
-    vkDestroyCommandPool(context.logical_device, context.command_pool, context.allocator);
+void vulkan_init_headless(u32 width, u32 height)
+{
+    context.headless = true;
+    init(NULL, width, height);
+}
 
-    for (u32 i = 0; i < context.swapchain_image_count; ++i) {
-        vkDestroyFramebuffer(context.logical_device, context.swapchain_framebuffers[i], context.allocator);
+void vulkan_destroy()
+{
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        vkDestroySemaphore(context.logical_device, context.image_available_semaphores[i], context.allocator);
     }
+    if (!context.headless) {
+        for (u32 i = 0; i < context.swapchain_image_count; ++i) {
+            vkDestroySemaphore(context.logical_device, context.render_finished_semaphores[i], context.allocator);
+        }
+        memory_free(
+            context.render_finished_semaphores,
+            sizeof(VkSemaphore) * context.swapchain_image_count,
+            MEMORY_TAG_VULKAN);
+        context.render_finished_semaphores = NULL;
+    }
+    memory_free(
+        context.images_in_flight, sizeof(u64) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+    context.images_in_flight = NULL;
+
+    vulkan_profiler_log_summary();
+    vulkan_profiler_destroy();
+
+    // Device memory as the last frame left it, before anything gets released
+    vulkan_allocator_log_stats();
+
+    destroy_command_pools();
+
+    vulkan_render_graph_destroy();
 
     vkDestroyPipeline(context.logical_device, context.graphics_pipeline, context.allocator);
     vkDestroyPipelineLayout(context.logical_device, context.pipeline_layout, context.allocator);
 
+    save_pipeline_cache();
+    vkDestroyPipelineCache(context.logical_device, context.pipeline_cache, context.allocator);
+
     vkDestroyRenderPass(context.logical_device, context.renderpass, context.allocator);
 
-    for (u32 i = 0; i < context.swapchain_image_count; ++i) {
-        vkDestroyImageView(context.logical_device, context.swapchain_image_views[i], context.allocator);
+    if (context.headless) {
+        destroy_offscreen_targets();
+    } else {
+        destroy_image_views(context.swapchain_image_views, context.swapchain_image_count);
+        context.swapchain_image_views = NULL;
+        memory_free(
+            context.swapchain_images, sizeof(VkImage) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
+        context.swapchain_images = NULL;
+        vkDestroySwapchainKHR(context.logical_device, context.swapchain, context.allocator);
+        context.swapchain = VK_NULL_HANDLE;
     }
-    memory_free(
-        context.swapchain_images, sizeof(VkImage) * context.swapchain_image_count, MEMORY_TAG_VULKAN);
     context.swapchain_image_count = 0;
-    vkDestroySwapchainKHR(context.logical_device, context.swapchain, context.allocator);
     
+    destroy_compute_pipelines();
+    destroy_geometry();
+    vulkan_draw_destroy();
+    vulkan_compute_destroy();
+    vulkan_buffer_system_destroy();
+    // The device is idle by now, whatever is still waiting can go
+    vulkan_deferred_destroy();
+    vulkan_timeline_destroy();
+
     free_swapchain_support(&context.swapchain_support);
+    vulkan_allocator_destroy();
     vkDestroyDevice(context.logical_device, context.allocator);
 
 #ifdef DEBUG_MODE
@@ -986,10 +1996,29 @@ void vulkan_destroy()
     callback(context.instance, context.debug_messenger, context.allocator);
 #endif
 
-    vkDestroySurfaceKHR(context.instance, context.surface, context.allocator);
+    if (!context.headless) {
+        vkDestroySurfaceKHR(context.instance, context.surface, context.allocator);
+    }
     vkDestroyInstance(context.instance, context.allocator);
 
     array_destroy(required_extension_names);
+
+    LOG_INFO("Frame arena high-water mark: %zu / %zu bytes\n",
+        context.frame_arena.high_water_mark, context.frame_arena.capacity);
+    memory_arena_destroy(&context.frame_arena);
+    LOG_INFO("Scratch stack high-water mark: %zu / %zu bytes\n",
+        context.scratch_stack.high_water_mark, context.scratch_stack.capacity);
+    memory_stack_destroy(&context.scratch_stack);
+}
+
+void *vulkan_frame_alloc(size_t size)
+{
+    void *block = memory_arena_alloc(&context.frame_arena, size, MEMORY_DEFAULT_ALIGNMENT);
+    if (!block) {
+        LOG_FATAL("Frame arena is out of memory, raise VULKAN_FRAME_ARENA_SIZE\n");
+    }
+
+    return block;
 }
 
 void vulkan_wait_idle()
@@ -997,48 +2026,299 @@ void vulkan_wait_idle()
     vkDeviceWaitIdle(context.logical_device);
 }
 
-void vulkan_draw_frame()
+// Semaphores of a frame's graphics submission. It waits on the swapchain image,
+// uploads and the frame's async compute work, and signals the graphics timeline
+// (plus the present semaphore).
+typedef struct {
+    VkSemaphore          wait_semaphores[3];
+    VkPipelineStageFlags wait_stages[3];
+    uint64_t             wait_values[3]; // Binary semaphores ignore theirs
+    u32                  wait_count;
+
+    VkSemaphore signal_semaphores[2];
+    uint64_t    signal_values[2];
+    u32         signal_count;
+} Submit_Semaphores;
+
+static void add_submit_wait(
+    Submit_Semaphores *semaphores, VkSemaphore semaphore, VkPipelineStageFlags stages, uint64_t value)
+{
+    assert(semaphores->wait_count < 3);
+    semaphores->wait_semaphores[semaphores->wait_count] = semaphore;
+    semaphores->wait_stages[semaphores->wait_count] = stages;
+    semaphores->wait_values[semaphores->wait_count] = value;
+    ++semaphores->wait_count;
+}
+
+static void add_submit_signal(Submit_Semaphores *semaphores, VkSemaphore semaphore, uint64_t value)
+{
+    assert(semaphores->signal_count < 2);
+    semaphores->signal_semaphores[semaphores->signal_count] = semaphore;
+    semaphores->signal_values[semaphores->signal_count] = value;
+    ++semaphores->signal_count;
+}
+
+static void add_frame_waits(Submit_Semaphores *semaphores, u64 upload_wait_value, u64 compute_wait_value)
+{
+    if (upload_wait_value > 0) {
+        add_submit_wait(
+            semaphores,
+            vulkan_timeline_get_semaphore(VULKAN_QUEUE_TRANSFER),
+            VULKAN_UPLOAD_WAIT_STAGES,
+            upload_wait_value);
+    }
+    if (compute_wait_value > 0) {
+        add_submit_wait(
+            semaphores,
+            vulkan_timeline_get_semaphore(VULKAN_QUEUE_COMPUTE),
+            VULKAN_COMPUTE_WAIT_STAGES,
+            compute_wait_value);
+    }
+}
+
+static void set_submit_semaphores(
+    VkSubmitInfo *submit_info, VkTimelineSemaphoreSubmitInfo *timeline_info, const Submit_Semaphores *semaphores)
+{
+    memory_zero(timeline_info, sizeof(VkTimelineSemaphoreSubmitInfo));
+    timeline_info->sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info->waitSemaphoreValueCount = semaphores->wait_count;
+    timeline_info->pWaitSemaphoreValues = semaphores->wait_values;
+    timeline_info->signalSemaphoreValueCount = semaphores->signal_count;
+    timeline_info->pSignalSemaphoreValues = semaphores->signal_values;
+
+    submit_info->pNext = timeline_info;
+    submit_info->waitSemaphoreCount = semaphores->wait_count;
+    submit_info->pWaitSemaphores = semaphores->wait_semaphores;
+    submit_info->pWaitDstStageMask = semaphores->wait_stages;
+    submit_info->signalSemaphoreCount = semaphores->signal_count;
+    submit_info->pSignalSemaphores = semaphores->signal_semaphores;
+}
+
+static void draw_offscreen_frame()
+{
+    u32 frame = context.current_frame;
+    VkCommandBuffer command_buffer = context.frame_commands[frame].primary_buffer;
+
+    vulkan_timeline_wait(VULKAN_QUEUE_GRAPHICS, context.frame_values[frame]);
+
+    vulkan_deferred_collect();
+
+    // Every frame slot owns its offscreen image, nothing to acquire
+    u32 image_index = frame;
+
+    // Goes out first, so it can run while the graphics queue is still busy with the
+    // previous frame
+    u64 compute_wait_value = record_compute(frame);
+
+    reset_command_pools(frame);
+    u64 upload_wait_value = record_command_buffer(frame, image_index);
+
+    context.frame_values[frame] = vulkan_timeline_next_value(VULKAN_QUEUE_GRAPHICS);
+
+    Submit_Semaphores semaphores = {0};
+    add_frame_waits(&semaphores, upload_wait_value, compute_wait_value);
+    add_submit_signal(&semaphores, vulkan_timeline_get_semaphore(VULKAN_QUEUE_GRAPHICS), context.frame_values[frame]);
+
+    VkTimelineSemaphoreSubmitInfo timeline_info;
+    VkSubmitInfo submit_info = {0};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    set_submit_semaphores(&submit_info, &timeline_info, &semaphores);
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    VULKAN_CHECK(vkQueueSubmit(context.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+    context.last_submitted_frame = frame;
+    context.frame_submitted = true;
+    ++context.submitted_frame_count;
+
+    context.current_frame = (frame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+bool vulkan_read_frame(void *pixels, size_t size)
 {
-    vkWaitForFences(context.logical_device, 1, &context.in_flight_fence, VK_TRUE, UINT64_MAX);
-    vkResetFences(context.logical_device, 1, &context.in_flight_fence);
+    if (!context.headless) {
+        LOG_WARNING("Frame readback is only available in headless mode\n");
+        return false;
+    }
+
+    if (!context.frame_submitted) {
+        LOG_WARNING("No frame has been rendered yet\n");
+        return false;
+    }
+
+    size_t frame_size = (size_t)context.swapchain_extent.width * context.swapchain_extent.height * 4;
+    if (size < frame_size) {
+        LOG_ERROR("Readback destination is too small. Size: %zu, required: %zu\n", size, frame_size);
+        return false;
+    }
+
+    u32 frame = context.last_submitted_frame;
+    vulkan_timeline_wait(VULKAN_QUEUE_GRAPHICS, context.frame_values[frame]);
+    memory_copy(pixels, context.readback_allocations[frame].mapped, frame_size);
+
+    return true;
+}
+
+void vulkan_set_present_policy(Vulkan_Present_Policy policy)
+{
+    if (policy >= MAX_VULKAN_PRESENT_POLICIES) {
+        LOG_ERROR("Invalid present policy: %u\n", policy);
+        return;
+    }
+    if (policy == context.present_policy) return;
+
+    context.present_policy = policy;
+    // Before init there's nothing to rebuild, create_swapchain picks it up
+    if (context.swapchain != VK_NULL_HANDLE) context.swapchain_dirty = true;
+}
+
+Vulkan_Present_Policy vulkan_get_present_policy()
+{
+    return context.present_policy;
+}
+
+void vulkan_set_swapchain_image_count(u32 count)
+{
+    if (count == context.requested_image_count) return;
+
+    context.requested_image_count = count;
+    if (context.swapchain != VK_NULL_HANDLE) context.swapchain_dirty = true;
+}
+
+void vulkan_set_dynamic_rendering(bool enabled)
+{
+    if (context.logical_device != VK_NULL_HANDLE) {
+        LOG_WARNING("Dynamic rendering can only be changed before vulkan_init\n");
+        return;
+    }
+    context.dynamic_rendering_disabled = !enabled;
+}
+
+void vulkan_resize(u32 width, u32 height)
+{
+    // Windows report their size on creation too, no need to rebuild for that
+    if (width == context.framebuffer_width && height == context.framebuffer_height) return;
+
+    context.framebuffer_width = width;
+    context.framebuffer_height = height;
+    context.swapchain_dirty = true;
+}
+
+static VkResult acquire_next_image(u32 frame, u32 *image_index)
+{
+    return vkAcquireNextImageKHR(
+        context.logical_device,
+        context.swapchain,
+        UINT64_MAX,
+        context.image_available_semaphores[frame],
+        VK_NULL_HANDLE,
+        image_index);
+}
+
+static bool draw_frame()
+{
+    memory_arena_reset(&context.frame_arena);
+
+    // Uploads made since the last frame start copying while this one is recorded
+    vulkan_buffer_flush_uploads();
+
+    if (context.headless) {
+        draw_offscreen_frame();
+        return true;
+    }
+
+    // Nothing to render into while minimized, try again next frame
+    if (context.swapchain_dirty && !recreate_swapchain()) return false;
+
+    u32 frame = context.current_frame;
+    VkCommandBuffer command_buffer = context.frame_commands[frame].primary_buffer;
+
+    // Only block when the GPU is still busy with the frame that used this slot
+    // MAX_FRAMES_IN_FLIGHT frames ago, so recording overlaps with GPU execution.
+    vulkan_timeline_wait(VULKAN_QUEUE_GRAPHICS, context.frame_values[frame]);
+
+    vulkan_deferred_collect();
+
+    // Goes out first, so it can run while the graphics queue is still busy with the
+    // previous frame and while acquire blocks. If the frame gets dropped below, the
+    // retry records it again, nothing ever has to wait for this submission.
+    u64 compute_wait_value = record_compute(frame);
 
     u32 image_index;
-    VULKAN_CHECK(
-        vkAcquireNextImageKHR(
-            context.logical_device,
-            context.swapchain,
-            UINT64_MAX,
-            context.image_available_semaphore,
-            VK_NULL_HANDLE,
-            &image_index));
+    VkResult result = acquire_next_image(frame, &image_index);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        // Nothing got acquired and the semaphore wasn't touched, so this frame can
+        // still go out on a new swapchain
+        if (!recreate_swapchain()) return false;
+        result = acquire_next_image(frame, &image_index);
+    }
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        context.swapchain_dirty = true;
+        return false;
+    } else if (result == VK_SUBOPTIMAL_KHR) {
+        // The image is still presentable and the semaphore will be signaled, finish
+        // the frame and recreate before the next one
+        context.swapchain_dirty = true;
+    } else if (result != VK_SUCCESS) {
+        LOG_FATAL("Failed to acquire a swapchain image: %d\n", result);
+    }
 
-    VULKAN_CHECK(vkResetCommandBuffer(context.command_buffer, 0));
-    record_command_buffer(context.command_buffer, image_index);
+    // The swapchain can hand out images out of order, so another frame slot might
+    // still be rendering into this image.
+    vulkan_timeline_wait(VULKAN_QUEUE_GRAPHICS, context.images_in_flight[image_index]);
 
-    VkSemaphore wait_semaphores[] = {context.image_available_semaphore};
-    VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    VkSemaphore signal_semaphores[] = {context.render_finished_semaphore};
+    reset_command_pools(frame);
+    u64 upload_wait_value = record_command_buffer(frame, image_index);
 
+    context.frame_values[frame] = vulkan_timeline_next_value(VULKAN_QUEUE_GRAPHICS);
+    context.images_in_flight[image_index] = context.frame_values[frame];
+
+    Submit_Semaphores semaphores = {0};
+    add_submit_wait(
+        &semaphores, context.image_available_semaphores[frame], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
+    add_frame_waits(&semaphores, upload_wait_value, compute_wait_value);
+    add_submit_signal(&semaphores, vulkan_timeline_get_semaphore(VULKAN_QUEUE_GRAPHICS), context.frame_values[frame]);
+    add_submit_signal(&semaphores, context.render_finished_semaphores[image_index], 0);
+
+    VkTimelineSemaphoreSubmitInfo timeline_info;
     VkSubmitInfo submit_info = {0};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_semaphores;
-    submit_info.pWaitDstStageMask = wait_stages;
+    set_submit_semaphores(&submit_info, &timeline_info, &semaphores);
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &context.command_buffer;
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_semaphores;
-    VULKAN_CHECK(vkQueueSubmit(context.graphics_queue, 1, &submit_info, context.in_flight_fence));
+    submit_info.pCommandBuffers = &command_buffer;
+    VULKAN_CHECK(vkQueueSubmit(context.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+    ++context.submitted_frame_count;
 
     VkSwapchainKHR swap_chains[] = {context.swapchain};
 
     VkPresentInfoKHR present_info = {0};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = signal_semaphores;
+    present_info.pWaitSemaphores = &context.render_finished_semaphores[image_index];
     present_info.swapchainCount = 1;
     present_info.pSwapchains = swap_chains;
     present_info.pImageIndices = &image_index;
     present_info.pResults = NULL; // optional
-    VULKAN_CHECK(vkQueuePresentKHR(context.present_queue, &present_info));
+    result = vkQueuePresentKHR(context.present_queue, &present_info);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        context.swapchain_dirty = true;
+    } else if (result != VK_SUCCESS) {
+        LOG_FATAL("Failed to present a swapchain image: %d\n", result);
+    }
+
+    context.current_frame = (frame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+    return true;
+}
+
+bool vulkan_draw_frame()
+{
+    PROFILE_ZONE("vulkan_draw_frame");
+
+    bool drawn = draw_frame();
+    // Packets are for the frame right after them, a dropped frame drops them as well
+    vulkan_draw_clear();
+
+    return drawn;
 }
\ No newline at end of file
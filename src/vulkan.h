@@ -4,9 +4,34 @@
 #include "platform.h"
 
 void vulkan_init(Platform_Window *window, u32 width, u32 height);
+// Render without a window: no surface, no swapchain, frames go into offscreen images
+void vulkan_init_headless(u32 width, u32 height);
 void vulkan_destroy();
 
-void vulkan_draw_frame();
+// Returns false when there was nothing to draw into, e.g. the window is minimized
+bool vulkan_draw_frame();
+
+// Can be called before vulkan_init, later changes rebuild the swapchain before the next frame
+void vulkan_set_present_policy(Vulkan_Present_Policy policy);
+Vulkan_Present_Policy vulkan_get_present_policy();
+// Swapchain images to ask for, 0 = minImageCount + 1. Clamped to what the surface
+// supports and to VULKAN_RENDER_GRAPH_MAX_VARIANTS. More images smooth out frame time
+// spikes at the cost of latency.
+void vulkan_set_swapchain_image_count(u32 count);
+// On by default, used when the device supports it (Vulkan 1.3 or VK_KHR_dynamic_rendering).
+// Off renders through render passes and framebuffers. Only before vulkan_init.
+void vulkan_set_dynamic_rendering(bool enabled);
+
+// New window size in pixels, the swapchain is rebuilt before the next frame.
+// Zero width or height (minimized) pauses drawing until a real size comes in.
+void vulkan_resize(u32 width, u32 height);
+
+// Copy the last submitted frame (RGBA8, tightly packed) into pixels. Headless mode only.
+bool vulkan_read_frame(void *pixels, size_t size);
+
+// Scratch memory that stays valid until the next vulkan_draw_frame call. Never
+// returns NULL, running out is fatal.
+void *vulkan_frame_alloc(size_t size);
 
 void vulkan_wait_idle();
 
@@ -0,0 +1,552 @@
+#include "vulkan_allocator.h"
+
+#include <assert.h>
+
+#include "common.h"
+#include "log.h"
+#include "array.h"
+#include "memory.h"
+#include "vulkan.h"
+
+// Order 0 is VULKAN_ALLOCATOR_MIN_SIZE, the last order is the whole block
+#define MAX_ORDERS 19
+_Static_assert(
+    (VULKAN_ALLOCATOR_MIN_SIZE << (MAX_ORDERS - 1)) == VULKAN_ALLOCATOR_BLOCK_SIZE,
+    "MAX_ORDERS doesn't match the block and minimum allocation size");
+
+// Every node of the buddy tree gets one bit, set when the node is free
+#define NODE_COUNT   ((1ull << MAX_ORDERS) - 1)
+#define BITMAP_WORDS ((NODE_COUNT + 63) / 64)
+
+typedef struct {
+    VkDeviceMemory  memory;
+    void           *mapped;
+    u64            *free_bits;
+    u32             free_counts[MAX_ORDERS];
+    VkDeviceSize    used;
+    u32             pool_index;
+} Memory_Block;
+
+// Pools are indexed by (memory type * 2 + linear)
+#define MAX_POOLS (VK_MAX_MEMORY_TYPES * 2)
+
+static struct {
+    Vulkan_Context                   *context;
+    VkPhysicalDeviceMemoryProperties  memory_properties;
+    u32                               max_allocation_count;
+    u32                               allocation_count; // Live VkDeviceMemory objects
+
+    Memory_Block **pools[MAX_POOLS];
+    Memory_Pool    block_headers; // Memory_Block, created and destroyed in any order
+
+    u32          dedicated_count;
+    VkDeviceSize dedicated_size;
+
+    // Index of the first bit of each order inside a block's bitmap
+    u64 order_offsets[MAX_ORDERS];
+} allocator;
+
+static bool initialized = false;
+
+static const VkMemoryPropertyFlags required_flags[MAX_VULKAN_MEMORY_USAGES] = {
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+};
+
+static const VkMemoryPropertyFlags preferred_flags[MAX_VULKAN_MEMORY_USAGES] = {
+    0,
+    0,
+    VK_MEMORY_PROPERTY_HOST_CACHED_BIT, // Reading uncached memory is painfully slow
+};
+
+static inline bool test_bit(u64 *bits, u64 i) { return (bits[i >> 6] >> (i & 63)) & 1; }
+static inline void set_bit(u64 *bits, u64 i) { bits[i >> 6] |= 1ull << (i & 63); }
+static inline void clear_bit(u64 *bits, u64 i) { bits[i >> 6] &= ~(1ull << (i & 63)); }
+
+static inline u64 order_node_count(u32 order)
+{
+    return 1ull << (MAX_ORDERS - 1 - order);
+}
+
+static inline VkDeviceSize order_size(u32 order)
+{
+    return VULKAN_ALLOCATOR_MIN_SIZE << order;
+}
+
+static u32 order_for_size(VkDeviceSize size, VkDeviceSize alignment)
+{
+    // Buddy nodes are aligned to their own size, so the alignment is free as long as
+    // the node is at least that big
+    if (size < alignment) size = alignment;
+
+    u32 order = 0;
+    while (order_size(order) < size) ++order;
+    return order;
+}
+
+static u32 find_memory_type(u32 type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred)
+{
+    VkMemoryPropertyFlags wanted[2] = {required | preferred, required};
+    for (u32 pass = 0; pass < 2; ++pass) {
+        for (u32 i = 0; i < allocator.memory_properties.memoryTypeCount; ++i) {
+            VkMemoryPropertyFlags flags = allocator.memory_properties.memoryTypes[i].propertyFlags;
+            if ((type_bits & (1 << i)) && (flags & wanted[pass]) == wanted[pass]) {
+                return i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static bool is_host_visible(u32 memory_type_index)
+{
+    return allocator.memory_properties.memoryTypes[memory_type_index].propertyFlags
+        & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+static bool allocate_device_memory(
+    VkDeviceSize size,
+    u32 memory_type_index,
+    const VkMemoryDedicatedAllocateInfo *dedicated_info,
+    VkDeviceMemory *memory,
+    void **mapped)
+{
+    if (allocator.allocation_count >= allocator.max_allocation_count) {
+        LOG_ERROR("Reached maxMemoryAllocationCount (%u)\n", allocator.max_allocation_count);
+        return false;
+    }
+
+    VkMemoryAllocateInfo alloc_info = {0};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.pNext = dedicated_info;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = memory_type_index;
+
+    VkResult result = vkAllocateMemory(
+        allocator.context->logical_device,
+        &alloc_info,
+        allocator.context->allocator,
+        memory);
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to allocate %llu bytes of device memory (type %u)\n",
+            (unsigned long long)size, memory_type_index);
+        return false;
+    }
+    ++allocator.allocation_count;
+
+    // Host visible memory stays mapped for its whole lifetime
+    *mapped = NULL;
+    if (is_host_visible(memory_type_index)) {
+        VULKAN_CHECK(vkMapMemory(allocator.context->logical_device, *memory, 0, VK_WHOLE_SIZE, 0, mapped));
+    }
+
+    return true;
+}
+
+static void free_device_memory(VkDeviceMemory memory, void *mapped)
+{
+    if (mapped) {
+        vkUnmapMemory(allocator.context->logical_device, memory);
+    }
+    vkFreeMemory(allocator.context->logical_device, memory, allocator.context->allocator);
+    --allocator.allocation_count;
+}
+
+static Memory_Block *create_block(u32 pool_index)
+{
+    u32 memory_type_index = pool_index / 2;
+
+    Memory_Block *block = memory_pool_alloc(&allocator.block_headers);
+    if (block == NULL) {
+        LOG_ERROR("Reached VULKAN_ALLOCATOR_MAX_BLOCKS (%u)\n", VULKAN_ALLOCATOR_MAX_BLOCKS);
+        return NULL;
+    }
+    memory_zero(block, sizeof(Memory_Block));
+
+    if (!allocate_device_memory(VULKAN_ALLOCATOR_BLOCK_SIZE, memory_type_index, NULL, &block->memory, &block->mapped)) {
+        memory_pool_free(&allocator.block_headers, block);
+        return NULL;
+    }
+
+    block->pool_index = pool_index;
+    block->free_bits = memory_alloc(BITMAP_WORDS * sizeof(u64), MEMORY_TAG_VULKAN);
+    memory_zero(block->free_bits, BITMAP_WORDS * sizeof(u64));
+
+    // Only the root is free in the beginning
+    set_bit(block->free_bits, allocator.order_offsets[MAX_ORDERS - 1]);
+    block->free_counts[MAX_ORDERS - 1] = 1;
+
+    return block;
+}
+
+static void destroy_block(Memory_Block *block)
+{
+    free_device_memory(block->memory, block->mapped);
+    memory_free(block->free_bits, BITMAP_WORDS * sizeof(u64), MEMORY_TAG_VULKAN);
+    memory_pool_free(&allocator.block_headers, block);
+}
+
+static i64 find_free_node(Memory_Block *block, u32 order)
+{
+    u64 first = allocator.order_offsets[order];
+    u64 last = first + order_node_count(order); // exclusive
+
+    for (u64 word = first >> 6; word <= (last - 1) >> 6; ++word) {
+        u64 bits = block->free_bits[word];
+
+        // Mask out the bits that belong to the neighbouring orders
+        u64 word_start = word << 6;
+        if (word_start < first) bits &= ~0ull << (first - word_start);
+        if (word_start + 64 > last) bits &= ~0ull >> (word_start + 64 - last);
+
+        if (bits) return (i64)(word_start + __builtin_ctzll(bits) - first);
+    }
+
+    return -1;
+}
+
+static bool block_alloc(Memory_Block *block, u32 order, VkDeviceSize *offset)
+{
+    u32 k = order;
+    while (k < MAX_ORDERS && block->free_counts[k] == 0) ++k;
+    if (k == MAX_ORDERS) return false;
+
+    i64 node = find_free_node(block, k);
+    assert(node >= 0);
+    clear_bit(block->free_bits, allocator.order_offsets[k] + node);
+    --block->free_counts[k];
+
+    // Split it down, the right half of every split stays free
+    while (k > order) {
+        --k;
+        node *= 2;
+        set_bit(block->free_bits, allocator.order_offsets[k] + node + 1);
+        ++block->free_counts[k];
+    }
+
+    *offset = node * order_size(order);
+    block->used += order_size(order);
+    return true;
+}
+
+static void block_free(Memory_Block *block, VkDeviceSize offset, u32 order)
+{
+    u64 node = offset / order_size(order);
+    block->used -= order_size(order);
+
+    // Merge with the buddy as long as it's free as well
+    while (order < MAX_ORDERS - 1) {
+        u64 buddy = node ^ 1;
+        if (!test_bit(block->free_bits, allocator.order_offsets[order] + buddy)) break;
+
+        clear_bit(block->free_bits, allocator.order_offsets[order] + buddy);
+        --block->free_counts[order];
+        node >>= 1;
+        ++order;
+    }
+
+    set_bit(block->free_bits, allocator.order_offsets[order] + node);
+    ++block->free_counts[order];
+}
+
+void vulkan_allocator_init(Vulkan_Context *context)
+{
+    if (initialized) {
+        LOG_WARNING("Vulkan allocator is already initialized\n");
+        return;
+    }
+
+    memory_zero(&allocator, sizeof(allocator));
+    allocator.context = context;
+
+    vkGetPhysicalDeviceMemoryProperties(context->physical_device, &allocator.memory_properties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+    allocator.max_allocation_count = properties.limits.maxMemoryAllocationCount;
+
+    memory_pool_create(
+        &allocator.block_headers, sizeof(Memory_Block), VULKAN_ALLOCATOR_MAX_BLOCKS, MEMORY_TAG_VULKAN);
+
+    u64 offset = 0;
+    for (u32 order = 0; order < MAX_ORDERS; ++order) {
+        allocator.order_offsets[order] = offset;
+        offset += order_node_count(order);
+    }
+
+    initialized = true;
+}
+
+void vulkan_allocator_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Vulkan allocator is not initialized yet\n");
+        return;
+    }
+
+    for (u32 i = 0; i < MAX_POOLS; ++i) {
+        Memory_Block **blocks = allocator.pools[i];
+        if (blocks == NULL) continue;
+
+        for (size_t j = 0; j < array_length(blocks); ++j) {
+            if (blocks[j]->used > 0) {
+                LOG_WARNING("Leaked %llu bytes of device memory (type %u)\n",
+                    (unsigned long long)blocks[j]->used, i / 2);
+            }
+            destroy_block(blocks[j]);
+        }
+        array_destroy(blocks);
+        allocator.pools[i] = NULL;
+    }
+
+    if (allocator.dedicated_count > 0) {
+        LOG_WARNING("Leaked %u dedicated device memory allocations\n", allocator.dedicated_count);
+    }
+
+    memory_pool_destroy(&allocator.block_headers);
+
+    initialized = false;
+}
+
+// dedicated_info is only set for a single buffer or image, which then gets memory of
+// its own when the driver asks for that
+static bool allocate(
+    VkMemoryRequirements requirements,
+    Vulkan_Memory_Usage usage,
+    bool linear,
+    Memory_Tag tag,
+    const VkMemoryDedicatedRequirements *dedicated_requirements,
+    const VkMemoryDedicatedAllocateInfo *dedicated_info,
+    Vulkan_Allocation *allocation)
+{
+    memory_zero(allocation, sizeof(Vulkan_Allocation));
+
+    if (!initialized) {
+        LOG_WARNING("Vulkan allocator is not initialized yet\n");
+        return false;
+    }
+
+    u32 memory_type_index =
+        find_memory_type(requirements.memoryTypeBits, required_flags[usage], preferred_flags[usage]);
+    if (memory_type_index == (u32)-1) {
+        LOG_ERROR("Failed to find a suitable memory type\n");
+        return false;
+    }
+
+    allocation->memory_type_index = memory_type_index;
+    allocation->tag = tag;
+
+    bool driver_dedicated = dedicated_requirements != NULL &&
+        (dedicated_requirements->prefersDedicatedAllocation || dedicated_requirements->requiresDedicatedAllocation);
+    if (driver_dedicated || requirements.size > VULKAN_ALLOCATOR_DEDICATED_THRESHOLD) {
+        // Big resources (render targets, huge textures) would only fragment the blocks.
+        // Telling the driver which resource the memory is for lets it pick a better
+        // layout (compression, alignment), so that goes along whenever it's known.
+        if (!allocate_device_memory(
+                requirements.size, memory_type_index, dedicated_info, &allocation->memory, &allocation->mapped)) {
+            return false;
+        }
+        allocation->offset = 0;
+        allocation->size = requirements.size;
+        allocation->block = NULL;
+
+        ++allocator.dedicated_count;
+        allocator.dedicated_size += allocation->size;
+    } else {
+        u32 pool_index = memory_type_index * 2 + (linear ? 1 : 0);
+        if (allocator.pools[pool_index] == NULL) {
+            allocator.pools[pool_index] = array_create(Memory_Block *);
+        }
+
+        u32 order = order_for_size(requirements.size, requirements.alignment);
+        VkDeviceSize offset = 0;
+        Memory_Block *block = NULL;
+
+        Memory_Block **blocks = allocator.pools[pool_index];
+        for (size_t i = 0; i < array_length(blocks); ++i) {
+            if (block_alloc(blocks[i], order, &offset)) {
+                block = blocks[i];
+                break;
+            }
+        }
+
+        if (block == NULL) {
+            block = create_block(pool_index);
+            if (block == NULL) return false;
+
+            array_push(allocator.pools[pool_index], block);
+            bool allocated = block_alloc(block, order, &offset);
+            assert(allocated);
+        }
+
+        allocation->memory = block->memory;
+        allocation->offset = offset;
+        allocation->size = order_size(order);
+        allocation->mapped = block->mapped ? (u8 *)block->mapped + offset : NULL;
+        allocation->block = block;
+        allocation->order = order;
+    }
+
+    memory_track_alloc(allocation->size, tag);
+
+    return true;
+}
+
+bool vulkan_allocate_memory(
+    VkMemoryRequirements requirements,
+    Vulkan_Memory_Usage usage,
+    bool linear,
+    Memory_Tag tag,
+    Vulkan_Allocation *allocation)
+{
+    return allocate(requirements, usage, linear, tag, NULL, NULL, allocation);
+}
+
+void vulkan_free_memory(Vulkan_Allocation *allocation)
+{
+    if (!initialized || allocation->memory == VK_NULL_HANDLE) return;
+
+    memory_track_free(allocation->size, allocation->tag);
+
+    Memory_Block *block = (Memory_Block *)allocation->block;
+    if (block == NULL) {
+        free_device_memory(allocation->memory, allocation->mapped);
+
+        --allocator.dedicated_count;
+        allocator.dedicated_size -= allocation->size;
+    } else {
+        block_free(block, allocation->offset, allocation->order);
+
+        // Give empty blocks back to the driver, but keep the last one of the pool
+        // around so allocating and freeing a single resource doesn't thrash
+        Memory_Block **blocks = allocator.pools[block->pool_index];
+        size_t block_count = array_length(blocks);
+        if (block->used == 0 && block_count > 1) {
+            for (size_t i = 0; i < block_count; ++i) {
+                if (blocks[i] == block) {
+                    blocks[i] = blocks[block_count - 1];
+                    array_set_length(blocks, block_count - 1);
+                    break;
+                }
+            }
+            destroy_block(block);
+        }
+    }
+
+    memory_zero(allocation, sizeof(Vulkan_Allocation));
+}
+
+bool vulkan_allocate_buffer_memory(
+    VkBuffer buffer, Vulkan_Memory_Usage usage, Memory_Tag tag, Vulkan_Allocation *allocation)
+{
+    VkBufferMemoryRequirementsInfo2 requirements_info = {0};
+    requirements_info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    requirements_info.buffer = buffer;
+
+    VkMemoryDedicatedRequirements dedicated_requirements = {0};
+    dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+    VkMemoryRequirements2 requirements = {0};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicated_requirements;
+    vkGetBufferMemoryRequirements2(allocator.context->logical_device, &requirements_info, &requirements);
+
+    VkMemoryDedicatedAllocateInfo dedicated_info = {0};
+    dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicated_info.buffer = buffer;
+
+    if (!allocate(
+            requirements.memoryRequirements,
+            usage,
+            true,
+            tag,
+            &dedicated_requirements,
+            &dedicated_info,
+            allocation)) {
+        return false;
+    }
+
+    VULKAN_CHECK(
+        vkBindBufferMemory(
+            allocator.context->logical_device,
+            buffer,
+            allocation->memory,
+            allocation->offset));
+
+    return true;
+}
+
+bool vulkan_allocate_image_memory(
+    VkImage image, VkImageTiling tiling, Vulkan_Memory_Usage usage, Memory_Tag tag, Vulkan_Allocation *allocation)
+{
+    VkImageMemoryRequirementsInfo2 requirements_info = {0};
+    requirements_info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    requirements_info.image = image;
+
+    VkMemoryDedicatedRequirements dedicated_requirements = {0};
+    dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+    VkMemoryRequirements2 requirements = {0};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicated_requirements;
+    vkGetImageMemoryRequirements2(allocator.context->logical_device, &requirements_info, &requirements);
+
+    VkMemoryDedicatedAllocateInfo dedicated_info = {0};
+    dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicated_info.image = image;
+
+    bool linear = tiling == VK_IMAGE_TILING_LINEAR;
+    if (!allocate(
+            requirements.memoryRequirements,
+            usage,
+            linear,
+            tag,
+            &dedicated_requirements,
+            &dedicated_info,
+            allocation)) {
+        return false;
+    }
+
+    VULKAN_CHECK(
+        vkBindImageMemory(
+            allocator.context->logical_device,
+            image,
+            allocation->memory,
+            allocation->offset));
+
+    return true;
+}
+
+void vulkan_allocator_log_stats()
+{
+    LOG_INFO("Device memory: %u of %u allocations in use\n",
+        allocator.allocation_count, allocator.max_allocation_count);
+    LOG_INFO("  blocks        %zu in use, at most %zu of %u\n",
+        allocator.block_headers.used_count,
+        allocator.block_headers.high_water_mark,
+        VULKAN_ALLOCATOR_MAX_BLOCKS);
+
+    for (u32 i = 0; i < MAX_POOLS; ++i) {
+        Memory_Block **blocks = allocator.pools[i];
+        if (blocks == NULL || array_length(blocks) == 0) continue;
+
+        VkDeviceSize used = 0;
+        for (size_t j = 0; j < array_length(blocks); ++j) {
+            used += blocks[j]->used;
+        }
+        VkDeviceSize reserved = array_length(blocks) * VULKAN_ALLOCATOR_BLOCK_SIZE;
+
+        LOG_INFO("  type %2u %-7s %zu block(s), %.2f of %.2f MiB used\n",
+            i / 2,
+            (i % 2) ? "linear" : "optimal",
+            array_length(blocks),
+            used / (1024.0 * 1024.0),
+            reserved / (1024.0 * 1024.0));
+    }
+
+    LOG_INFO("  dedicated     %u allocation(s), %.2f MiB\n",
+        allocator.dedicated_count,
+        allocator.dedicated_size / (1024.0 * 1024.0));
+}
@@ -0,0 +1,38 @@
+#ifndef VULKAN_ALLOCATOR_H
+#define VULKAN_ALLOCATOR_H
+
+#include "vulkan_types.h"
+
+// Device memory is reserved in big blocks per memory type and handed out with a
+// buddy allocator, so we stay far away from maxMemoryAllocationCount. Anything
+// bigger than half a block gets its own VkDeviceMemory, and so do buffers and images
+// the driver prefers or requires dedicated memory for.
+#define VULKAN_ALLOCATOR_BLOCK_SIZE (64ull * 1024 * 1024) // 64 MiB
+#define VULKAN_ALLOCATOR_MIN_SIZE   256ull
+#define VULKAN_ALLOCATOR_DEDICATED_THRESHOLD (VULKAN_ALLOCATOR_BLOCK_SIZE / 2)
+// Blocks across all memory types, 64 GiB worth
+#define VULKAN_ALLOCATOR_MAX_BLOCKS 1024
+
+void vulkan_allocator_init(Vulkan_Context *context);
+void vulkan_allocator_destroy();
+
+// Linear (buffers, linear images) and optimal (tiled images) resources come from
+// different blocks, so bufferImageGranularity never has to be considered.
+// Without a resource to ask about, only the size decides about dedicated memory.
+bool vulkan_allocate_memory(
+    VkMemoryRequirements requirements,
+    Vulkan_Memory_Usage usage,
+    bool linear,
+    Memory_Tag tag,
+    Vulkan_Allocation *allocation);
+void vulkan_free_memory(Vulkan_Allocation *allocation);
+
+// Allocate and bind in one go
+bool vulkan_allocate_buffer_memory(
+    VkBuffer buffer, Vulkan_Memory_Usage usage, Memory_Tag tag, Vulkan_Allocation *allocation);
+bool vulkan_allocate_image_memory(
+    VkImage image, VkImageTiling tiling, Vulkan_Memory_Usage usage, Memory_Tag tag, Vulkan_Allocation *allocation);
+
+void vulkan_allocator_log_stats();
+
+#endif
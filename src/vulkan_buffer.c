@@ -0,0 +1,504 @@
+#include "vulkan_buffer.h"
+
+#include <assert.h>
+
+#include "common.h"
+#include "log.h"
+#include "memory.h"
+#include "array.h"
+#include "profile.h"
+#include "vulkan.h"
+#include "vulkan_allocator.h"
+#include "vulkan_deferred.h"
+#include "vulkan_timeline.h"
+
+// Staging allocations start at multiples of this, keeps the memcpy happy
+#define STAGING_ALIGNMENT 16ull
+
+typedef struct {
+    VkCommandBuffer command_buffer;
+    u64             staging_end; // Staging head after this batch, everything before it is free once it's done
+    u64             value;       // Transfer timeline value signaled on completion
+} Upload_Batch;
+
+// A range handed over from the transfer to the graphics queue family
+typedef struct {
+    VkBuffer     buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    u64          value;
+    bool         concurrent; // No ownership to hand over, just the semaphore wait
+} Upload_Range;
+
+static struct {
+    Vulkan_Context *context;
+    bool            ownership_transfer; // Transfer and graphics queues are in different families
+
+    VkBuffer          staging_buffer;
+    Vulkan_Allocation staging_allocation;
+    // Byte counts that only ever grow, the ring position is the count modulo its size
+    u64               staging_head;
+    u64               staging_tail;
+
+    VkCommandPool command_pool;
+    Upload_Batch  batches[VULKAN_UPLOAD_MAX_BATCHES];
+    u32           first_batch;   // Oldest submitted batch that hasn't been retired
+    u32           batch_count;   // Submitted and not retired
+    bool          recording;     // The batch after the submitted ones is being recorded
+
+    Upload_Range *recorded_ranges; // array, in the batch being recorded
+    Upload_Range *flushed_ranges;  // array, submitted but not acquired by the graphics queue yet
+
+    // Stats
+    u64 uploaded_bytes;
+    u32 submit_count;
+    u32 stall_count;
+} uploads;
+
+static bool initialized = false;
+
+void vulkan_buffer_system_init(Vulkan_Context *context)
+{
+    if (initialized) {
+        LOG_WARNING("Vulkan buffer system is already initialized\n");
+        return;
+    }
+
+    memory_zero(&uploads, sizeof(uploads));
+    uploads.context = context;
+    uploads.ownership_transfer =
+        context->supported_queue_families.transfer_queue_family_index !=
+            context->supported_queue_families.graphics_queue_family_index;
+
+    VkBufferCreateInfo buffer_create_info = {0};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = VULKAN_STAGING_RING_SIZE;
+    buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VULKAN_CHECK(
+        vkCreateBuffer(
+            context->logical_device,
+            &buffer_create_info,
+            context->allocator,
+            &uploads.staging_buffer));
+
+    // Stays mapped for good, host coherent so there is nothing to flush
+    if (!vulkan_allocate_buffer_memory(
+            uploads.staging_buffer,
+            VULKAN_MEMORY_USAGE_CPU_TO_GPU,
+            MEMORY_TAG_GPU_BUFFER,
+            &uploads.staging_allocation)) {
+        LOG_FATAL("Failed to allocate the staging ring\n");
+    }
+
+    VkCommandPoolCreateInfo pool_create_info = {0};
+    pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.flags =
+        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_create_info.queueFamilyIndex = context->supported_queue_families.transfer_queue_family_index;
+    VULKAN_CHECK(
+        vkCreateCommandPool(
+            context->logical_device,
+            &pool_create_info,
+            context->allocator,
+            &uploads.command_pool));
+
+    VkCommandBufferAllocateInfo alloc_info = {0};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = uploads.command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    for (u32 i = 0; i < VULKAN_UPLOAD_MAX_BATCHES; ++i) {
+        VULKAN_CHECK(
+            vkAllocateCommandBuffers(
+                context->logical_device,
+                &alloc_info,
+                &uploads.batches[i].command_buffer));
+    }
+
+    uploads.recorded_ranges = array_create(Upload_Range);
+    uploads.flushed_ranges = array_create(Upload_Range);
+
+    initialized = true;
+}
+
+void vulkan_buffer_system_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Vulkan buffer system is not initialized yet\n");
+        return;
+    }
+
+    Vulkan_Context *context = uploads.context;
+
+    LOG_INFO("Uploads: %.2f MiB in %u submissions, %u stalls on a full staging ring\n",
+        uploads.uploaded_bytes / (1024.0 * 1024.0), uploads.submit_count, uploads.stall_count);
+
+    array_destroy(uploads.recorded_ranges);
+    array_destroy(uploads.flushed_ranges);
+
+    // Frees the command buffers too
+    vkDestroyCommandPool(context->logical_device, uploads.command_pool, context->allocator);
+
+    vkDestroyBuffer(context->logical_device, uploads.staging_buffer, context->allocator);
+    vulkan_free_memory(&uploads.staging_allocation);
+
+    memory_zero(&uploads, sizeof(uploads));
+    initialized = false;
+}
+
+bool vulkan_buffer_create(Vulkan_Buffer *buffer, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+    Vulkan_Context *context = uploads.context;
+
+    Vulkan_Queue_Family_Indices *families = &context->supported_queue_families;
+
+    // Storage buffers go back and forth between the compute and graphics queues
+    // every frame, ownership transfers for all of those aren't worth it
+    u32 family_indices[3];
+    u32 family_count = 0;
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+        u32 candidates[] = {
+            families->graphics_queue_family_index,
+            families->compute_queue_family_index,
+            families->transfer_queue_family_index,
+        };
+        for (u32 i = 0; i < 3; ++i) {
+            bool found = false;
+            for (u32 j = 0; j < family_count; ++j) {
+                if (family_indices[j] == candidates[i]) found = true;
+            }
+            if (!found) family_indices[family_count++] = candidates[i];
+        }
+    }
+
+    buffer->size = size;
+    buffer->concurrent = family_count > 1;
+
+    // Otherwise exclusive to one family at a time, uploads move it over explicitly
+    VkBufferCreateInfo create_info = {0};
+    create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    create_info.size = size;
+    create_info.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (buffer->concurrent) {
+        create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        create_info.queueFamilyIndexCount = family_count;
+        create_info.pQueueFamilyIndices = family_indices;
+    } else {
+        create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    VULKAN_CHECK(vkCreateBuffer(context->logical_device, &create_info, context->allocator, &buffer->buffer));
+
+    if (!vulkan_allocate_buffer_memory(
+            buffer->buffer, VULKAN_MEMORY_USAGE_GPU_ONLY, MEMORY_TAG_GPU_BUFFER, &buffer->allocation)) {
+        LOG_ERROR("Failed to allocate %llu bytes of buffer memory\n", (unsigned long long)size);
+        vkDestroyBuffer(context->logical_device, buffer->buffer, context->allocator);
+        buffer->buffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    return true;
+}
+
+void vulkan_buffer_destroy(Vulkan_Buffer *buffer)
+{
+    if (buffer->buffer == VK_NULL_HANDLE) return;
+
+    // Copies into it that are still being recorded go out now, so the deferred
+    // destruction below waits for them too
+    for (u32 i = 0; i < array_length(uploads.recorded_ranges); ++i) {
+        if (uploads.recorded_ranges[i].buffer == buffer->buffer) {
+            vulkan_buffer_flush_uploads();
+            break;
+        }
+    }
+
+    // Nothing is going to read it anymore, so its ranges are never acquired
+    u32 kept_count = 0;
+    for (u32 i = 0; i < array_length(uploads.flushed_ranges); ++i) {
+        if (uploads.flushed_ranges[i].buffer == buffer->buffer) continue;
+        uploads.flushed_ranges[kept_count++] = uploads.flushed_ranges[i];
+    }
+    array_set_length(uploads.flushed_ranges, kept_count);
+
+    vulkan_defer_buffer(buffer->buffer);
+    vulkan_defer_free_memory(&buffer->allocation);
+    memory_zero(buffer, sizeof(Vulkan_Buffer));
+}
+
+// Frees the staging space of every batch the transfer queue is done with
+static void retire_batches()
+{
+    while (uploads.batch_count > 0) {
+        Upload_Batch *batch = &uploads.batches[uploads.first_batch];
+        if (!vulkan_timeline_is_complete(VULKAN_QUEUE_TRANSFER, batch->value)) break;
+
+        uploads.staging_tail = batch->staging_end;
+        uploads.first_batch = (uploads.first_batch + 1) % VULKAN_UPLOAD_MAX_BATCHES;
+        --uploads.batch_count;
+    }
+}
+
+// Blocks until the oldest submitted batch is done
+static void wait_for_oldest_batch()
+{
+    PROFILE_ZONE("upload stall");
+
+    ++uploads.stall_count;
+
+    vulkan_timeline_wait(VULKAN_QUEUE_TRANSFER, uploads.batches[uploads.first_batch].value);
+
+    retire_batches();
+}
+
+static VkCommandBuffer get_recording_command_buffer()
+{
+    if (uploads.recording) {
+        u32 index = (uploads.first_batch + uploads.batch_count) % VULKAN_UPLOAD_MAX_BATCHES;
+        return uploads.batches[index].command_buffer;
+    }
+
+    // Every batch is in flight, the oldest one has to finish to free one up
+    retire_batches();
+    if (uploads.batch_count == VULKAN_UPLOAD_MAX_BATCHES) {
+        wait_for_oldest_batch();
+    }
+
+    u32 index = (uploads.first_batch + uploads.batch_count) % VULKAN_UPLOAD_MAX_BATCHES;
+    VkCommandBuffer command_buffer = uploads.batches[index].command_buffer;
+
+    VULKAN_CHECK(vkResetCommandBuffer(command_buffer, 0));
+
+    VkCommandBufferBeginInfo begin_info = {0};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VULKAN_CHECK(vkBeginCommandBuffer(command_buffer, &begin_info));
+
+    uploads.recording = true;
+
+    return command_buffer;
+}
+
+// Reserves size bytes (at most the ring size) of staging memory, waiting for old
+// uploads to finish if the ring is full. A range never wraps around the end.
+static VkDeviceSize staging_alloc(VkDeviceSize size)
+{
+    for (;;) {
+        // Nothing in use: the ring can start over anywhere. Otherwise the skipped bit
+        // at the end would count against an empty ring and a big range could never fit.
+        if (uploads.staging_tail == uploads.staging_head) {
+            uploads.staging_tail = 0;
+            uploads.staging_head = 0;
+        }
+
+        u64 head = (uploads.staging_head + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+        u64 position = head % VULKAN_STAGING_RING_SIZE;
+        if (position + size > VULKAN_STAGING_RING_SIZE) {
+            // Skip what's left at the end, that bit gets freed along with the rest
+            head += VULKAN_STAGING_RING_SIZE - position;
+            position = 0;
+        }
+
+        if (head + size - uploads.staging_tail <= VULKAN_STAGING_RING_SIZE) {
+            uploads.staging_head = head + size;
+            return position;
+        }
+
+        retire_batches();
+        if (head + size - uploads.staging_tail <= VULKAN_STAGING_RING_SIZE) continue;
+
+        // The space is held by uploads that weren't even submitted yet
+        if (uploads.batch_count == 0) {
+            vulkan_buffer_flush_uploads();
+        }
+        wait_for_oldest_batch();
+    }
+}
+
+void vulkan_buffer_upload(Vulkan_Buffer *buffer, VkDeviceSize offset, const void *data, VkDeviceSize size)
+{
+    PROFILE_FUNCTION();
+
+    if (offset + size > buffer->size) {
+        LOG_ERROR("Upload out of bounds. Buffer size: %llu, offset: %llu, size: %llu\n",
+            (unsigned long long)buffer->size, (unsigned long long)offset, (unsigned long long)size);
+        return;
+    }
+
+    // Nothing to copy, and a zero sized range would turn into an invalid barrier
+    if (size == 0) {
+        return;
+    }
+
+    // Bigger than the ring: goes through in pieces, every piece in the batch that
+    // was being recorded when it got its staging space
+    VkDeviceSize copied = 0;
+    while (copied < size) {
+        VkDeviceSize chunk_size = MIN(size - copied, VULKAN_STAGING_RING_SIZE);
+        VkDeviceSize staging_offset = staging_alloc(chunk_size);
+
+        memory_copy(
+            (u8 *)uploads.staging_allocation.mapped + staging_offset,
+            (const u8 *)data + copied,
+            chunk_size);
+
+        VkBufferCopy region = {0};
+        region.srcOffset = staging_offset;
+        region.dstOffset = offset + copied;
+        region.size = chunk_size;
+        vkCmdCopyBuffer(get_recording_command_buffer(), uploads.staging_buffer, buffer->buffer, 1, &region);
+
+        copied += chunk_size;
+    }
+
+    // Released as a whole with the batch of the last piece, the earlier pieces are
+    // ahead of it on the same queue
+    Upload_Range range = {0};
+    range.buffer = buffer->buffer;
+    range.offset = offset;
+    range.size = size;
+    range.concurrent = buffer->concurrent;
+    array_push(uploads.recorded_ranges, range);
+
+    uploads.uploaded_bytes += size;
+}
+
+// Transfer side of the queue family ownership transfer
+static void record_releases(VkCommandBuffer command_buffer)
+{
+    u32 count = array_length(uploads.recorded_ranges);
+    if (count == 0 || !uploads.ownership_transfer) return;
+
+    Vulkan_Queue_Family_Indices *families = &uploads.context->supported_queue_families;
+
+    VkBufferMemoryBarrier *barriers =
+        memory_alloc(sizeof(VkBufferMemoryBarrier) * count, MEMORY_TAG_VULKAN);
+    u32 barrier_count = 0;
+    for (u32 i = 0; i < count; ++i) {
+        if (uploads.recorded_ranges[i].concurrent) continue;
+
+        VkBufferMemoryBarrier *barrier = &barriers[barrier_count++];
+        memory_zero(barrier, sizeof(VkBufferMemoryBarrier));
+        barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier->srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier->dstAccessMask = 0; // Ignored on release
+        barrier->srcQueueFamilyIndex = families->transfer_queue_family_index;
+        barrier->dstQueueFamilyIndex = families->graphics_queue_family_index;
+        barrier->buffer = uploads.recorded_ranges[i].buffer;
+        barrier->offset = uploads.recorded_ranges[i].offset;
+        barrier->size = uploads.recorded_ranges[i].size;
+    }
+
+    if (barrier_count > 0) {
+        vkCmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, NULL,
+            barrier_count, barriers,
+            0, NULL);
+    }
+
+    memory_free(barriers, sizeof(VkBufferMemoryBarrier) * count, MEMORY_TAG_VULKAN);
+}
+
+void vulkan_buffer_flush_uploads()
+{
+    if (!uploads.recording) return;
+
+    PROFILE_FUNCTION();
+
+    Vulkan_Context *context = uploads.context;
+
+    u32 index = (uploads.first_batch + uploads.batch_count) % VULKAN_UPLOAD_MAX_BATCHES;
+    Upload_Batch *batch = &uploads.batches[index];
+
+    record_releases(batch->command_buffer);
+    VULKAN_CHECK(vkEndCommandBuffer(batch->command_buffer));
+
+    batch->value = vulkan_timeline_next_value(VULKAN_QUEUE_TRANSFER);
+    batch->staging_end = uploads.staging_head;
+
+    uint64_t signal_value = batch->value;
+    VkSemaphore signal_semaphore = vulkan_timeline_get_semaphore(VULKAN_QUEUE_TRANSFER);
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {0};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &signal_value;
+
+    VkSubmitInfo submit_info = {0};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch->command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &signal_semaphore;
+    VULKAN_CHECK(vkQueueSubmit(context->transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+    for (u32 i = 0; i < array_length(uploads.recorded_ranges); ++i) {
+        uploads.recorded_ranges[i].value = batch->value;
+    }
+    array_append(uploads.flushed_ranges, uploads.recorded_ranges);
+    array_clear(uploads.recorded_ranges);
+
+    ++uploads.batch_count;
+    ++uploads.submit_count;
+    uploads.recording = false;
+}
+
+u64 vulkan_buffer_record_acquires(VkCommandBuffer command_buffer)
+{
+    u32 count = array_length(uploads.flushed_ranges);
+    if (count == 0) return 0;
+
+    u64 wait_value = 0;
+    for (u32 i = 0; i < count; ++i) {
+        wait_value = MAX(wait_value, uploads.flushed_ranges[i].value);
+    }
+
+    // Same family: the semaphore wait alone makes the writes visible
+    if (uploads.ownership_transfer) {
+        Vulkan_Queue_Family_Indices *families = &uploads.context->supported_queue_families;
+
+        // Recorded into the frame's command buffer, so the frame arena can hold them
+        VkBufferMemoryBarrier *barriers = vulkan_frame_alloc(sizeof(VkBufferMemoryBarrier) * count);
+        u32 barrier_count = 0;
+        for (u32 i = 0; i < count; ++i) {
+            if (uploads.flushed_ranges[i].concurrent) continue;
+
+            VkBufferMemoryBarrier *barrier = &barriers[barrier_count++];
+            memory_zero(barrier, sizeof(VkBufferMemoryBarrier));
+            barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier->srcAccessMask = 0; // Ignored on acquire
+            barrier->dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+                | VK_ACCESS_INDEX_READ_BIT
+                | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+                | VK_ACCESS_UNIFORM_READ_BIT
+                | VK_ACCESS_SHADER_READ_BIT;
+            barrier->srcQueueFamilyIndex = families->transfer_queue_family_index;
+            barrier->dstQueueFamilyIndex = families->graphics_queue_family_index;
+            barrier->buffer = uploads.flushed_ranges[i].buffer;
+            barrier->offset = uploads.flushed_ranges[i].offset;
+            barrier->size = uploads.flushed_ranges[i].size;
+        }
+
+        // Chained to the semaphore wait, which happens at the same stages
+        if (barrier_count > 0) {
+            vkCmdPipelineBarrier(
+                command_buffer,
+                VULKAN_UPLOAD_WAIT_STAGES,
+                VULKAN_UPLOAD_WAIT_STAGES,
+                0,
+                0, NULL,
+                barrier_count, barriers,
+                0, NULL);
+        }
+    }
+
+    array_clear(uploads.flushed_ranges);
+
+    return wait_value;
+}
+
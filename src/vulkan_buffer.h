@@ -0,0 +1,53 @@
+#ifndef VULKAN_BUFFER_H
+#define VULKAN_BUFFER_H
+
+#include "vulkan_types.h"
+
+// Device local buffers and the uploads that fill them. Data is copied into a
+// persistently mapped staging ring and copied over on the transfer queue, whose
+// completion is tracked with the transfer timeline (vulkan_timeline.h). When the transfer queue has its
+// own family, the uploaded range is released there and acquired on the graphics
+// queue, see vulkan_buffer_record_acquires.
+//
+// Main thread only, same as the rest of the renderer.
+#ifndef VULKAN_STAGING_RING_SIZE
+#define VULKAN_STAGING_RING_SIZE (16ull * 1024 * 1024) // 16 MiB
+#endif
+
+// Transfer submissions that can be in flight at once
+#define VULKAN_UPLOAD_MAX_BATCHES 8
+
+void vulkan_buffer_system_init(Vulkan_Context *context);
+// The device has to be idle
+void vulkan_buffer_system_destroy();
+
+// Always usable as a transfer destination on top of usage. Storage buffers are shared
+// by the graphics, compute and transfer families (concurrent), everything else is
+// owned by one family at a time.
+bool vulkan_buffer_create(Vulkan_Buffer *buffer, VkDeviceSize size, VkBufferUsageFlags usage);
+// Safe while the GPU is still using it, the buffer and its memory go to the deferred
+// destruction queue (vulkan_deferred.h). Pending uploads into it are flushed first.
+void vulkan_buffer_destroy(Vulkan_Buffer *buffer);
+
+// Copies data into the staging ring right away and records the copy, which is
+// submitted with the next flush. Only blocks when the staging ring is full, until the
+// oldest upload has finished. The range must not be in use by the GPU.
+void vulkan_buffer_upload(Vulkan_Buffer *buffer, VkDeviceSize offset, const void *data, VkDeviceSize size);
+// Submits everything uploaded since the last flush to the transfer queue
+void vulkan_buffer_flush_uploads();
+
+// Graphics side of the flushed uploads: records the ownership acquire barriers (if
+// needed) into command_buffer and returns the transfer timeline value its submission
+// has to wait for at VULKAN_UPLOAD_WAIT_STAGES, 0 when there's nothing to wait for.
+u64 vulkan_buffer_record_acquires(VkCommandBuffer command_buffer);
+
+// Uploads are acquired once, so every stage that could read a buffer is covered
+// instead of tracking how each one is used
+#define VULKAN_UPLOAD_WAIT_STAGES                   \
+    (VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT            \
+        | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT        \
+        | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT       \
+        | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT     \
+        | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+
+#endif
@@ -0,0 +1,356 @@
+#include "vulkan_compute.h"
+
+#include <assert.h>
+
+#include "common.h"
+#include "log.h"
+#include "memory.h"
+#include "profile.h"
+#include "vulkan.h"
+#include "vulkan_deferred.h"
+#include "vulkan_timeline.h"
+
+typedef struct {
+    VkCommandPool    command_pool;
+    VkCommandBuffer  command_buffer;
+    VkDescriptorPool descriptor_pool; // Reset along with the command pool
+    u64              value;           // Compute timeline value of the last submission
+    u32              dispatch_count;  // Since begin_frame
+} Compute_Frame;
+
+static struct {
+    Vulkan_Context *context;
+    Compute_Frame   frames[MAX_FRAMES_IN_FLIGHT];
+    u32             current_frame;
+
+    // Stats
+    u64 dispatch_count;
+    u32 submit_count;
+} compute;
+
+static bool initialized = false;
+
+void vulkan_compute_init(Vulkan_Context *context)
+{
+    if (initialized) {
+        LOG_WARNING("Vulkan compute is already initialized\n");
+        return;
+    }
+
+    memory_zero(&compute, sizeof(compute));
+    compute.context = context;
+
+    VkCommandPoolCreateInfo pool_create_info = {0};
+    pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_create_info.queueFamilyIndex = context->supported_queue_families.compute_queue_family_index;
+
+    VkDescriptorPoolSize descriptor_pool_size = {0};
+    descriptor_pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_pool_size.descriptorCount = VULKAN_COMPUTE_MAX_DISPATCHES * VULKAN_COMPUTE_MAX_BUFFERS;
+
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {0};
+    descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptor_pool_create_info.maxSets = VULKAN_COMPUTE_MAX_DISPATCHES;
+    descriptor_pool_create_info.poolSizeCount = 1;
+    descriptor_pool_create_info.pPoolSizes = &descriptor_pool_size;
+
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        Compute_Frame *frame = &compute.frames[i];
+
+        VULKAN_CHECK(
+            vkCreateCommandPool(
+                context->logical_device,
+                &pool_create_info,
+                context->allocator,
+                &frame->command_pool));
+
+        VkCommandBufferAllocateInfo alloc_info = {0};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = frame->command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+        VULKAN_CHECK(vkAllocateCommandBuffers(context->logical_device, &alloc_info, &frame->command_buffer));
+
+        VULKAN_CHECK(
+            vkCreateDescriptorPool(
+                context->logical_device,
+                &descriptor_pool_create_info,
+                context->allocator,
+                &frame->descriptor_pool));
+    }
+
+    initialized = true;
+}
+
+void vulkan_compute_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Vulkan compute is not initialized yet\n");
+        return;
+    }
+
+    Vulkan_Context *context = compute.context;
+
+    LOG_INFO("Compute: %llu dispatches in %u submissions\n",
+        (unsigned long long)compute.dispatch_count, compute.submit_count);
+
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        Compute_Frame *frame = &compute.frames[i];
+        vkDestroyDescriptorPool(context->logical_device, frame->descriptor_pool, context->allocator);
+        // Frees the command buffer too
+        vkDestroyCommandPool(context->logical_device, frame->command_pool, context->allocator);
+    }
+
+    memory_zero(&compute, sizeof(compute));
+    initialized = false;
+}
+
+bool vulkan_compute_pipeline_create(
+    Vulkan_Compute_Pipeline *pipeline,
+    const void *code,
+    size_t code_size,
+    u32 buffer_count,
+    u32 push_constant_size)
+{
+    Vulkan_Context *context = compute.context;
+
+    if (buffer_count > VULKAN_COMPUTE_MAX_BUFFERS) {
+        LOG_ERROR("Too many buffers for a compute pipeline. Count: %u, max: %u\n",
+            buffer_count, VULKAN_COMPUTE_MAX_BUFFERS);
+        return false;
+    }
+
+    memory_zero(pipeline, sizeof(Vulkan_Compute_Pipeline));
+    pipeline->buffer_count = buffer_count;
+    pipeline->push_constant_size = push_constant_size;
+
+    VkDescriptorSetLayoutBinding bindings[VULKAN_COMPUTE_MAX_BUFFERS] = {0};
+    for (u32 i = 0; i < buffer_count; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_create_info = {0};
+    set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_create_info.bindingCount = buffer_count;
+    set_layout_create_info.pBindings = bindings;
+    VULKAN_CHECK(
+        vkCreateDescriptorSetLayout(
+            context->logical_device,
+            &set_layout_create_info,
+            context->allocator,
+            &pipeline->descriptor_set_layout));
+
+    VkPushConstantRange push_constant_range = {0};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = push_constant_size;
+
+    VkPipelineLayoutCreateInfo layout_create_info = {0};
+    layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_create_info.setLayoutCount = 1;
+    layout_create_info.pSetLayouts = &pipeline->descriptor_set_layout;
+    layout_create_info.pushConstantRangeCount = push_constant_size > 0 ? 1 : 0;
+    layout_create_info.pPushConstantRanges = &push_constant_range;
+    VULKAN_CHECK(
+        vkCreatePipelineLayout(
+            context->logical_device,
+            &layout_create_info,
+            context->allocator,
+            &pipeline->layout));
+
+    VkShaderModuleCreateInfo module_create_info = {0};
+    module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_create_info.codeSize = code_size;
+    module_create_info.pCode = (const u32 *)code;
+    VkShaderModule shader_module;
+    VULKAN_CHECK(
+        vkCreateShaderModule(
+            context->logical_device,
+            &module_create_info,
+            context->allocator,
+            &shader_module));
+
+    VkComputePipelineCreateInfo pipeline_create_info = {0};
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_create_info.stage.module = shader_module;
+    pipeline_create_info.stage.pName = "main";
+    pipeline_create_info.layout = pipeline->layout;
+    VkResult result =
+        vkCreateComputePipelines(
+            context->logical_device,
+            context->pipeline_cache,
+            1,
+            &pipeline_create_info,
+            context->allocator,
+            &pipeline->pipeline);
+
+    vkDestroyShaderModule(context->logical_device, shader_module, context->allocator);
+
+    if (result != VK_SUCCESS) {
+        LOG_ERROR("Failed to create a compute pipeline: %d\n", result);
+        pipeline->pipeline = VK_NULL_HANDLE;
+        vulkan_compute_pipeline_destroy(pipeline);
+        return false;
+    }
+
+    return true;
+}
+
+void vulkan_compute_pipeline_destroy(Vulkan_Compute_Pipeline *pipeline)
+{
+    vulkan_defer_pipeline(pipeline->pipeline);
+    vulkan_defer_pipeline_layout(pipeline->layout);
+    vulkan_defer_descriptor_set_layout(pipeline->descriptor_set_layout);
+    memory_zero(pipeline, sizeof(Vulkan_Compute_Pipeline));
+}
+
+void vulkan_compute_begin_frame(u32 frame_index)
+{
+    Vulkan_Context *context = compute.context;
+    Compute_Frame *frame = &compute.frames[frame_index];
+
+    compute.current_frame = frame_index;
+
+    // Long done in practice, the graphics work of the frame waited for it
+    vulkan_timeline_wait(VULKAN_QUEUE_COMPUTE, frame->value);
+
+    VULKAN_CHECK(vkResetCommandPool(context->logical_device, frame->command_pool, 0));
+    VULKAN_CHECK(vkResetDescriptorPool(context->logical_device, frame->descriptor_pool, 0));
+    frame->dispatch_count = 0;
+}
+
+void vulkan_compute_dispatch(
+    const Vulkan_Compute_Pipeline *pipeline,
+    const Vulkan_Buffer *const *buffers,
+    const void *push_constants,
+    u32 group_count_x,
+    u32 group_count_y,
+    u32 group_count_z)
+{
+    Vulkan_Context *context = compute.context;
+    Compute_Frame *frame = &compute.frames[compute.current_frame];
+    VkCommandBuffer command_buffer = frame->command_buffer;
+
+    if (frame->dispatch_count == VULKAN_COMPUTE_MAX_DISPATCHES) {
+        LOG_ERROR("Too many compute dispatches this frame, max: %u\n", VULKAN_COMPUTE_MAX_DISPATCHES);
+        return;
+    }
+
+    VkDescriptorSetAllocateInfo set_alloc_info = {0};
+    set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_alloc_info.descriptorPool = frame->descriptor_pool;
+    set_alloc_info.descriptorSetCount = 1;
+    set_alloc_info.pSetLayouts = &pipeline->descriptor_set_layout;
+    VkDescriptorSet descriptor_set;
+    VULKAN_CHECK(vkAllocateDescriptorSets(context->logical_device, &set_alloc_info, &descriptor_set));
+
+    VkDescriptorBufferInfo buffer_infos[VULKAN_COMPUTE_MAX_BUFFERS];
+    VkWriteDescriptorSet writes[VULKAN_COMPUTE_MAX_BUFFERS];
+    for (u32 i = 0; i < pipeline->buffer_count; ++i) {
+        buffer_infos[i].buffer = buffers[i]->buffer;
+        buffer_infos[i].offset = 0;
+        buffer_infos[i].range = VK_WHOLE_SIZE;
+
+        memory_zero(&writes[i], sizeof(VkWriteDescriptorSet));
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = descriptor_set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &buffer_infos[i];
+    }
+    vkUpdateDescriptorSets(context->logical_device, pipeline->buffer_count, writes, 0, NULL);
+
+    if (frame->dispatch_count == 0) {
+        VkCommandBufferBeginInfo begin_info = {0};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VULKAN_CHECK(vkBeginCommandBuffer(command_buffer, &begin_info));
+    } else {
+        // Nothing keeps track of what a dispatch reads, so every one waits for the
+        // writes before it. Independent dispatches lose a bit of overlap with each
+        // other, the overlap with the graphics queue stays.
+        VkMemoryBarrier barrier = {0};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1, &barrier,
+            0, NULL,
+            0, NULL);
+    }
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline);
+    vkCmdBindDescriptorSets(
+        command_buffer,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        pipeline->layout,
+        0,
+        1, &descriptor_set,
+        0, NULL);
+    if (pipeline->push_constant_size > 0 && push_constants) {
+        vkCmdPushConstants(
+            command_buffer,
+            pipeline->layout,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            0,
+            pipeline->push_constant_size,
+            push_constants);
+    }
+    vkCmdDispatch(command_buffer, group_count_x, group_count_y, group_count_z);
+
+    ++frame->dispatch_count;
+    ++compute.dispatch_count;
+}
+
+u64 vulkan_compute_submit()
+{
+    Compute_Frame *frame = &compute.frames[compute.current_frame];
+    if (frame->dispatch_count == 0) return 0;
+
+    PROFILE_FUNCTION();
+
+    VULKAN_CHECK(vkEndCommandBuffer(frame->command_buffer));
+
+    frame->value = vulkan_timeline_next_value(VULKAN_QUEUE_COMPUTE);
+
+    // Storage buffers are concurrent, so the uploads only have to be finished
+    uint64_t wait_values[] = {vulkan_timeline_get_submitted_value(VULKAN_QUEUE_TRANSFER)};
+    VkSemaphore wait_semaphores[] = {vulkan_timeline_get_semaphore(VULKAN_QUEUE_TRANSFER)};
+    VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
+    uint64_t signal_values[] = {frame->value};
+    VkSemaphore signal_semaphores[] = {vulkan_timeline_get_semaphore(VULKAN_QUEUE_COMPUTE)};
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {0};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = wait_values[0] > 0 ? 1 : 0;
+    timeline_info.pWaitSemaphoreValues = wait_values;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = signal_values;
+
+    VkSubmitInfo submit_info = {0};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = timeline_info.waitSemaphoreValueCount;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stages;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &frame->command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = signal_semaphores;
+    VULKAN_CHECK(vkQueueSubmit(compute.context->compute_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+    ++compute.submit_count;
+
+    return frame->value;
+}
\ No newline at end of file
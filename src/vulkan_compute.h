@@ -0,0 +1,61 @@
+#ifndef VULKAN_COMPUTE_H
+#define VULKAN_COMPUTE_H
+
+#include "vulkan_types.h"
+
+// Async compute: dispatches are recorded into the frame's compute command buffer and
+// submitted to the compute queue ahead of the frame's graphics work, so they run
+// alongside whatever graphics work of the previous frame is still going. The
+// graphics submission waits on the compute timeline value vulkan_compute_submit
+// returns.
+//
+// Dispatches only see storage buffers, which are shared by every queue family (see
+// vulkan_buffer_create), so nothing changes hands. A buffer the graphics side reads
+// has to be written by one frame in flight only, give every frame its own copy.
+//
+// Main thread only, same as the rest of the renderer.
+#define VULKAN_COMPUTE_MAX_DISPATCHES 256 // Per frame
+#define VULKAN_COMPUTE_MAX_BUFFERS 8      // Per pipeline
+
+// Where the graphics submission waits for the frame's compute work
+#define VULKAN_COMPUTE_WAIT_STAGES                  \
+    (VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT            \
+        | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT        \
+        | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT       \
+        | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+
+void vulkan_compute_init(Vulkan_Context *context);
+// The device has to be idle
+void vulkan_compute_destroy();
+
+// code is SPIR-V with a "main" entry point
+bool vulkan_compute_pipeline_create(
+    Vulkan_Compute_Pipeline *pipeline,
+    const void *code,
+    size_t code_size,
+    u32 buffer_count,
+    u32 push_constant_size);
+// Deferred (vulkan_deferred.h), so it can go while frames using it are in flight
+void vulkan_compute_pipeline_destroy(Vulkan_Compute_Pipeline *pipeline);
+
+// Waits for the frame slot's previous compute work, which is done by the time the
+// graphics work that waited on it is
+void vulkan_compute_begin_frame(u32 frame);
+
+// buffers has pipeline->buffer_count entries, push_constants pipeline->push_constant_size
+// bytes (or NULL). Runs after the dispatches recorded before it this frame, and sees
+// their writes.
+void vulkan_compute_dispatch(
+    const Vulkan_Compute_Pipeline *pipeline,
+    const Vulkan_Buffer *const *buffers,
+    const void *push_constants,
+    u32 group_count_x,
+    u32 group_count_y,
+    u32 group_count_z);
+
+// Submits the frame's dispatches. Returns the compute timeline value the frame's
+// graphics submission has to wait for at VULKAN_COMPUTE_WAIT_STAGES, 0 if nothing
+// was dispatched.
+u64 vulkan_compute_submit();
+
+#endif
\ No newline at end of file
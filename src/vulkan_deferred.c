@@ -0,0 +1,192 @@
+#include "vulkan_deferred.h"
+
+#include "common.h"
+#include "log.h"
+#include "memory.h"
+#include "array.h"
+#include "profile.h"
+#include "vulkan_allocator.h"
+#include "vulkan_timeline.h"
+
+typedef struct {
+    Vulkan_Deferred_Type type;
+    union {
+        VkBuffer              buffer;
+        VkImage               image;
+        VkImageView           image_view;
+        VkFramebuffer         framebuffer;
+        VkRenderPass          renderpass;
+        VkPipeline            pipeline;
+        VkPipelineLayout      pipeline_layout;
+        VkDescriptorSetLayout descriptor_set_layout;
+        VkSwapchainKHR        swapchain;
+        VkSemaphore           semaphore;
+        Vulkan_Allocation     allocation;
+    };
+    // Submitted value of every timeline at the time it was handed over
+    u64 values[MAX_VULKAN_QUEUES];
+} Deferred_Entry;
+
+static struct {
+    Vulkan_Context *context;
+    Deferred_Entry *entries; // array, oldest first, so the values never go down
+
+    // Stats
+    u64 released_count;
+    u32 max_pending_count;
+} deferred;
+
+static bool initialized = false;
+
+void vulkan_deferred_init(Vulkan_Context *context)
+{
+    if (initialized) {
+        LOG_WARNING("Vulkan deferred destruction is already initialized\n");
+        return;
+    }
+
+    memory_zero(&deferred, sizeof(deferred));
+    deferred.context = context;
+    deferred.entries = array_create(Deferred_Entry);
+
+    initialized = true;
+}
+
+static void release(Deferred_Entry *entry)
+{
+    VkDevice device = deferred.context->logical_device;
+    VkAllocationCallbacks *allocator = deferred.context->allocator;
+
+    switch (entry->type) {
+        case VULKAN_DEFERRED_BUFFER:
+            vkDestroyBuffer(device, entry->buffer, allocator);
+            break;
+        case VULKAN_DEFERRED_IMAGE:
+            vkDestroyImage(device, entry->image, allocator);
+            break;
+        case VULKAN_DEFERRED_IMAGE_VIEW:
+            vkDestroyImageView(device, entry->image_view, allocator);
+            break;
+        case VULKAN_DEFERRED_FRAMEBUFFER:
+            vkDestroyFramebuffer(device, entry->framebuffer, allocator);
+            break;
+        case VULKAN_DEFERRED_RENDER_PASS:
+            vkDestroyRenderPass(device, entry->renderpass, allocator);
+            break;
+        case VULKAN_DEFERRED_PIPELINE:
+            vkDestroyPipeline(device, entry->pipeline, allocator);
+            break;
+        case VULKAN_DEFERRED_PIPELINE_LAYOUT:
+            vkDestroyPipelineLayout(device, entry->pipeline_layout, allocator);
+            break;
+        case VULKAN_DEFERRED_DESCRIPTOR_SET_LAYOUT:
+            vkDestroyDescriptorSetLayout(device, entry->descriptor_set_layout, allocator);
+            break;
+        case VULKAN_DEFERRED_SWAPCHAIN:
+            vkDestroySwapchainKHR(device, entry->swapchain, allocator);
+            break;
+        case VULKAN_DEFERRED_SEMAPHORE:
+            vkDestroySemaphore(device, entry->semaphore, allocator);
+            break;
+        case VULKAN_DEFERRED_MEMORY:
+            vulkan_free_memory(&entry->allocation);
+            break;
+        default:
+            LOG_ERROR("Unknown deferred destruction type: %u\n", entry->type);
+            break;
+    }
+
+    ++deferred.released_count;
+}
+
+void vulkan_deferred_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Vulkan deferred destruction is not initialized yet\n");
+        return;
+    }
+
+    for (u32 i = 0; i < array_length(deferred.entries); ++i) {
+        release(&deferred.entries[i]);
+    }
+
+    LOG_INFO("Deferred destruction: %llu released, at most %u pending\n",
+        (unsigned long long)deferred.released_count, deferred.max_pending_count);
+
+    array_destroy(deferred.entries);
+
+    memory_zero(&deferred, sizeof(deferred));
+    initialized = false;
+}
+
+static void push(Deferred_Entry *entry)
+{
+    for (u32 i = 0; i < MAX_VULKAN_QUEUES; ++i) {
+        entry->values[i] = vulkan_timeline_get_submitted_value(i);
+    }
+    array_push(deferred.entries, *entry);
+
+    deferred.max_pending_count = MAX(deferred.max_pending_count, (u32)array_length(deferred.entries));
+}
+
+// One per handle type, they only differ in the union member
+#define DEFINE_DEFER(name, Handle, deferred_type, member) \
+    void vulkan_defer_##name(Handle handle)               \
+    {                                                     \
+        if (handle == VK_NULL_HANDLE) return;             \
+        Deferred_Entry entry = {0};                       \
+        entry.type = deferred_type;                       \
+        entry.member = handle;                            \
+        push(&entry);                                     \
+    }
+
+DEFINE_DEFER(buffer, VkBuffer, VULKAN_DEFERRED_BUFFER, buffer)
+DEFINE_DEFER(image, VkImage, VULKAN_DEFERRED_IMAGE, image)
+DEFINE_DEFER(image_view, VkImageView, VULKAN_DEFERRED_IMAGE_VIEW, image_view)
+DEFINE_DEFER(framebuffer, VkFramebuffer, VULKAN_DEFERRED_FRAMEBUFFER, framebuffer)
+DEFINE_DEFER(render_pass, VkRenderPass, VULKAN_DEFERRED_RENDER_PASS, renderpass)
+DEFINE_DEFER(pipeline, VkPipeline, VULKAN_DEFERRED_PIPELINE, pipeline)
+DEFINE_DEFER(pipeline_layout, VkPipelineLayout, VULKAN_DEFERRED_PIPELINE_LAYOUT, pipeline_layout)
+DEFINE_DEFER(descriptor_set_layout, VkDescriptorSetLayout, VULKAN_DEFERRED_DESCRIPTOR_SET_LAYOUT, descriptor_set_layout)
+DEFINE_DEFER(swapchain, VkSwapchainKHR, VULKAN_DEFERRED_SWAPCHAIN, swapchain)
+DEFINE_DEFER(semaphore, VkSemaphore, VULKAN_DEFERRED_SEMAPHORE, semaphore)
+
+#undef DEFINE_DEFER
+
+void vulkan_defer_free_memory(const Vulkan_Allocation *allocation)
+{
+    if (allocation->memory == VK_NULL_HANDLE) return;
+
+    Deferred_Entry entry = {0};
+    entry.type = VULKAN_DEFERRED_MEMORY;
+    entry.allocation = *allocation;
+    push(&entry);
+}
+
+static bool is_complete(const Deferred_Entry *entry)
+{
+    for (u32 i = 0; i < MAX_VULKAN_QUEUES; ++i) {
+        if (!vulkan_timeline_is_complete(i, entry->values[i])) return false;
+    }
+    return true;
+}
+
+void vulkan_deferred_collect()
+{
+    u32 count = array_length(deferred.entries);
+    if (count == 0) return;
+
+    PROFILE_FUNCTION();
+
+    // Oldest first, once one isn't done none of the later ones are
+    u32 done = 0;
+    while (done < count && is_complete(&deferred.entries[done])) {
+        release(&deferred.entries[done]);
+        ++done;
+    }
+
+    if (done > 0) {
+        memory_move(deferred.entries, deferred.entries + done, sizeof(Deferred_Entry) * (count - done));
+        array_set_length(deferred.entries, count - done);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef VULKAN_DEFERRED_H
+#define VULKAN_DEFERRED_H
+
+#include "vulkan_types.h"
+
+// Deferred destruction: handles and device memory handed over here are released
+// once the GPU is past everything that was submitted (on any queue) by the time they
+// were handed over, so nothing has to wait for the device to go idle to replace a
+// resource. vulkan_deferred_collect releases whatever is done, call it once a frame.
+//
+// Main thread only, same as the rest of the renderer.
+typedef enum {
+    VULKAN_DEFERRED_BUFFER = 0,
+    VULKAN_DEFERRED_IMAGE,
+    VULKAN_DEFERRED_IMAGE_VIEW,
+    VULKAN_DEFERRED_FRAMEBUFFER,
+    VULKAN_DEFERRED_RENDER_PASS,
+    VULKAN_DEFERRED_PIPELINE,
+    VULKAN_DEFERRED_PIPELINE_LAYOUT,
+    VULKAN_DEFERRED_DESCRIPTOR_SET_LAYOUT,
+    VULKAN_DEFERRED_SWAPCHAIN,
+    VULKAN_DEFERRED_SEMAPHORE,
+    VULKAN_DEFERRED_MEMORY,
+
+    MAX_VULKAN_DEFERRED_TYPES
+} Vulkan_Deferred_Type;
+
+void vulkan_deferred_init(Vulkan_Context *context);
+// The device has to be idle, releases everything that's left
+void vulkan_deferred_destroy();
+
+// VK_NULL_HANDLE is ignored
+void vulkan_defer_buffer(VkBuffer buffer);
+void vulkan_defer_image(VkImage image);
+void vulkan_defer_image_view(VkImageView image_view);
+void vulkan_defer_framebuffer(VkFramebuffer framebuffer);
+void vulkan_defer_render_pass(VkRenderPass renderpass);
+void vulkan_defer_pipeline(VkPipeline pipeline);
+void vulkan_defer_pipeline_layout(VkPipelineLayout pipeline_layout);
+void vulkan_defer_descriptor_set_layout(VkDescriptorSetLayout descriptor_set_layout);
+void vulkan_defer_swapchain(VkSwapchainKHR swapchain);
+void vulkan_defer_semaphore(VkSemaphore semaphore);
+// Takes a copy, the allocation can be reused right away
+void vulkan_defer_free_memory(const Vulkan_Allocation *allocation);
+
+// Releases everything the GPU is done with, in the order it was handed over
+void vulkan_deferred_collect();
+
+#endif
\ No newline at end of file
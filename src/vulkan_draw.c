@@ -0,0 +1,404 @@
+#include "vulkan_draw.h"
+
+#include <assert.h>
+
+#include "common.h"
+#include "log.h"
+#include "memory.h"
+#include "array.h"
+#include "profile.h"
+#include "vulkan.h"
+#include "vulkan_allocator.h"
+#include "vulkan_deferred.h"
+
+// Smallest per frame buffer, in packets
+#define MIN_CAPACITY 1024
+
+typedef struct {
+    u32 first_index;
+    u32 index_count;
+    i32 vertex_offset;
+} Mesh;
+
+// Draws of one pipeline and material, recorded with one indirect call if possible
+typedef struct {
+    VkPipeline pipeline;
+    u32        material;
+    u32        first_draw;
+    u32        draw_count;
+} Batch;
+
+typedef struct {
+    // Indirect draw commands, then the draw count of every batch, then the instance
+    // data, capacity entries each
+    VkBuffer          buffer;
+    Vulkan_Allocation allocation;
+    u32               capacity; // In packets, there are never more draws or batches
+    Batch            *batches;  // array
+    u32              *instance_starts; // array, per draw, only without drawIndirectFirstInstance
+} Draw_Frame;
+
+// Bits 48-55 are the pipeline (its index among this frame's), 32-47 the material and
+// 0-31 the mesh, so packets that can share a draw end up next to each other
+typedef struct {
+    u64 key;
+    u32 packet;
+} Sort_Entry;
+
+static struct {
+    Vulkan_Context     *context;
+    Mesh               *meshes;  // array
+    Vulkan_Draw_Packet *packets; // array, since the last clear
+    Draw_Frame          frames[MAX_FRAMES_IN_FLIGHT];
+
+    // Sort scratch, kept around so it doesn't have to be allocated every frame
+    Sort_Entry *entries;
+    Sort_Entry *sorted;
+    u32         entry_capacity;
+
+    // Stats
+    u64 packet_count;
+    u64 draw_count;
+    u64 call_count;
+    u32 frame_count;
+} draw;
+
+static bool initialized = false;
+
+void vulkan_draw_init(Vulkan_Context *context)
+{
+    if (initialized) {
+        LOG_WARNING("Vulkan draw submission is already initialized\n");
+        return;
+    }
+
+    memory_zero(&draw, sizeof(draw));
+    draw.context = context;
+    draw.meshes = array_create(Mesh);
+    draw.packets = array_create(Vulkan_Draw_Packet);
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        draw.frames[i].batches = array_create(Batch);
+        draw.frames[i].instance_starts = array_create(u32);
+    }
+
+    initialized = true;
+}
+
+void vulkan_draw_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Vulkan draw submission is not initialized yet\n");
+        return;
+    }
+
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        Draw_Frame *frame = &draw.frames[i];
+        vulkan_defer_buffer(frame->buffer);
+        vulkan_defer_free_memory(&frame->allocation);
+        array_destroy(frame->batches);
+        array_destroy(frame->instance_starts);
+    }
+
+    if (draw.entry_capacity > 0) {
+        memory_free(draw.entries, sizeof(Sort_Entry) * draw.entry_capacity, MEMORY_TAG_VULKAN);
+        memory_free(draw.sorted, sizeof(Sort_Entry) * draw.entry_capacity, MEMORY_TAG_VULKAN);
+    }
+
+    if (draw.frame_count > 0) {
+        LOG_INFO("Draw submission: %.1f packets, %.1f instanced draws and %.1f indirect calls per frame\n",
+            (f64)draw.packet_count / draw.frame_count,
+            (f64)draw.draw_count / draw.frame_count,
+            (f64)draw.call_count / draw.frame_count);
+    }
+
+    array_destroy(draw.meshes);
+    array_destroy(draw.packets);
+
+    memory_zero(&draw, sizeof(draw));
+    initialized = false;
+}
+
+u32 vulkan_draw_register_mesh(u32 first_index, u32 index_count, i32 vertex_offset)
+{
+    Mesh mesh = {first_index, index_count, vertex_offset};
+    array_push(draw.meshes, mesh);
+    return array_length(draw.meshes) - 1;
+}
+
+void vulkan_draw_submit(const Vulkan_Draw_Packet *packets, u32 count)
+{
+    array_push_n(draw.packets, packets, count);
+}
+
+void vulkan_draw_clear()
+{
+    array_clear(draw.packets);
+}
+
+static VkDeviceSize get_counts_offset(u32 capacity)
+{
+    return sizeof(VkDrawIndexedIndirectCommand) * capacity;
+}
+
+static VkDeviceSize get_instances_offset(u32 capacity)
+{
+    return get_counts_offset(capacity) + sizeof(u32) * capacity;
+}
+
+static bool reserve_frame_buffer(Draw_Frame *frame, u32 count)
+{
+    if (count <= frame->capacity) return true;
+
+    // Frames still using the old one have their own, but it can't go right away
+    vulkan_defer_buffer(frame->buffer);
+    vulkan_defer_free_memory(&frame->allocation);
+    frame->buffer = VK_NULL_HANDLE;
+    memory_zero(&frame->allocation, sizeof(Vulkan_Allocation));
+
+    u32 capacity = MAX(frame->capacity, MIN_CAPACITY);
+    while (capacity < count) capacity *= 2;
+
+    Vulkan_Context *context = draw.context;
+
+    VkBufferCreateInfo buffer_create_info = {0};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = get_instances_offset(capacity) + sizeof(Vulkan_Instance) * capacity;
+    buffer_create_info.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VULKAN_CHECK(vkCreateBuffer(context->logical_device, &buffer_create_info, context->allocator, &frame->buffer));
+
+    // Written once a frame and read once by the GPU, not worth a staging copy
+    if (!vulkan_allocate_buffer_memory(
+            frame->buffer, VULKAN_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TAG_GPU_BUFFER, &frame->allocation)) {
+        LOG_ERROR("Failed to allocate memory for %u draw packets\n", capacity);
+        vkDestroyBuffer(context->logical_device, frame->buffer, context->allocator);
+        frame->buffer = VK_NULL_HANDLE;
+        frame->capacity = 0;
+        return false;
+    }
+
+    frame->capacity = capacity;
+    return true;
+}
+
+static void reserve_entries(u32 count)
+{
+    if (count <= draw.entry_capacity) return;
+
+    if (draw.entry_capacity > 0) {
+        memory_free(draw.entries, sizeof(Sort_Entry) * draw.entry_capacity, MEMORY_TAG_VULKAN);
+        memory_free(draw.sorted, sizeof(Sort_Entry) * draw.entry_capacity, MEMORY_TAG_VULKAN);
+    }
+
+    u32 capacity = MAX(draw.entry_capacity, MIN_CAPACITY);
+    while (capacity < count) capacity *= 2;
+
+    draw.entries = memory_alloc(sizeof(Sort_Entry) * capacity, MEMORY_TAG_VULKAN);
+    draw.sorted = memory_alloc(sizeof(Sort_Entry) * capacity, MEMORY_TAG_VULKAN);
+    draw.entry_capacity = capacity;
+}
+
+// LSD radix sort on bytes, stable. Bytes that are the same in every key are skipped,
+// with a handful of pipelines and materials that's most of them. Returns whichever
+// of the two buffers ends up with the sorted entries.
+static Sort_Entry *radix_sort(Sort_Entry *entries, Sort_Entry *temp, u32 count)
+{
+    u32 histograms[8][256];
+    memory_zero(histograms, sizeof(histograms));
+    for (u32 i = 0; i < count; ++i) {
+        u64 key = entries[i].key;
+        for (u32 digit = 0; digit < 8; ++digit) {
+            ++histograms[digit][(key >> (digit * 8)) & 0xFF];
+        }
+    }
+
+    for (u32 digit = 0; digit < 8; ++digit) {
+        u32 shift = digit * 8;
+        u32 *histogram = histograms[digit];
+        if (histogram[(entries[0].key >> shift) & 0xFF] == count) continue;
+
+        u32 offset = 0;
+        for (u32 i = 0; i < 256; ++i) {
+            u32 bucket_count = histogram[i];
+            histogram[i] = offset;
+            offset += bucket_count;
+        }
+
+        for (u32 i = 0; i < count; ++i) {
+            temp[histogram[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+        }
+
+        Sort_Entry *swap = entries;
+        entries = temp;
+        temp = swap;
+    }
+
+    return entries;
+}
+
+// Packets with a pipeline past VULKAN_DRAW_MAX_PIPELINES or an unknown mesh or
+// material are dropped
+static u32 build_sort_entries(VkPipeline *pipelines, u32 *pipeline_count)
+{
+    u32 packet_count = array_length(draw.packets);
+    u32 mesh_count = array_length(draw.meshes);
+    u32 entry_count = 0;
+
+    // Packets tend to come in runs of the same pipeline
+    VkPipeline last_pipeline = VK_NULL_HANDLE;
+    u32 last_pipeline_index = 0;
+
+    for (u32 i = 0; i < packet_count; ++i) {
+        const Vulkan_Draw_Packet *packet = &draw.packets[i];
+        if (packet->mesh >= mesh_count || packet->material >= VULKAN_DRAW_MAX_MATERIALS) {
+            LOG_ERROR("Invalid draw packet: mesh %u, material %u\n", packet->mesh, packet->material);
+            continue;
+        }
+
+        if (packet->pipeline != last_pipeline || *pipeline_count == 0) {
+            u32 index = 0;
+            while (index < *pipeline_count && pipelines[index] != packet->pipeline) ++index;
+            if (index == VULKAN_DRAW_MAX_PIPELINES) {
+                LOG_ERROR("More than %u pipelines in a frame, draw dropped\n", VULKAN_DRAW_MAX_PIPELINES);
+                continue;
+            }
+            if (index == *pipeline_count) {
+                pipelines[(*pipeline_count)++] = packet->pipeline;
+            }
+            last_pipeline = packet->pipeline;
+            last_pipeline_index = index;
+        }
+
+        Sort_Entry *entry = &draw.entries[entry_count++];
+        entry->key = ((u64)last_pipeline_index << 48) | ((u64)packet->material << 32) | packet->mesh;
+        entry->packet = i;
+    }
+
+    return entry_count;
+}
+
+u32 vulkan_draw_prepare(u32 frame_index)
+{
+    PROFILE_FUNCTION();
+
+    Vulkan_Context *context = draw.context;
+    Draw_Frame *frame = &draw.frames[frame_index];
+    array_clear(frame->batches);
+    array_clear(frame->instance_starts);
+
+    u32 packet_count = array_length(draw.packets);
+    if (packet_count == 0) return 0;
+
+    reserve_entries(packet_count);
+
+    VkPipeline pipelines[VULKAN_DRAW_MAX_PIPELINES];
+    u32 pipeline_count = 0;
+    u32 count = build_sort_entries(pipelines, &pipeline_count);
+    if (count == 0 || !reserve_frame_buffer(frame, count)) return 0;
+
+    Sort_Entry *sorted = radix_sort(draw.entries, draw.sorted, count);
+
+    u8 *mapped = (u8 *)frame->allocation.mapped;
+    VkDrawIndexedIndirectCommand *commands = (VkDrawIndexedIndirectCommand *)mapped;
+    u32 *counts = (u32 *)(mapped + get_counts_offset(frame->capacity));
+    Vulkan_Instance *instances = (Vulkan_Instance *)(mapped + get_instances_offset(frame->capacity));
+
+    // Runs of the same key become one instanced draw, runs of the same pipeline and
+    // material one batch
+    u32 draw_count = 0;
+    u32 start = 0;
+    while (start < count) {
+        u64 key = sorted[start].key;
+        u32 end = start;
+        while (end < count && sorted[end].key == key) {
+            instances[end] = draw.packets[sorted[end].packet].instance;
+            ++end;
+        }
+
+        const Mesh *mesh = &draw.meshes[(u32)key];
+        VkDrawIndexedIndirectCommand *command = &commands[draw_count];
+        command->indexCount = mesh->index_count;
+        command->instanceCount = end - start;
+        command->firstIndex = mesh->first_index;
+        command->vertexOffset = mesh->vertex_offset;
+        // Has to be 0 without the feature, the instance data gets bound at start then
+        command->firstInstance = context->draw_indirect_first_instance ? start : 0;
+        if (!context->draw_indirect_first_instance) array_push(frame->instance_starts, start);
+
+        VkPipeline pipeline = pipelines[(key >> 48) & 0xFF];
+        u32 material = (u32)(key >> 32) & 0xFFFF;
+        u32 batch_count = array_length(frame->batches);
+        Batch *batch = batch_count > 0 ? &frame->batches[batch_count - 1] : NULL;
+        if (!batch || batch->pipeline != pipeline || batch->material != material) {
+            Batch new_batch = {pipeline, material, draw_count, 0};
+            array_push(frame->batches, new_batch);
+            batch = &frame->batches[batch_count];
+        }
+        ++batch->draw_count;
+
+        ++draw_count;
+        start = end;
+    }
+
+    u32 batch_count = array_length(frame->batches);
+    for (u32 i = 0; i < batch_count; ++i) {
+        counts[i] = frame->batches[i].draw_count;
+    }
+
+    bool one_call_per_batch = context->multi_draw_indirect && context->draw_indirect_first_instance;
+    draw.packet_count += count;
+    draw.draw_count += draw_count;
+    draw.call_count += one_call_per_batch ? batch_count : draw_count;
+    ++draw.frame_count;
+
+    return batch_count;
+}
+
+void vulkan_draw_record(VkCommandBuffer command_buffer, u32 frame_index, u32 first_batch, u32 batch_count)
+{
+    Vulkan_Context *context = draw.context;
+    const Draw_Frame *frame = &draw.frames[frame_index];
+    assert(first_batch + batch_count <= array_length(frame->batches));
+
+    VkDeviceSize instances_offset = get_instances_offset(frame->capacity);
+    VkDeviceSize counts_offset = get_counts_offset(frame->capacity);
+    u32 stride = sizeof(VkDrawIndexedIndirectCommand);
+
+    vkCmdBindVertexBuffers(command_buffer, VULKAN_DRAW_INSTANCE_BINDING, 1, &frame->buffer, &instances_offset);
+
+    VkPipeline bound_pipeline = VK_NULL_HANDLE;
+    for (u32 i = first_batch; i < first_batch + batch_count; ++i) {
+        const Batch *batch = &frame->batches[i];
+        if (batch->pipeline != bound_pipeline) {
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, batch->pipeline);
+            bound_pipeline = batch->pipeline;
+        }
+
+        VkDeviceSize commands_offset = (VkDeviceSize)stride * batch->first_draw;
+
+        if (context->multi_draw_indirect && context->draw_indirect_first_instance) {
+            if (context->draw_indirect_count) {
+                vkCmdDrawIndexedIndirectCount(
+                    command_buffer,
+                    frame->buffer,
+                    commands_offset,
+                    frame->buffer,
+                    counts_offset + sizeof(u32) * i,
+                    batch->draw_count,
+                    stride);
+            } else {
+                vkCmdDrawIndexedIndirect(command_buffer, frame->buffer, commands_offset, batch->draw_count, stride);
+            }
+            continue;
+        }
+
+        for (u32 j = 0; j < batch->draw_count; ++j) {
+            if (!context->draw_indirect_first_instance) {
+                VkDeviceSize offset = instances_offset
+                    + sizeof(Vulkan_Instance) * frame->instance_starts[batch->first_draw + j];
+                vkCmdBindVertexBuffers(command_buffer, VULKAN_DRAW_INSTANCE_BINDING, 1, &frame->buffer, &offset);
+            }
+            vkCmdDrawIndexedIndirect(command_buffer, frame->buffer, commands_offset + stride * j, 1, stride);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef VULKAN_DRAW_H
+#define VULKAN_DRAW_H
+
+#include "vulkan_types.h"
+
+// Draw submission: objects are handed over as packets every frame, and instead of a
+// draw call each, the frame gets:
+// - the packets radix sorted by pipeline, material and mesh
+// - packets with the same key merged into one instanced draw, their instance data
+//   laid out one after the other
+// - the draws written into a per frame buffer and issued with
+//   vkCmdDrawIndexedIndirect, one call per pipeline and material (a batch), or
+//   vkCmdDrawIndexedIndirectCount with the counts in the same buffer when the
+//   device has drawIndirectCount
+// so recording costs the same for ten objects as for ten thousand of one mesh.
+// Without multiDrawIndirect every draw is its own indirect call, without
+// drawIndirectFirstInstance the instance data is bound again for each.
+//
+// Meshes are ranges of the shared index and vertex buffers, which whoever records
+// has bound already (binding 0 and the index buffer), instance data goes to binding 1.
+// Materials only order and split the batches for now, there's nothing to bind yet.
+//
+// Main thread only, same as the rest of the renderer.
+#define VULKAN_DRAW_MAX_PIPELINES 256   // Per frame
+#define VULKAN_DRAW_MAX_MATERIALS 65536
+
+// Where the instance data goes in the graphics pipelines
+#define VULKAN_DRAW_INSTANCE_BINDING 1
+
+typedef struct {
+    VkPipeline      pipeline;
+    u32             material; // Below VULKAN_DRAW_MAX_MATERIALS, 0 if it doesn't matter
+    u32             mesh;     // From vulkan_draw_register_mesh
+    Vulkan_Instance instance;
+} Vulkan_Draw_Packet;
+
+void vulkan_draw_init(Vulkan_Context *context);
+// The device has to be idle
+void vulkan_draw_destroy();
+
+// Meshes stay around until vulkan_draw_destroy
+u32 vulkan_draw_register_mesh(u32 first_index, u32 index_count, i32 vertex_offset);
+
+// Drawn by the next vulkan_draw_frame, in whatever order the sort ends up with
+void vulkan_draw_submit(const Vulkan_Draw_Packet *packets, u32 count);
+// Drops the submitted packets, done at the end of every frame whether it was drawn or not
+void vulkan_draw_clear();
+
+// Sorts and merges the submitted packets into the frame's batches and fills its
+// buffer, returns the batch count. Call once per frame before recording.
+u32 vulkan_draw_prepare(u32 frame);
+// Records batches first_batch to first_batch + batch_count - 1 of the frame, inside a
+// render pass with the shared vertex and index buffers bound. Safe to call from job
+// threads, on different command buffers.
+void vulkan_draw_record(VkCommandBuffer command_buffer, u32 frame, u32 first_batch, u32 batch_count);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,266 @@
+#include "vulkan_profiler.h"
+
+#include <assert.h>
+
+#include "common.h"
+#include "log.h"
+#include "memory.h"
+#include "string_intern.h"
+#include "vulkan.h"
+
+// Every scope takes a begin and an end timestamp
+#define MAX_QUERIES (VULKAN_PROFILER_MAX_SCOPES * 2)
+
+typedef struct {
+    const char *name;
+    u32         depth;
+    bool        closed;
+} Scope;
+
+typedef struct {
+    VkQueryPool pool;
+    Scope       scopes[VULKAN_PROFILER_MAX_SCOPES];
+    u32         scope_count;
+    bool        pending; // Submitted, results not read yet
+} Frame_Queries;
+
+// Running totals for the summary, matched by the interned name
+typedef struct {
+    const char *name;
+    u32         depth;
+    f64         total_milliseconds;
+    f64         max_milliseconds;
+    u32         sample_count;
+} Scope_Stats;
+
+static struct {
+    Vulkan_Context *context;
+    bool            supported;
+    f64             timestamp_period; // Nanoseconds per tick
+    u64             timestamp_mask;   // Only timestampValidBits of the value are meaningful
+
+    Frame_Queries frames[MAX_FRAMES_IN_FLIGHT];
+    u32           current_frame;
+    u32           depth;
+    u32           frame_scope;
+    const char   *frame_name; // Interned
+
+    Vulkan_Gpu_Timing timings[VULKAN_PROFILER_MAX_SCOPES];
+    u32               timing_count;
+
+    Scope_Stats stats[VULKAN_PROFILER_MAX_SCOPES];
+    u32         stats_count;
+    u32         frames_since_summary;
+} profiler;
+
+static bool initialized = false;
+
+void vulkan_profiler_init(Vulkan_Context *context)
+{
+    if (initialized) {
+        LOG_WARNING("Vulkan profiler is already initialized\n");
+        return;
+    }
+
+    memory_zero(&profiler, sizeof(profiler));
+    profiler.context = context;
+    profiler.frame_name = string_intern("frame");
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+
+    u32 family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physical_device, &family_count, NULL);
+    VkQueueFamilyProperties families[family_count];
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physical_device, &family_count, families);
+
+    u32 valid_bits = families[context->supported_queue_families.graphics_queue_family_index].timestampValidBits;
+    profiler.supported = valid_bits > 0 && properties.limits.timestampPeriod > 0.0f;
+    if (!profiler.supported) {
+        LOG_WARNING("Graphics queue doesn't support timestamps, GPU profiling is disabled\n");
+        initialized = true;
+        return;
+    }
+
+    profiler.timestamp_period = properties.limits.timestampPeriod;
+    profiler.timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    VkQueryPoolCreateInfo create_info = {0};
+    create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    create_info.queryCount = MAX_QUERIES;
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        VULKAN_CHECK(
+            vkCreateQueryPool(
+                context->logical_device,
+                &create_info,
+                context->allocator,
+                &profiler.frames[i].pool));
+    }
+
+    initialized = true;
+}
+
+void vulkan_profiler_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Vulkan profiler is not initialized yet\n");
+        return;
+    }
+
+    if (profiler.supported) {
+        for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+            vkDestroyQueryPool(
+                profiler.context->logical_device,
+                profiler.frames[i].pool,
+                profiler.context->allocator);
+        }
+    }
+
+    initialized = false;
+}
+
+static void accumulate_stats(const Vulkan_Gpu_Timing *timing)
+{
+    Scope_Stats *stats = NULL;
+    for (u32 i = 0; i < profiler.stats_count; ++i) {
+        if (profiler.stats[i].name == timing->name) {
+            stats = &profiler.stats[i];
+            break;
+        }
+    }
+
+    if (stats == NULL) {
+        if (profiler.stats_count == VULKAN_PROFILER_MAX_SCOPES) return;
+        stats = &profiler.stats[profiler.stats_count++];
+        memory_zero(stats, sizeof(Scope_Stats));
+        stats->name = timing->name;
+        stats->depth = timing->depth;
+    }
+
+    stats->total_milliseconds += timing->milliseconds;
+    stats->max_milliseconds = MAX(stats->max_milliseconds, timing->milliseconds);
+    ++stats->sample_count;
+}
+
+// The frame's timeline value has been reached, so this returns right away
+static void read_results(Frame_Queries *queries)
+{
+    u32 query_count = queries->scope_count * 2;
+    u64 timestamps[MAX_QUERIES];
+    VkResult result = vkGetQueryPoolResults(
+        profiler.context->logical_device,
+        queries->pool,
+        0,
+        query_count,
+        sizeof(u64) * query_count,
+        timestamps,
+        sizeof(u64),
+        VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        // VK_NOT_READY, e.g. a scope that was never closed. Just skip the frame.
+        return;
+    }
+
+    profiler.timing_count = queries->scope_count;
+    for (u32 i = 0; i < queries->scope_count; ++i) {
+        u64 ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & profiler.timestamp_mask;
+
+        Vulkan_Gpu_Timing *timing = &profiler.timings[i];
+        timing->name = queries->scopes[i].name;
+        timing->depth = queries->scopes[i].depth;
+        timing->milliseconds = ticks * profiler.timestamp_period / 1000000.0;
+
+        accumulate_stats(timing);
+    }
+
+    ++profiler.frames_since_summary;
+}
+
+void vulkan_profiler_begin_frame(VkCommandBuffer command_buffer, u32 frame)
+{
+    if (!initialized || !profiler.supported) return;
+
+    Frame_Queries *queries = &profiler.frames[frame];
+    if (queries->pending) {
+        read_results(queries);
+        queries->pending = false;
+
+#if VULKAN_PROFILER_SUMMARY_INTERVAL > 0
+        if (profiler.frames_since_summary >= VULKAN_PROFILER_SUMMARY_INTERVAL) {
+            vulkan_profiler_log_summary();
+        }
+#endif
+    }
+
+    vkCmdResetQueryPool(command_buffer, queries->pool, 0, MAX_QUERIES);
+    queries->scope_count = 0;
+
+    profiler.current_frame = frame;
+    profiler.depth = 0;
+    profiler.frame_scope = vulkan_profiler_begin_scope(command_buffer, profiler.frame_name);
+}
+
+void vulkan_profiler_end_frame(VkCommandBuffer command_buffer)
+{
+    if (!initialized || !profiler.supported) return;
+
+    vulkan_profiler_end_scope(command_buffer, profiler.frame_scope);
+    profiler.frames[profiler.current_frame].pending = true;
+}
+
+u32 vulkan_profiler_begin_scope(VkCommandBuffer command_buffer, const char *name)
+{
+    if (!initialized || !profiler.supported) return VULKAN_PROFILER_INVALID_SCOPE;
+
+    Frame_Queries *queries = &profiler.frames[profiler.current_frame];
+    if (queries->scope_count == VULKAN_PROFILER_MAX_SCOPES) return VULKAN_PROFILER_INVALID_SCOPE;
+
+    u32 scope = queries->scope_count++;
+    queries->scopes[scope].name = name;
+    queries->scopes[scope].depth = profiler.depth++;
+    queries->scopes[scope].closed = false;
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries->pool, scope * 2);
+
+    return scope;
+}
+
+void vulkan_profiler_end_scope(VkCommandBuffer command_buffer, u32 scope)
+{
+    if (!initialized || !profiler.supported || scope == VULKAN_PROFILER_INVALID_SCOPE) return;
+
+    Frame_Queries *queries = &profiler.frames[profiler.current_frame];
+    if (queries->scopes[scope].closed) {
+        LOG_WARNING("GPU scope %s is closed twice\n", queries->scopes[scope].name);
+        return;
+    }
+    queries->scopes[scope].closed = true;
+    --profiler.depth;
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries->pool, scope * 2 + 1);
+}
+
+u32 vulkan_profiler_get_timings(const Vulkan_Gpu_Timing **timings)
+{
+    *timings = profiler.timings;
+    return profiler.timing_count;
+}
+
+void vulkan_profiler_log_summary()
+{
+    if (!initialized || !profiler.supported || profiler.frames_since_summary == 0) return;
+
+    LOG_INFO("GPU timings over %u frames (avg / max):\n", profiler.frames_since_summary);
+    for (u32 i = 0; i < profiler.stats_count; ++i) {
+        Scope_Stats *stats = &profiler.stats[i];
+        LOG_INFO("  %*s%-*s %8.3f / %8.3f ms\n",
+            (int)stats->depth * 2, "",
+            24 - (int)stats->depth * 2, stats->name,
+            stats->total_milliseconds / stats->sample_count,
+            stats->max_milliseconds);
+    }
+
+    profiler.stats_count = 0;
+    profiler.frames_since_summary = 0;
+}
@@ -0,0 +1,41 @@
+#ifndef VULKAN_PROFILER_H
+#define VULKAN_PROFILER_H
+
+#include "vulkan_types.h"
+
+// GPU timings from timestamp queries. Every frame in flight has its own query
+// pool, results are read back when the frame slot comes around again (its graphics
+// timeline value has been reached by then), so reading them never stalls.
+#define VULKAN_PROFILER_MAX_SCOPES 64
+#define VULKAN_PROFILER_INVALID_SCOPE 0xFFFFFFFF
+
+// Frames between two summaries in the log, 0 turns them off
+#ifndef VULKAN_PROFILER_SUMMARY_INTERVAL
+#define VULKAN_PROFILER_SUMMARY_INTERVAL 600
+#endif
+
+typedef struct {
+    const char *name;
+    u32         depth; // 0 is the whole frame
+    f64         milliseconds;
+} Vulkan_Gpu_Timing;
+
+void vulkan_profiler_init(Vulkan_Context *context);
+void vulkan_profiler_destroy();
+
+// Bracket the frame's primary command buffer, begin right after vkBeginCommandBuffer.
+// Only call once the frame's timeline value has been reached.
+void vulkan_profiler_begin_frame(VkCommandBuffer command_buffer, u32 frame);
+void vulkan_profiler_end_frame(VkCommandBuffer command_buffer);
+
+// name has to be interned (string_intern), scopes with the same name are summed up
+u32 vulkan_profiler_begin_scope(VkCommandBuffer command_buffer, const char *name);
+void vulkan_profiler_end_scope(VkCommandBuffer command_buffer, u32 scope);
+
+// Scopes of the latest frame whose results came back, in the order they were opened
+u32 vulkan_profiler_get_timings(const Vulkan_Gpu_Timing **timings);
+
+// Average of every scope since the last summary
+void vulkan_profiler_log_summary();
+
+#endif
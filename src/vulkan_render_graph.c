@@ -0,0 +1,1172 @@
+#include "vulkan_render_graph.h"
+
+#include <assert.h>
+
+#include "common.h"
+#include "log.h"
+#include "memory.h"
+#include "profile.h"
+#include "string_intern.h"
+#include "vulkan.h"
+#include "vulkan_allocator.h"
+#include "vulkan_deferred.h"
+#include "vulkan_profiler.h"
+
+typedef enum {
+    RESOURCE_TRANSIENT_IMAGE = 0,
+    RESOURCE_IMPORTED_IMAGE,
+    RESOURCE_IMPORTED_BUFFER,
+} Resource_Kind;
+
+// Where a resource is at during an execution. Reads are only made visible to the
+// stages (and access types) that haven't seen the last write yet, and the next
+// write waits for every read since.
+typedef struct {
+    VkPipelineStageFlags write_stages;
+    VkAccessFlags        write_access;
+    VkPipelineStageFlags read_stages;
+    VkPipelineStageFlags visible_stages;
+    VkAccessFlags        visible_access;
+} Sync_State;
+
+typedef struct {
+    const char   *name;
+    Resource_Kind kind;
+    VkFormat      format;
+    VkExtent2D    extent;
+    Vulkan_Render_Graph_Image_Import  image_import;
+    Vulkan_Render_Graph_Buffer_Import buffer_import;
+
+    // Compile
+    u32               first_pass; // Of the passes that weren't culled, INVALID if none uses it
+    u32               last_pass;
+    VkImageUsageFlags usage;
+    VkImage           image;      // Transient images only
+    VkImageView       view;
+    u32               slot;       // Memory it shares with other transient images
+
+    // Execute
+    VkImageLayout layout;
+    Sync_State    sync; // Transient images use the one of their slot
+} Resource;
+
+typedef struct {
+    u32                 resource;
+    Vulkan_Resource_Use use;
+    bool                clear;
+    VkClearValue        clear_value;
+} Pass_Use;
+
+// Attachment of a graphics pass, in the order the pass uses them
+typedef struct {
+    u32                 resource;
+    VkImageLayout       layout;
+    VkAttachmentLoadOp  load_op;
+    VkAttachmentStoreOp store_op;
+    bool                depth;
+} Pass_Attachment;
+
+typedef struct {
+    const char             *name;
+    Vulkan_Render_Pass_Type type;
+    u32                     flags;
+    Vulkan_Render_Pass_Proc proc;
+    void                   *data;
+    Pass_Use                uses[VULKAN_RENDER_GRAPH_MAX_USES];
+    u32                     use_count;
+
+    // Compile, graphics passes only
+    bool            culled;
+    Pass_Attachment attachments[VULKAN_RENDER_GRAPH_MAX_USES];
+    VkClearValue    clear_values[VULKAN_RENDER_GRAPH_MAX_USES]; // In attachment order
+    u32             attachment_count;
+    VkExtent2D      extent;
+    u32             variant_count; // Of the attachments, the most any import has
+    // Left empty with dynamic rendering, which begins on the views directly
+    VkRenderPass    renderpass;
+    VkFramebuffer   framebuffers[VULKAN_RENDER_GRAPH_MAX_VARIANTS];
+    u32             framebuffer_count;
+} Pass;
+
+// Memory shared by transient images whose lifetimes don't overlap
+typedef struct {
+    VkMemoryRequirements requirements;
+    u32                  last_pass; // Of the image that went in last
+    Vulkan_Allocation    allocation;
+    // Carried over between executions, the next frame's first image has to wait for
+    // the last one of this frame
+    Sync_State           sync;
+} Memory_Slot;
+
+typedef struct {
+    VkPipelineStageFlags stages;      // 0 means the shader stages of the pass type
+    VkAccessFlags        access;
+    VkImageLayout        layout;
+    VkImageUsageFlags    image_usage; // 0 if images can't be used that way
+    bool                 buffer;      // Buffers can be used that way
+    bool                 write;
+    bool                 attachment;
+} Use_Info;
+
+// What has to be made available after a write, the rest of an access mask is reads
+#define WRITE_ACCESS_MASK                                 \
+    (VK_ACCESS_SHADER_WRITE_BIT                           \
+        | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT            \
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT    \
+        | VK_ACCESS_TRANSFER_WRITE_BIT)
+
+static const Use_Info use_infos[MAX_VULKAN_RESOURCE_USES] = {
+    [VULKAN_RESOURCE_USE_COLOR_ATTACHMENT] = {
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        false, true, true},
+    [VULKAN_RESOURCE_USE_DEPTH_ATTACHMENT] = {
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        false, true, true},
+    [VULKAN_RESOURCE_USE_STORAGE_WRITE] = {
+        0,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_USAGE_STORAGE_BIT,
+        true, true, false},
+    [VULKAN_RESOURCE_USE_TRANSFER_DST] = {
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        true, true, false},
+    [VULKAN_RESOURCE_USE_DEPTH_READ] = {
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        false, false, true},
+    [VULKAN_RESOURCE_USE_SAMPLED] = {
+        0,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_IMAGE_USAGE_SAMPLED_BIT,
+        false, false, false},
+    [VULKAN_RESOURCE_USE_STORAGE_READ] = {
+        0,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_IMAGE_USAGE_STORAGE_BIT,
+        true, false, false},
+    [VULKAN_RESOURCE_USE_TRANSFER_SRC] = {
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        true, false, false},
+    [VULKAN_RESOURCE_USE_VERTEX_BUFFER] = {
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        0,
+        true, false, false},
+    [VULKAN_RESOURCE_USE_INDEX_BUFFER] = {
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_ACCESS_INDEX_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        0,
+        true, false, false},
+    [VULKAN_RESOURCE_USE_INDIRECT_BUFFER] = {
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        0,
+        true, false, false},
+    [VULKAN_RESOURCE_USE_UNIFORM_BUFFER] = {
+        0,
+        VK_ACCESS_UNIFORM_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        0,
+        true, false, false},
+};
+
+// At most one barrier per resource: a pass adds one per use, and the final layout
+// transitions one per imported image
+typedef struct {
+    VkPipelineStageFlags  src_stages;
+    VkPipelineStageFlags  dst_stages;
+    VkImageMemoryBarrier  image_barriers[VULKAN_RENDER_GRAPH_MAX_RESOURCES];
+    u32                   image_barrier_count;
+    VkBufferMemoryBarrier buffer_barriers[VULKAN_RENDER_GRAPH_MAX_RESOURCES];
+    u32                   buffer_barrier_count;
+} Barrier_Batch;
+
+static struct {
+    Vulkan_Context *context;
+
+    Pass        passes[VULKAN_RENDER_GRAPH_MAX_PASSES];
+    u32         pass_count;
+    Resource    resources[VULKAN_RENDER_GRAPH_MAX_RESOURCES];
+    u32         resource_count;
+    Memory_Slot slots[VULKAN_RENDER_GRAPH_MAX_RESOURCES];
+    u32         slot_count;
+    bool        compiled;
+
+    // Stats
+    u32 compile_count;
+    u64 barrier_count;
+    u64 execute_count;
+} graph;
+
+static bool initialized = false;
+
+void vulkan_render_graph_init(Vulkan_Context *context)
+{
+    if (initialized) {
+        LOG_WARNING("Vulkan render graph is already initialized\n");
+        return;
+    }
+
+    memory_zero(&graph, sizeof(graph));
+    graph.context = context;
+
+    initialized = true;
+}
+
+void vulkan_render_graph_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Vulkan render graph is not initialized yet\n");
+        return;
+    }
+
+    vulkan_render_graph_reset();
+
+    LOG_INFO("Render graph: compiled %u times, %.1f barriers per execution\n",
+        graph.compile_count,
+        graph.execute_count > 0 ? (f64)graph.barrier_count / graph.execute_count : 0.0);
+
+    memory_zero(&graph, sizeof(graph));
+    initialized = false;
+}
+
+void vulkan_render_graph_reset()
+{
+    for (u32 i = 0; i < graph.pass_count; ++i) {
+        Pass *pass = &graph.passes[i];
+        for (u32 j = 0; j < pass->framebuffer_count; ++j) {
+            vulkan_defer_framebuffer(pass->framebuffers[j]);
+        }
+        vulkan_defer_render_pass(pass->renderpass);
+    }
+
+    for (u32 i = 0; i < graph.resource_count; ++i) {
+        vulkan_defer_image_view(graph.resources[i].view);
+        vulkan_defer_image(graph.resources[i].image);
+    }
+
+    for (u32 i = 0; i < graph.slot_count; ++i) {
+        vulkan_defer_free_memory(&graph.slots[i].allocation);
+    }
+
+    memory_zero(graph.passes, sizeof(graph.passes));
+    memory_zero(graph.resources, sizeof(graph.resources));
+    memory_zero(graph.slots, sizeof(graph.slots));
+    graph.pass_count = 0;
+    graph.resource_count = 0;
+    graph.slot_count = 0;
+    graph.compiled = false;
+}
+
+static u32 add_resource(const char *name, Resource_Kind kind)
+{
+    if (graph.compiled) {
+        LOG_ERROR("Render graph is already compiled, reset it before adding %s\n", name);
+        return VULKAN_RENDER_GRAPH_INVALID;
+    }
+    if (graph.resource_count == VULKAN_RENDER_GRAPH_MAX_RESOURCES) {
+        LOG_ERROR("Too many render graph resources, can't add %s\n", name);
+        return VULKAN_RENDER_GRAPH_INVALID;
+    }
+
+    u32 index = graph.resource_count++;
+    Resource *resource = &graph.resources[index];
+    resource->name = string_intern(name);
+    resource->kind = kind;
+    return index;
+}
+
+u32 vulkan_render_graph_create_image(const char *name, VkFormat format, VkExtent2D extent)
+{
+    u32 index = add_resource(name, RESOURCE_TRANSIENT_IMAGE);
+    if (index == VULKAN_RENDER_GRAPH_INVALID) return index;
+
+    graph.resources[index].format = format;
+    graph.resources[index].extent = extent;
+    return index;
+}
+
+u32 vulkan_render_graph_import_image(const char *name, const Vulkan_Render_Graph_Image_Import *import)
+{
+    if (import->variant_count == 0 || import->variant_count > VULKAN_RENDER_GRAPH_MAX_VARIANTS) {
+        LOG_ERROR("Render graph image %s has %u variants, at most %u are supported\n",
+            name, import->variant_count, VULKAN_RENDER_GRAPH_MAX_VARIANTS);
+        return VULKAN_RENDER_GRAPH_INVALID;
+    }
+
+    u32 index = add_resource(name, RESOURCE_IMPORTED_IMAGE);
+    if (index == VULKAN_RENDER_GRAPH_INVALID) return index;
+
+    graph.resources[index].format = import->format;
+    graph.resources[index].extent = import->extent;
+    graph.resources[index].image_import = *import;
+    return index;
+}
+
+u32 vulkan_render_graph_import_buffer(const char *name, const Vulkan_Render_Graph_Buffer_Import *import)
+{
+    if (import->variant_count == 0 || import->variant_count > VULKAN_RENDER_GRAPH_MAX_VARIANTS) {
+        LOG_ERROR("Render graph buffer %s has %u variants, at most %u are supported\n",
+            name, import->variant_count, VULKAN_RENDER_GRAPH_MAX_VARIANTS);
+        return VULKAN_RENDER_GRAPH_INVALID;
+    }
+
+    u32 index = add_resource(name, RESOURCE_IMPORTED_BUFFER);
+    if (index == VULKAN_RENDER_GRAPH_INVALID) return index;
+
+    graph.resources[index].buffer_import = *import;
+    return index;
+}
+
+u32 vulkan_render_graph_add_pass(
+    const char *name,
+    Vulkan_Render_Pass_Type type,
+    u32 flags,
+    Vulkan_Render_Pass_Proc proc,
+    void *data)
+{
+    if (graph.compiled) {
+        LOG_ERROR("Render graph is already compiled, reset it before adding %s\n", name);
+        return VULKAN_RENDER_GRAPH_INVALID;
+    }
+    if (graph.pass_count == VULKAN_RENDER_GRAPH_MAX_PASSES) {
+        LOG_ERROR("Too many render graph passes, can't add %s\n", name);
+        return VULKAN_RENDER_GRAPH_INVALID;
+    }
+
+    u32 index = graph.pass_count++;
+    Pass *pass = &graph.passes[index];
+    pass->name = string_intern(name);
+    pass->type = type;
+    pass->flags = flags;
+    pass->proc = proc;
+    pass->data = data;
+    return index;
+}
+
+static Pass_Use *add_use(u32 pass_index, u32 resource, Vulkan_Resource_Use use)
+{
+    if (pass_index >= graph.pass_count || resource >= graph.resource_count) {
+        LOG_ERROR("Invalid render graph pass (%u) or resource (%u)\n", pass_index, resource);
+        return NULL;
+    }
+
+    Pass *pass = &graph.passes[pass_index];
+    if (pass->use_count == VULKAN_RENDER_GRAPH_MAX_USES) {
+        LOG_ERROR("Render graph pass %s uses too many resources\n", pass->name);
+        return NULL;
+    }
+
+    Pass_Use *pass_use = &pass->uses[pass->use_count++];
+    memory_zero(pass_use, sizeof(Pass_Use));
+    pass_use->resource = resource;
+    pass_use->use = use;
+    return pass_use;
+}
+
+void vulkan_render_graph_use(u32 pass, u32 resource, Vulkan_Resource_Use use)
+{
+    add_use(pass, resource, use);
+}
+
+static bool is_depth_format(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool has_stencil(VkFormat format)
+{
+    return format == VK_FORMAT_D16_UNORM_S8_UINT
+        || format == VK_FORMAT_D24_UNORM_S8_UINT
+        || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+static VkImageAspectFlags get_aspect_mask(VkFormat format)
+{
+    if (!is_depth_format(format)) return VK_IMAGE_ASPECT_COLOR_BIT;
+    return has_stencil(format)
+        ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT
+        : VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
+void vulkan_render_graph_clear(u32 pass, u32 resource, VkClearValue clear_value)
+{
+    if (resource >= graph.resource_count) {
+        LOG_ERROR("Invalid render graph resource: %u\n", resource);
+        return;
+    }
+
+    Vulkan_Resource_Use use = is_depth_format(graph.resources[resource].format)
+        ? VULKAN_RESOURCE_USE_DEPTH_ATTACHMENT
+        : VULKAN_RESOURCE_USE_COLOR_ATTACHMENT;
+
+    Pass_Use *pass_use = add_use(pass, resource, use);
+    if (pass_use == NULL) return;
+
+    pass_use->clear = true;
+    pass_use->clear_value = clear_value;
+}
+
+static bool validate()
+{
+    for (u32 i = 0; i < graph.pass_count; ++i) {
+        Pass *pass = &graph.passes[i];
+        u32 attachment_count = 0;
+        u32 depth_count = 0;
+
+        for (u32 j = 0; j < pass->use_count; ++j) {
+            Pass_Use *use = &pass->uses[j];
+            const Use_Info *info = &use_infos[use->use];
+            Resource *resource = &graph.resources[use->resource];
+
+            for (u32 k = 0; k < j; ++k) {
+                if (pass->uses[k].resource == use->resource) {
+                    LOG_ERROR("Render graph pass %s uses %s more than once\n", pass->name, resource->name);
+                    return false;
+                }
+            }
+
+            bool is_buffer = resource->kind == RESOURCE_IMPORTED_BUFFER;
+            if ((is_buffer && !info->buffer) || (!is_buffer && info->image_usage == 0)) {
+                LOG_ERROR("Render graph pass %s can't use %s that way\n", pass->name, resource->name);
+                return false;
+            }
+
+            if (info->attachment) {
+                if (pass->type != VULKAN_RENDER_PASS_GRAPHICS) {
+                    LOG_ERROR("Render graph pass %s uses %s as an attachment, but isn't a graphics pass\n",
+                        pass->name, resource->name);
+                    return false;
+                }
+                ++attachment_count;
+                if (use->use != VULKAN_RESOURCE_USE_COLOR_ATTACHMENT) ++depth_count;
+            }
+        }
+
+        if (pass->type == VULKAN_RENDER_PASS_GRAPHICS && (attachment_count == 0 || depth_count > 1)) {
+            LOG_ERROR("Render graph pass %s needs one or more attachments, at most one of them depth\n", pass->name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Walks the passes backwards, keeping whatever produces something a kept pass
+// reads. A clear overwrites everything, so earlier writers aren't needed for it.
+static void cull_passes()
+{
+    bool needed[VULKAN_RENDER_GRAPH_MAX_RESOURCES] = {0};
+
+    for (u32 i = graph.pass_count; i-- > 0;) {
+        Pass *pass = &graph.passes[i];
+
+        bool keep = (pass->flags & VULKAN_RENDER_PASS_FLAG_SIDE_EFFECTS) != 0;
+        for (u32 j = 0; j < pass->use_count && !keep; ++j) {
+            Pass_Use *use = &pass->uses[j];
+            if (!use_infos[use->use].write) continue;
+            keep = needed[use->resource] || graph.resources[use->resource].kind != RESOURCE_TRANSIENT_IMAGE;
+        }
+
+        pass->culled = !keep;
+        if (!keep) continue;
+
+        for (u32 j = 0; j < pass->use_count; ++j) {
+            Pass_Use *use = &pass->uses[j];
+            // Writes that don't clear keep (or load) what was there before
+            needed[use->resource] = !use->clear;
+        }
+    }
+}
+
+static void compute_lifetimes()
+{
+    for (u32 i = 0; i < graph.resource_count; ++i) {
+        graph.resources[i].first_pass = VULKAN_RENDER_GRAPH_INVALID;
+        graph.resources[i].last_pass = VULKAN_RENDER_GRAPH_INVALID;
+    }
+
+    for (u32 i = 0; i < graph.pass_count; ++i) {
+        Pass *pass = &graph.passes[i];
+        if (pass->culled) continue;
+
+        for (u32 j = 0; j < pass->use_count; ++j) {
+            Resource *resource = &graph.resources[pass->uses[j].resource];
+            if (resource->first_pass == VULKAN_RENDER_GRAPH_INVALID) resource->first_pass = i;
+            resource->last_pass = i;
+            resource->usage |= use_infos[pass->uses[j].use].image_usage;
+        }
+    }
+}
+
+// Greedy interval packing: images in the order they're first used, each goes into
+// the slot whose last image is done by then and whose size fits it best
+static u32 choose_slot(const VkMemoryRequirements *requirements, u32 first_pass)
+{
+    u32 best = VULKAN_RENDER_GRAPH_INVALID;
+    for (u32 i = 0; i < graph.slot_count; ++i) {
+        Memory_Slot *slot = &graph.slots[i];
+        if (slot->last_pass >= first_pass) continue;
+        if ((slot->requirements.memoryTypeBits & requirements->memoryTypeBits) == 0) continue;
+
+        if (best == VULKAN_RENDER_GRAPH_INVALID) {
+            best = i;
+            continue;
+        }
+
+        // Smallest one that fits, else the biggest one, so it grows the least
+        VkDeviceSize best_size = graph.slots[best].requirements.size;
+        VkDeviceSize size = slot->requirements.size;
+        bool fits = size >= requirements->size;
+        bool best_fits = best_size >= requirements->size;
+        if ((fits && (!best_fits || size < best_size)) || (!fits && !best_fits && size > best_size)) {
+            best = i;
+        }
+    }
+
+    if (best == VULKAN_RENDER_GRAPH_INVALID) {
+        best = graph.slot_count++;
+        memory_zero(&graph.slots[best], sizeof(Memory_Slot));
+        graph.slots[best].requirements.memoryTypeBits = requirements->memoryTypeBits;
+    }
+
+    Memory_Slot *slot = &graph.slots[best];
+    slot->requirements.size = MAX(slot->requirements.size, requirements->size);
+    slot->requirements.alignment = MAX(slot->requirements.alignment, requirements->alignment);
+    slot->requirements.memoryTypeBits &= requirements->memoryTypeBits;
+    return best;
+}
+
+static bool create_transient_images(VkDeviceSize *unaliased_size)
+{
+    Vulkan_Context *context = graph.context;
+
+    // Images in the order they're first used
+    u32 order[VULKAN_RENDER_GRAPH_MAX_RESOURCES];
+    u32 count = 0;
+    for (u32 i = 0; i < graph.resource_count; ++i) {
+        Resource *resource = &graph.resources[i];
+        if (resource->kind != RESOURCE_TRANSIENT_IMAGE || resource->first_pass == VULKAN_RENDER_GRAPH_INVALID) {
+            continue;
+        }
+
+        u32 j = count++;
+        while (j > 0 && graph.resources[order[j - 1]].first_pass > resource->first_pass) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = i;
+    }
+
+    *unaliased_size = 0;
+    VkMemoryRequirements requirements[VULKAN_RENDER_GRAPH_MAX_RESOURCES];
+
+    for (u32 i = 0; i < count; ++i) {
+        Resource *resource = &graph.resources[order[i]];
+
+        VkImageCreateInfo create_info = {0};
+        create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        create_info.imageType = VK_IMAGE_TYPE_2D;
+        create_info.format = resource->format;
+        create_info.extent.width = resource->extent.width;
+        create_info.extent.height = resource->extent.height;
+        create_info.extent.depth = 1;
+        create_info.mipLevels = 1;
+        create_info.arrayLayers = 1;
+        create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        create_info.usage = resource->usage;
+        create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VULKAN_CHECK(vkCreateImage(context->logical_device, &create_info, context->allocator, &resource->image));
+
+        vkGetImageMemoryRequirements(context->logical_device, resource->image, &requirements[i]);
+        *unaliased_size += requirements[i].size;
+
+        resource->slot = choose_slot(&requirements[i], resource->first_pass);
+        graph.slots[resource->slot].last_pass = resource->last_pass;
+    }
+
+    for (u32 i = 0; i < graph.slot_count; ++i) {
+        Memory_Slot *slot = &graph.slots[i];
+        if (slot->requirements.memoryTypeBits == 0 ||
+            !vulkan_allocate_memory(
+                slot->requirements,
+                VULKAN_MEMORY_USAGE_GPU_ONLY,
+                false,
+                MEMORY_TAG_GPU_IMAGE,
+                &slot->allocation)) {
+            LOG_ERROR("Failed to allocate %llu bytes of transient image memory\n",
+                (unsigned long long)slot->requirements.size);
+            return false;
+        }
+    }
+
+    for (u32 i = 0; i < count; ++i) {
+        Resource *resource = &graph.resources[order[i]];
+        Vulkan_Allocation *allocation = &graph.slots[resource->slot].allocation;
+
+        VULKAN_CHECK(
+            vkBindImageMemory(
+                context->logical_device,
+                resource->image,
+                allocation->memory,
+                allocation->offset));
+
+        VkImageViewCreateInfo view_create_info = {0};
+        view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_create_info.image = resource->image;
+        view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_create_info.format = resource->format;
+        view_create_info.subresourceRange.aspectMask = get_aspect_mask(resource->format);
+        view_create_info.subresourceRange.baseMipLevel = 0;
+        view_create_info.subresourceRange.levelCount = 1;
+        view_create_info.subresourceRange.baseArrayLayer = 0;
+        view_create_info.subresourceRange.layerCount = 1;
+        VULKAN_CHECK(
+            vkCreateImageView(context->logical_device, &view_create_info, context->allocator, &resource->view));
+    }
+
+    return true;
+}
+
+static VkImage get_image(const Resource *resource, u32 variant)
+{
+    if (resource->kind == RESOURCE_TRANSIENT_IMAGE) return resource->image;
+    return resource->image_import.images[variant % resource->image_import.variant_count];
+}
+
+static VkImageView get_view(const Resource *resource, u32 variant)
+{
+    if (resource->kind == RESOURCE_TRANSIENT_IMAGE) return resource->view;
+    return resource->image_import.views[variant % resource->image_import.variant_count];
+}
+
+// Nothing before the first use of a transient image (or an imported one that is
+// discarded) is worth loading, and nothing after the last use of a transient one is
+// worth storing
+static bool compute_attachments(u32 pass_index)
+{
+    Pass *pass = &graph.passes[pass_index];
+
+    pass->attachment_count = 0;
+    pass->variant_count = 1;
+
+    for (u32 i = 0; i < pass->use_count; ++i) {
+        Pass_Use *use = &pass->uses[i];
+        const Use_Info *info = &use_infos[use->use];
+        if (!info->attachment) continue;
+
+        Resource *resource = &graph.resources[use->resource];
+        bool imported = resource->kind != RESOURCE_TRANSIENT_IMAGE;
+
+        if (pass->attachment_count == 0) {
+            pass->extent = resource->extent;
+        } else if (pass->extent.width != resource->extent.width || pass->extent.height != resource->extent.height) {
+            LOG_ERROR("Attachments of render graph pass %s differ in size\n", pass->name);
+            return false;
+        }
+        if (imported) {
+            pass->variant_count = MAX(pass->variant_count, resource->image_import.variant_count);
+        }
+
+        bool discard = resource->first_pass == pass_index
+            && (!imported || resource->image_import.initial_layout == VK_IMAGE_LAYOUT_UNDEFINED);
+
+        u32 index = pass->attachment_count++;
+        Pass_Attachment *attachment = &pass->attachments[index];
+        attachment->resource = use->resource;
+        // The barriers before the pass already did the transition
+        attachment->layout = info->layout;
+        attachment->load_op = use->clear
+            ? VK_ATTACHMENT_LOAD_OP_CLEAR
+            : (discard ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD);
+        attachment->store_op = imported || resource->last_pass != pass_index
+            ? VK_ATTACHMENT_STORE_OP_STORE
+            : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment->depth = use->use != VULKAN_RESOURCE_USE_COLOR_ATTACHMENT;
+
+        pass->clear_values[index] = use->clear_value;
+    }
+
+    return true;
+}
+
+static void create_framebuffer(Pass *pass, u32 variant)
+{
+    Vulkan_Context *context = graph.context;
+
+    VkImageView views[VULKAN_RENDER_GRAPH_MAX_USES];
+    for (u32 i = 0; i < pass->attachment_count; ++i) {
+        views[i] = get_view(&graph.resources[pass->attachments[i].resource], variant);
+    }
+
+    VkFramebufferCreateInfo framebuffer_create_info = {0};
+    framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_create_info.renderPass = pass->renderpass;
+    framebuffer_create_info.attachmentCount = pass->attachment_count;
+    framebuffer_create_info.pAttachments = views;
+    framebuffer_create_info.width = pass->extent.width;
+    framebuffer_create_info.height = pass->extent.height;
+    framebuffer_create_info.layers = 1;
+    VULKAN_CHECK(
+        vkCreateFramebuffer(
+            context->logical_device,
+            &framebuffer_create_info,
+            context->allocator,
+            &pass->framebuffers[variant]));
+}
+
+static void create_renderpass(Pass *pass)
+{
+    Vulkan_Context *context = graph.context;
+
+    VkAttachmentDescription attachments[VULKAN_RENDER_GRAPH_MAX_USES];
+    VkAttachmentReference color_refs[VULKAN_RENDER_GRAPH_MAX_USES];
+    VkAttachmentReference depth_ref = {0};
+    u32 color_count = 0;
+    bool has_depth = false;
+
+    for (u32 i = 0; i < pass->attachment_count; ++i) {
+        const Pass_Attachment *pass_attachment = &pass->attachments[i];
+        VkFormat format = graph.resources[pass_attachment->resource].format;
+
+        VkAttachmentDescription *attachment = &attachments[i];
+        memory_zero(attachment, sizeof(VkAttachmentDescription));
+        attachment->format = format;
+        attachment->samples = VK_SAMPLE_COUNT_1_BIT;
+        attachment->loadOp = pass_attachment->load_op;
+        attachment->storeOp = pass_attachment->store_op;
+        attachment->stencilLoadOp = has_stencil(format) ? pass_attachment->load_op : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment->stencilStoreOp = has_stencil(format) ? pass_attachment->store_op : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment->initialLayout = pass_attachment->layout;
+        attachment->finalLayout = pass_attachment->layout;
+
+        if (!pass_attachment->depth) {
+            color_refs[color_count].attachment = i;
+            color_refs[color_count].layout = pass_attachment->layout;
+            ++color_count;
+        } else {
+            depth_ref.attachment = i;
+            depth_ref.layout = pass_attachment->layout;
+            has_depth = true;
+        }
+    }
+
+    VkSubpassDescription subpass_desc = {0};
+    subpass_desc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass_desc.colorAttachmentCount = color_count;
+    subpass_desc.pColorAttachments = color_refs;
+    subpass_desc.pDepthStencilAttachment = has_depth ? &depth_ref : NULL;
+
+    // No dependencies, the pipeline barriers around the pass take care of that
+    VkRenderPassCreateInfo renderpass_create_info = {0};
+    renderpass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderpass_create_info.attachmentCount = pass->attachment_count;
+    renderpass_create_info.pAttachments = attachments;
+    renderpass_create_info.subpassCount = 1;
+    renderpass_create_info.pSubpasses = &subpass_desc;
+    VULKAN_CHECK(
+        vkCreateRenderPass(
+            context->logical_device,
+            &renderpass_create_info,
+            context->allocator,
+            &pass->renderpass));
+
+    pass->framebuffer_count = pass->variant_count;
+    for (u32 variant = 0; variant < pass->framebuffer_count; ++variant) {
+        create_framebuffer(pass, variant);
+    }
+}
+
+bool vulkan_render_graph_compile()
+{
+    PROFILE_FUNCTION();
+
+    if (graph.compiled) {
+        LOG_WARNING("Render graph is already compiled\n");
+        return true;
+    }
+
+    if (!validate()) return false;
+
+    cull_passes();
+    compute_lifetimes();
+
+    VkDeviceSize unaliased_size = 0;
+    if (!create_transient_images(&unaliased_size)) return false;
+
+    u32 kept_count = 0;
+    for (u32 i = 0; i < graph.pass_count; ++i) {
+        if (graph.passes[i].culled) continue;
+        ++kept_count;
+
+        if (graph.passes[i].type != VULKAN_RENDER_PASS_GRAPHICS) continue;
+        if (!compute_attachments(i)) return false;
+        if (!graph.context->dynamic_rendering) create_renderpass(&graph.passes[i]);
+    }
+
+    VkDeviceSize aliased_size = 0;
+    for (u32 i = 0; i < graph.slot_count; ++i) {
+        aliased_size += graph.slots[i].requirements.size;
+    }
+
+    graph.compiled = true;
+    ++graph.compile_count;
+
+    LOG_INFO("Render graph compiled: %u of %u passes, transient images take %.2f MiB (%.2f MiB without aliasing)\n",
+        kept_count,
+        graph.pass_count,
+        aliased_size / (1024.0 * 1024.0),
+        unaliased_size / (1024.0 * 1024.0));
+
+    return true;
+}
+
+static Sync_State *get_sync(Resource *resource)
+{
+    if (resource->kind == RESOURCE_TRANSIENT_IMAGE) return &graph.slots[resource->slot].sync;
+    return &resource->sync;
+}
+
+static VkPipelineStageFlags get_stages(const Use_Info *info, Vulkan_Render_Pass_Type type)
+{
+    if (info->stages != 0) return info->stages;
+
+    switch (type) {
+        case VULKAN_RENDER_PASS_GRAPHICS:
+            return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        case VULKAN_RENDER_PASS_COMPUTE:
+            return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        default:
+            return VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+}
+
+static void add_barrier(
+    Barrier_Batch *batch,
+    Resource *resource,
+    u32 variant,
+    VkPipelineStageFlags src_stages,
+    VkAccessFlags src_access,
+    VkPipelineStageFlags dst_stages,
+    VkAccessFlags dst_access,
+    VkImageLayout new_layout)
+{
+    batch->src_stages |= src_stages;
+    batch->dst_stages |= dst_stages;
+
+    if (resource->kind == RESOURCE_IMPORTED_BUFFER) {
+        VkBufferMemoryBarrier *barrier = &batch->buffer_barriers[batch->buffer_barrier_count++];
+        memory_zero(barrier, sizeof(VkBufferMemoryBarrier));
+        barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier->srcAccessMask = src_access;
+        barrier->dstAccessMask = dst_access;
+        barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier->buffer = resource->buffer_import.buffers[variant % resource->buffer_import.variant_count];
+        barrier->offset = 0;
+        barrier->size = VK_WHOLE_SIZE;
+        return;
+    }
+
+    VkImageMemoryBarrier *barrier = &batch->image_barriers[batch->image_barrier_count++];
+    memory_zero(barrier, sizeof(VkImageMemoryBarrier));
+    barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier->srcAccessMask = src_access;
+    barrier->dstAccessMask = dst_access;
+    barrier->oldLayout = resource->layout;
+    barrier->newLayout = new_layout;
+    barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier->image = get_image(resource, variant);
+    barrier->subresourceRange.aspectMask = get_aspect_mask(resource->format);
+    barrier->subresourceRange.baseMipLevel = 0;
+    barrier->subresourceRange.levelCount = 1;
+    barrier->subresourceRange.baseArrayLayer = 0;
+    barrier->subresourceRange.layerCount = 1;
+
+    resource->layout = new_layout;
+}
+
+static void flush_barriers(VkCommandBuffer command_buffer, Barrier_Batch *batch)
+{
+    if (batch->image_barrier_count == 0 && batch->buffer_barrier_count == 0) return;
+
+    vkCmdPipelineBarrier(
+        command_buffer,
+        batch->src_stages != 0 ? batch->src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        batch->dst_stages != 0 ? batch->dst_stages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0,
+        0, NULL,
+        batch->buffer_barrier_count, batch->buffer_barriers,
+        batch->image_barrier_count, batch->image_barriers);
+
+    graph.barrier_count += batch->image_barrier_count + batch->buffer_barrier_count;
+    memory_zero(batch, sizeof(Barrier_Batch));
+}
+
+static void sync_use(Barrier_Batch *batch, const Pass *pass, const Pass_Use *use, u32 variant)
+{
+    Resource *resource = &graph.resources[use->resource];
+    Sync_State *sync = get_sync(resource);
+    const Use_Info *info = &use_infos[use->use];
+
+    VkPipelineStageFlags stages = get_stages(info, pass->type);
+    VkAccessFlags access = info->access;
+    bool transition = resource->kind != RESOURCE_IMPORTED_BUFFER && resource->layout != info->layout;
+
+    if (info->write || transition) {
+        // Waits for every earlier read and write, a transition is a write too
+        VkPipelineStageFlags src_stages = sync->write_stages | sync->read_stages;
+        if (src_stages != 0 || transition) {
+            add_barrier(batch, resource, variant, src_stages, sync->write_access, stages, access, info->layout);
+        }
+
+        sync->write_stages = stages;
+        sync->write_access = info->write ? (access & WRITE_ACCESS_MASK) : 0;
+        sync->read_stages = info->write ? 0 : stages;
+        sync->visible_stages = info->write ? 0 : stages;
+        sync->visible_access = info->write ? 0 : access;
+        return;
+    }
+
+    // Read after read in the same layout, or of a write it has seen already
+    bool visible = (stages & ~sync->visible_stages) == 0 && (access & ~sync->visible_access) == 0;
+    if (sync->write_stages != 0 && !visible) {
+        add_barrier(batch, resource, variant, sync->write_stages, sync->write_access, stages, access, info->layout);
+        sync->visible_stages |= stages;
+        sync->visible_access |= access;
+    }
+    sync->read_stages |= stages;
+}
+
+static void begin_renderpass(VkCommandBuffer command_buffer, const Pass *pass, u32 variant)
+{
+    VkRenderPassBeginInfo render_begin_info = {0};
+    render_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_begin_info.renderPass = pass->renderpass;
+    render_begin_info.framebuffer = pass->framebuffers[variant % pass->framebuffer_count];
+    render_begin_info.renderArea.offset.x = 0;
+    render_begin_info.renderArea.offset.y = 0;
+    render_begin_info.renderArea.extent = pass->extent;
+    render_begin_info.clearValueCount = pass->attachment_count;
+    render_begin_info.pClearValues = pass->clear_values;
+
+    VkSubpassContents contents = (pass->flags & VULKAN_RENDER_PASS_FLAG_SECONDARY_COMMAND_BUFFERS)
+        ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+        : VK_SUBPASS_CONTENTS_INLINE;
+    vkCmdBeginRenderPass(command_buffer, &render_begin_info, contents);
+}
+
+static void begin_rendering(VkCommandBuffer command_buffer, const Pass *pass, u32 variant)
+{
+    VkRenderingAttachmentInfo color_attachments[VULKAN_RENDER_GRAPH_MAX_USES];
+    VkRenderingAttachmentInfo depth_attachment = {0};
+    u32 color_count = 0;
+    bool has_depth = false;
+    bool depth_has_stencil = false;
+
+    for (u32 i = 0; i < pass->attachment_count; ++i) {
+        const Pass_Attachment *pass_attachment = &pass->attachments[i];
+        const Resource *resource = &graph.resources[pass_attachment->resource];
+
+        VkRenderingAttachmentInfo *attachment = pass_attachment->depth
+            ? &depth_attachment
+            : &color_attachments[color_count++];
+        memory_zero(attachment, sizeof(VkRenderingAttachmentInfo));
+        attachment->sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        attachment->imageView = get_view(resource, variant);
+        attachment->imageLayout = pass_attachment->layout;
+        attachment->loadOp = pass_attachment->load_op;
+        attachment->storeOp = pass_attachment->store_op;
+        attachment->clearValue = pass->clear_values[i];
+
+        if (pass_attachment->depth) {
+            has_depth = true;
+            depth_has_stencil = has_stencil(resource->format);
+        }
+    }
+
+    VkRenderingInfo rendering_info = {0};
+    rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    rendering_info.flags = (pass->flags & VULKAN_RENDER_PASS_FLAG_SECONDARY_COMMAND_BUFFERS)
+        ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT
+        : 0;
+    rendering_info.renderArea.offset.x = 0;
+    rendering_info.renderArea.offset.y = 0;
+    rendering_info.renderArea.extent = pass->extent;
+    rendering_info.layerCount = 1;
+    rendering_info.colorAttachmentCount = color_count;
+    rendering_info.pColorAttachments = color_attachments;
+    rendering_info.pDepthAttachment = has_depth ? &depth_attachment : NULL;
+    rendering_info.pStencilAttachment = depth_has_stencil ? &depth_attachment : NULL;
+
+    graph.context->cmd_begin_rendering(command_buffer, &rendering_info);
+}
+
+static void fill_pass_info(Vulkan_Render_Pass_Info *info, const Pass *pass, u32 frame, u32 variant)
+{
+    memory_zero(info, sizeof(Vulkan_Render_Pass_Info));
+    info->name = pass->name;
+    info->extent = pass->extent;
+    info->frame = frame;
+    info->variant = variant;
+
+    if (pass->type != VULKAN_RENDER_PASS_GRAPHICS) return;
+
+    info->renderpass = pass->renderpass;
+    info->framebuffer = pass->framebuffer_count > 0
+        ? pass->framebuffers[variant % pass->framebuffer_count]
+        : VK_NULL_HANDLE;
+    info->depth_format = VK_FORMAT_UNDEFINED;
+    for (u32 i = 0; i < pass->attachment_count; ++i) {
+        VkFormat format = graph.resources[pass->attachments[i].resource].format;
+        if (pass->attachments[i].depth) {
+            info->depth_format = format;
+        } else {
+            info->color_formats[info->color_format_count++] = format;
+        }
+    }
+}
+
+void vulkan_render_graph_set_image_variant(u32 resource_index, u32 variant, VkImage image, VkImageView view)
+{
+    if (resource_index >= graph.resource_count || graph.resources[resource_index].kind != RESOURCE_IMPORTED_IMAGE) {
+        LOG_ERROR("Render graph resource %u is not an imported image\n", resource_index);
+        return;
+    }
+
+    Vulkan_Render_Graph_Image_Import *import = &graph.resources[resource_index].image_import;
+    u32 slot = variant % import->variant_count;
+    if (import->images[slot] == image && import->views[slot] == view) return;
+
+    import->images[slot] = image;
+    import->views[slot] = view;
+    if (!graph.compiled) return;
+
+    // The old framebuffers may still be in use by frames in flight
+    for (u32 i = 0; i < graph.pass_count; ++i) {
+        Pass *pass = &graph.passes[i];
+        if (pass->culled || pass->framebuffer_count == 0) continue;
+
+        bool attached = false;
+        for (u32 j = 0; j < pass->attachment_count; ++j) {
+            attached = attached || pass->attachments[j].resource == resource_index;
+        }
+        if (!attached) continue;
+
+        for (u32 j = slot; j < pass->framebuffer_count; j += import->variant_count) {
+            vulkan_defer_framebuffer(pass->framebuffers[j]);
+            create_framebuffer(pass, j);
+        }
+    }
+}
+
+void vulkan_render_graph_execute(VkCommandBuffer command_buffer, u32 frame, u32 variant)
+{
+    if (!graph.compiled) {
+        LOG_WARNING("Render graph is not compiled, nothing to execute\n");
+        return;
+    }
+
+    PROFILE_FUNCTION();
+
+    // Transient images start out discarded every frame, imported ones as described.
+    // The sync state of transient images lives on in their slots.
+    for (u32 i = 0; i < graph.resource_count; ++i) {
+        Resource *resource = &graph.resources[i];
+        resource->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (resource->kind == RESOURCE_TRANSIENT_IMAGE) continue;
+
+        memory_zero(&resource->sync, sizeof(Sync_State));
+        if (resource->kind == RESOURCE_IMPORTED_IMAGE) {
+            resource->layout = resource->image_import.initial_layout;
+            resource->sync.write_stages = resource->image_import.initial_stages;
+        } else {
+            resource->sync.write_stages = resource->buffer_import.initial_stages;
+        }
+    }
+
+    Barrier_Batch batch = {0};
+
+    for (u32 i = 0; i < graph.pass_count; ++i) {
+        Pass *pass = &graph.passes[i];
+        if (pass->culled) continue;
+
+        for (u32 j = 0; j < pass->use_count; ++j) {
+            sync_use(&batch, pass, &pass->uses[j], variant);
+        }
+        flush_barriers(command_buffer, &batch);
+
+        Vulkan_Render_Pass_Info info;
+        fill_pass_info(&info, pass, frame, variant);
+
+        u32 scope = vulkan_profiler_begin_scope(command_buffer, pass->name);
+        if (pass->type == VULKAN_RENDER_PASS_GRAPHICS && graph.context->dynamic_rendering) {
+            begin_rendering(command_buffer, pass, variant);
+            pass->proc(command_buffer, &info, pass->data);
+            graph.context->cmd_end_rendering(command_buffer);
+        } else if (pass->type == VULKAN_RENDER_PASS_GRAPHICS) {
+            begin_renderpass(command_buffer, pass, variant);
+            pass->proc(command_buffer, &info, pass->data);
+            vkCmdEndRenderPass(command_buffer);
+        } else {
+            pass->proc(command_buffer, &info, pass->data);
+        }
+        vulkan_profiler_end_scope(command_buffer, scope);
+    }
+
+    // Handed over in the layout the outside world expects, whoever uses it next
+    // waits on the submission anyway
+    for (u32 i = 0; i < graph.resource_count; ++i) {
+        Resource *resource = &graph.resources[i];
+        if (resource->kind != RESOURCE_IMPORTED_IMAGE || resource->first_pass == VULKAN_RENDER_GRAPH_INVALID) continue;
+
+        VkImageLayout final_layout = resource->image_import.final_layout;
+        if (final_layout == VK_IMAGE_LAYOUT_UNDEFINED || final_layout == resource->layout) continue;
+
+        add_barrier(
+            &batch,
+            resource,
+            variant,
+            resource->sync.write_stages | resource->sync.read_stages,
+            resource->sync.write_access,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            final_layout);
+    }
+    flush_barriers(command_buffer, &batch);
+
+    ++graph.execute_count;
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+#ifndef VULKAN_RENDER_GRAPH_H
+#define VULKAN_RENDER_GRAPH_H
+
+#include "vulkan_types.h"
+
+// Frame render graph: passes declare how they use named images and buffers, the
+// graph works out the rest when it's compiled:
+// - passes whose results nothing ends up using are culled, a pass is needed when it
+//   writes an imported resource, has side effects or feeds a pass that is needed
+// - load and store ops of the graphics passes' attachments that only keep what a
+//   later pass reads, in render passes and framebuffers or, with dynamic rendering,
+//   straight on the image views (nothing to create, so aliasing a transient image or
+//   swapping an imported one doesn't leave framebuffers to rebuild)
+// - transient images, which only live within the frame, share memory whenever
+//   their lifetimes don't overlap
+// and every execution records the pipeline barriers and layout transitions between
+// the passes, batched into one vkCmdPipelineBarrier per pass and skipped when
+// nothing changed (a read after a read in the same layout, say).
+//
+// Declare everything between vulkan_render_graph_reset and vulkan_render_graph_compile,
+// then execute it every frame. Resetting hands the previous objects over to the
+// deferred destruction queue, so the graph can be rebuilt while frames are in flight.
+// All passes go into one command buffer on the graphics queue.
+//
+// Main thread only, same as the rest of the renderer.
+#define VULKAN_RENDER_GRAPH_MAX_PASSES    32
+#define VULKAN_RENDER_GRAPH_MAX_RESOURCES 64
+#define VULKAN_RENDER_GRAPH_MAX_USES      16 // Per pass
+#define VULKAN_RENDER_GRAPH_MAX_VARIANTS  16 // Per imported resource
+
+#define VULKAN_RENDER_GRAPH_INVALID 0xFFFFFFFF
+
+typedef enum {
+    VULKAN_RENDER_PASS_GRAPHICS = 0, // Recorded inside a render pass over its attachments
+    VULKAN_RENDER_PASS_COMPUTE,
+    VULKAN_RENDER_PASS_TRANSFER,
+
+    MAX_VULKAN_RENDER_PASS_TYPES
+} Vulkan_Render_Pass_Type;
+
+typedef enum {
+    VULKAN_RENDER_PASS_FLAG_NONE = 0,
+    VULKAN_RENDER_PASS_FLAG_SIDE_EFFECTS = 1 << 0, // Never culled
+    VULKAN_RENDER_PASS_FLAG_SECONDARY_COMMAND_BUFFERS = 1 << 1, // Graphics only, contents come from vkCmdExecuteCommands
+} Vulkan_Render_Pass_Flags;
+
+typedef enum {
+    // Writes
+    VULKAN_RESOURCE_USE_COLOR_ATTACHMENT = 0,
+    VULKAN_RESOURCE_USE_DEPTH_ATTACHMENT,
+    VULKAN_RESOURCE_USE_STORAGE_WRITE,
+    VULKAN_RESOURCE_USE_TRANSFER_DST,
+
+    // Reads
+    VULKAN_RESOURCE_USE_DEPTH_READ, // Read only depth attachment
+    VULKAN_RESOURCE_USE_SAMPLED,    // Images only
+    VULKAN_RESOURCE_USE_STORAGE_READ,
+    VULKAN_RESOURCE_USE_TRANSFER_SRC,
+    VULKAN_RESOURCE_USE_VERTEX_BUFFER,
+    VULKAN_RESOURCE_USE_INDEX_BUFFER,
+    VULKAN_RESOURCE_USE_INDIRECT_BUFFER,
+    VULKAN_RESOURCE_USE_UNIFORM_BUFFER,
+
+    MAX_VULKAN_RESOURCE_USES
+} Vulkan_Resource_Use;
+
+// Something the frame renders into that lives outside the graph, e.g. the swapchain
+// images. Variants are picked with the variant index of vulkan_render_graph_execute
+// (modulo variant_count), one per swapchain image, say.
+typedef struct {
+    VkImage       images[VULKAN_RENDER_GRAPH_MAX_VARIANTS];
+    VkImageView   views[VULKAN_RENDER_GRAPH_MAX_VARIANTS];
+    u32           variant_count;
+    VkFormat      format;
+    VkExtent2D    extent;
+    // State at the start of every execution, UNDEFINED discards the contents.
+    // initial_stages is where the previous user is waited for (the stages of the
+    // acquire semaphore wait for a swapchain image), 0 if nothing has to be.
+    VkImageLayout        initial_layout;
+    VkPipelineStageFlags initial_stages;
+    // Left in this layout at the end, UNDEFINED keeps whatever the last pass needed
+    VkImageLayout        final_layout;
+} Vulkan_Render_Graph_Image_Import;
+
+typedef struct {
+    VkBuffer             buffers[VULKAN_RENDER_GRAPH_MAX_VARIANTS];
+    u32                  variant_count;
+    VkPipelineStageFlags initial_stages; // Same as for images
+} Vulkan_Render_Graph_Buffer_Import;
+
+// What a pass gets to record with
+typedef struct {
+    const char   *name;
+    VkRenderPass  renderpass;  // Graphics passes only, already begun. VK_NULL_HANDLE
+    VkFramebuffer framebuffer; // with dynamic rendering, the formats below describe it then
+    VkExtent2D    extent;      // Of the attachments
+    VkFormat      color_formats[VULKAN_RENDER_GRAPH_MAX_USES];
+    u32           color_format_count;
+    VkFormat      depth_format; // VK_FORMAT_UNDEFINED without a depth attachment
+    u32           frame;
+    u32           variant;
+} Vulkan_Render_Pass_Info;
+
+typedef void (*Vulkan_Render_Pass_Proc)(VkCommandBuffer command_buffer, const Vulkan_Render_Pass_Info *info, void *data);
+
+void vulkan_render_graph_init(Vulkan_Context *context);
+// The device has to be idle
+void vulkan_render_graph_destroy();
+
+// Drops every pass and resource, the objects of the last compile are destroyed once
+// the frames using them are done
+void vulkan_render_graph_reset();
+
+// Names are interned, so they only have to live through the call.
+// Transient images get the usage flags of whatever the passes use them for.
+u32 vulkan_render_graph_create_image(const char *name, VkFormat format, VkExtent2D extent);
+u32 vulkan_render_graph_import_image(const char *name, const Vulkan_Render_Graph_Image_Import *import);
+u32 vulkan_render_graph_import_buffer(const char *name, const Vulkan_Render_Graph_Buffer_Import *import);
+
+// Passes run in the order they were added
+u32 vulkan_render_graph_add_pass(
+    const char *name,
+    Vulkan_Render_Pass_Type type,
+    u32 flags,
+    Vulkan_Render_Pass_Proc proc,
+    void *data);
+void vulkan_render_graph_use(u32 pass, u32 resource, Vulkan_Resource_Use use);
+// Color or depth attachment (depending on the format) that is cleared on load
+void vulkan_render_graph_clear(u32 pass, u32 resource, VkClearValue clear_value);
+
+// Returns false when the declarations don't add up, nothing gets executed then
+bool vulkan_render_graph_compile();
+// Points variant (modulo variant_count) of an imported image at another image, for
+// when there are more images than variants, a swapchain with more than
+// VULKAN_RENDER_GRAPH_MAX_VARIANTS images, say. Framebuffers on it are created again.
+void vulkan_render_graph_set_image_variant(u32 resource, u32 variant, VkImage image, VkImageView view);
+// Records every pass that wasn't culled into command_buffer (outside a render pass)
+void vulkan_render_graph_execute(VkCommandBuffer command_buffer, u32 frame, u32 variant);
+
+#endif
\ No newline at end of file
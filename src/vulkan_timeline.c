@@ -0,0 +1,132 @@
+#include "vulkan_timeline.h"
+
+#include <assert.h>
+
+#include "common.h"
+#include "log.h"
+#include "memory.h"
+#include "profile.h"
+#include "vulkan.h"
+
+typedef struct {
+    VkSemaphore semaphore;
+    u64         submitted_value;
+    u64         completed_value; // Last one seen, the real one can only be ahead
+} Timeline;
+
+static struct {
+    Vulkan_Context *context;
+    Timeline        timelines[MAX_VULKAN_QUEUES];
+
+    // Stats
+    u32 wait_count; // Waits that actually blocked
+} timeline_state;
+
+static bool initialized = false;
+
+static const char *queue_names[MAX_VULKAN_QUEUES] = {"graphics", "transfer", "compute"};
+
+void vulkan_timeline_init(Vulkan_Context *context)
+{
+    if (initialized) {
+        LOG_WARNING("Vulkan timelines are already initialized\n");
+        return;
+    }
+
+    memory_zero(&timeline_state, sizeof(timeline_state));
+    timeline_state.context = context;
+
+    VkSemaphoreTypeCreateInfo type_create_info = {0};
+    type_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_create_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_create_info = {0};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_create_info.pNext = &type_create_info;
+
+    for (u32 i = 0; i < MAX_VULKAN_QUEUES; ++i) {
+        VULKAN_CHECK(
+            vkCreateSemaphore(
+                context->logical_device,
+                &semaphore_create_info,
+                context->allocator,
+                &timeline_state.timelines[i].semaphore));
+    }
+
+    initialized = true;
+}
+
+void vulkan_timeline_destroy()
+{
+    if (!initialized) {
+        LOG_WARNING("Vulkan timelines are not initialized yet\n");
+        return;
+    }
+
+    Vulkan_Context *context = timeline_state.context;
+
+    for (u32 i = 0; i < MAX_VULKAN_QUEUES; ++i) {
+        LOG_INFO("Timeline %s: %llu submissions\n",
+            queue_names[i], (unsigned long long)timeline_state.timelines[i].submitted_value);
+        vkDestroySemaphore(context->logical_device, timeline_state.timelines[i].semaphore, context->allocator);
+    }
+    LOG_INFO("Timeline waits that blocked: %u\n", timeline_state.wait_count);
+
+    memory_zero(&timeline_state, sizeof(timeline_state));
+    initialized = false;
+}
+
+VkSemaphore vulkan_timeline_get_semaphore(Vulkan_Queue_Type queue)
+{
+    return timeline_state.timelines[queue].semaphore;
+}
+
+u64 vulkan_timeline_next_value(Vulkan_Queue_Type queue)
+{
+    return ++timeline_state.timelines[queue].submitted_value;
+}
+
+u64 vulkan_timeline_get_submitted_value(Vulkan_Queue_Type queue)
+{
+    return timeline_state.timelines[queue].submitted_value;
+}
+
+u64 vulkan_timeline_get_completed_value(Vulkan_Queue_Type queue)
+{
+    Timeline *timeline = &timeline_state.timelines[queue];
+
+    uint64_t value;
+    VULKAN_CHECK(vkGetSemaphoreCounterValue(timeline_state.context->logical_device, timeline->semaphore, &value));
+    timeline->completed_value = value;
+
+    return timeline->completed_value;
+}
+
+bool vulkan_timeline_is_complete(Vulkan_Queue_Type queue, u64 value)
+{
+    if (value <= timeline_state.timelines[queue].completed_value) return true;
+
+    return value <= vulkan_timeline_get_completed_value(queue);
+}
+
+void vulkan_timeline_wait(Vulkan_Queue_Type queue, u64 value)
+{
+    if (vulkan_timeline_is_complete(queue, value)) return;
+
+    PROFILE_ZONE("timeline wait");
+
+    Timeline *timeline = &timeline_state.timelines[queue];
+    assert(value <= timeline->submitted_value); // Would never return
+
+    uint64_t wait_value = value;
+    VkSemaphoreWaitInfo wait_info = {0};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline->semaphore;
+    wait_info.pValues = &wait_value;
+    VULKAN_CHECK(vkWaitSemaphores(timeline_state.context->logical_device, &wait_info, UINT64_MAX));
+
+    timeline->completed_value = MAX(timeline->completed_value, value);
+    ++timeline_state.wait_count;
+}
\ No newline at end of file
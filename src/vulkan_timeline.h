@@ -0,0 +1,38 @@
+#ifndef VULKAN_TIMELINE_H
+#define VULKAN_TIMELINE_H
+
+#include "vulkan_types.h"
+
+// One timeline semaphore per kind of submission. Every submission signals the next
+// value of its timeline, so "is value X done" is a single comparison against the
+// last known completed value, and only goes to the driver when that's not enough.
+//
+// Main thread only, same as the rest of the renderer.
+typedef enum {
+    VULKAN_QUEUE_GRAPHICS = 0,
+    VULKAN_QUEUE_TRANSFER,
+    VULKAN_QUEUE_COMPUTE,
+
+    MAX_VULKAN_QUEUES
+} Vulkan_Queue_Type;
+
+void vulkan_timeline_init(Vulkan_Context *context);
+// The device has to be idle
+void vulkan_timeline_destroy();
+
+VkSemaphore vulkan_timeline_get_semaphore(Vulkan_Queue_Type queue);
+
+// Hands out the value the next submission to queue has to signal. Submissions have
+// to happen in the order their values were handed out.
+u64 vulkan_timeline_next_value(Vulkan_Queue_Type queue);
+// Latest value handed out, 0 before the first one
+u64 vulkan_timeline_get_submitted_value(Vulkan_Queue_Type queue);
+
+// Asks the driver for the current value
+u64 vulkan_timeline_get_completed_value(Vulkan_Queue_Type queue);
+// Doesn't touch the driver if value is known to be done already. 0 is always done.
+bool vulkan_timeline_is_complete(Vulkan_Queue_Type queue, u64 value);
+// Blocks until value is done
+void vulkan_timeline_wait(Vulkan_Queue_Type queue, u64 value);
+
+#endif
\ No newline at end of file
@@ -4,6 +4,27 @@
 #include <vulkan/vulkan.h>
 
 #include "common.h"
+#include "memory.h"
+
+// Number of frames the CPU is allowed to record ahead of the GPU
+#ifndef MAX_FRAMES_IN_FLIGHT
+#define MAX_FRAMES_IN_FLIGHT 2
+#endif
+
+// Scratch memory for the CPU side of a frame, reset every vulkan_draw_frame
+#ifndef VULKAN_FRAME_ARENA_SIZE
+#define VULKAN_FRAME_ARENA_SIZE (4 * 1024 * 1024)
+#endif
+
+// Scratch memory for setup work (file contents, surface queries), freed LIFO
+#ifndef VULKAN_SCRATCH_STACK_SIZE
+#define VULKAN_SCRATCH_STACK_SIZE (16 * 1024 * 1024)
+#endif
+
+// Draw recording is split into at most this many secondary command buffers per frame
+#ifndef VULKAN_MAX_RECORDING_JOBS
+#define VULKAN_MAX_RECORDING_JOBS 16
+#endif
 
 typedef struct {
     u32 graphics_queue_family_index;
@@ -18,8 +39,84 @@ typedef struct {
     VkSurfaceFormatKHR       *formats;
     u32                       present_mode_count;
     VkPresentModeKHR         *present_modes;
+    Memory_Stack_Marker       marker; // Both arrays are on the scratch stack above this
 } Vulkan_Swapchain_Support_Details;
 
+typedef enum {
+    VULKAN_MEMORY_USAGE_GPU_ONLY = 0, // Device local, never touched by the CPU
+    VULKAN_MEMORY_USAGE_CPU_TO_GPU,   // Mapped, written by the CPU (staging, per frame data)
+    VULKAN_MEMORY_USAGE_GPU_TO_CPU,   // Mapped, read back by the CPU
+
+    MAX_VULKAN_MEMORY_USAGES
+} Vulkan_Memory_Usage;
+
+// Trade-off between latency and tearing/power, decides the swapchain present mode.
+// Falls back to FIFO (always supported) when the preferred modes aren't available.
+typedef enum {
+    VULKAN_PRESENT_POLICY_LOW_LATENCY = 0, // MAILBOX, else IMMEDIATE (can tear)
+    VULKAN_PRESENT_POLICY_VSYNC,           // FIFO, frame rate capped at the refresh rate
+    VULKAN_PRESENT_POLICY_ADAPTIVE,        // FIFO_RELAXED, tears only when a frame is late
+
+    MAX_VULKAN_PRESENT_POLICIES
+} Vulkan_Present_Policy;
+
+// A range of device memory handed out by the allocator (see vulkan_allocator.h)
+typedef struct {
+    VkDeviceMemory  memory;
+    VkDeviceSize    offset;
+    VkDeviceSize    size;   // Actually reserved size, can be bigger than requested
+    void           *mapped; // Already offset, NULL if the memory isn't host visible
+    void           *block;  // Owning block, NULL for dedicated allocations
+    u32             memory_type_index;
+    u32             order;
+    Memory_Tag      tag;
+} Vulkan_Allocation;
+
+// Device local buffer, filled through the staging uploads in vulkan_buffer.h
+typedef struct {
+    VkBuffer          buffer;
+    VkDeviceSize      size;
+    Vulkan_Allocation allocation;
+    bool              concurrent; // Shared by the queue families, never changes hands
+} Vulkan_Buffer;
+
+// Compute shader whose storage buffers are bindings 0 to buffer_count - 1 of set 0,
+// see vulkan_compute.h
+typedef struct {
+    VkDescriptorSetLayout descriptor_set_layout;
+    VkPipelineLayout      layout;
+    VkPipeline            pipeline;
+    u32                   buffer_count;
+    u32                   push_constant_size;
+} Vulkan_Compute_Pipeline;
+
+typedef struct {
+    f32 position[2];
+    f32 color[3];
+} Vulkan_Vertex;
+
+// Per instance vertex data of the draws in vulkan_draw.h
+typedef struct {
+    f32 offset[2];
+    f32 scale;
+} Vulkan_Instance;
+
+// Command pools can only be used from one thread at a time, so every job thread
+// records into its own. Each frame in flight has its own set as well, that way a
+// whole set is reset at once after the frame's timeline value has been reached.
+typedef struct {
+    VkCommandPool   pool;
+    VkCommandBuffer secondary_buffers[VULKAN_MAX_RECORDING_JOBS];
+    u32             allocated_count;
+    u32             used_count; // Since the last reset
+} Vulkan_Thread_Commands;
+
+typedef struct {
+    VkCommandPool           primary_pool;
+    VkCommandBuffer         primary_buffer;
+    Vulkan_Thread_Commands *threads; // One per job thread
+} Vulkan_Frame_Commands;
+
 typedef struct {
     VkInstance                instance;
     VkSurfaceKHR              surface;
@@ -36,6 +133,7 @@ typedef struct {
     VkQueue graphics_queue;
     VkQueue present_queue;
     VkQueue transfer_queue;
+    VkQueue compute_queue; // Async compute, can be the graphics queue if there's nothing better
 
     VkSwapchainKHR  swapchain;
     u32             swapchain_image_count;
@@ -43,21 +141,73 @@ typedef struct {
     VkFormat        swapchain_image_format;
     VkImageView    *swapchain_image_views;
     VkExtent2D      swapchain_extent;
-    VkFramebuffer  *swapchain_framebuffers;
+    u32             backbuffer; // Render graph resource of the swapchain images
+
+    Vulkan_Present_Policy present_policy;
+    VkPresentModeKHR      present_mode;          // What the policy ended up with
+    u32                   requested_image_count; // 0 = minImageCount + 1
+
+    bool                  swapchain_dirty;       // Resized or out of date, recreated before the next frame
 
     u32 framebuffer_width;
     u32 framebuffer_height;
 
-    VkRenderPass     renderpass;
+    // Headless mode renders into offscreen images (stored in the swapchain_* fields
+    // above, so the rest of the renderer doesn't care) and copies every frame into
+    // a host visible readback buffer. There is no surface and no swapchain.
+    bool               headless;
+    Vulkan_Allocation *offscreen_image_allocations;
+    VkBuffer           readback_buffers[MAX_FRAMES_IN_FLIGHT];
+    Vulkan_Allocation  readback_allocations[MAX_FRAMES_IN_FLIGHT];
+    u32                last_submitted_frame;
+    bool               frame_submitted;
+
+    // VK_KHR_dynamic_rendering (core in 1.3): graphics passes begin on the image
+    // views, without render passes or framebuffers. The functions are the core or the
+    // KHR ones, whichever the device has.
+    bool                       dynamic_rendering;
+    bool                       dynamic_rendering_disabled; // vulkan_set_dynamic_rendering
+    PFN_vkCmdBeginRenderingKHR cmd_begin_rendering;
+    PFN_vkCmdEndRenderingKHR   cmd_end_rendering;
+
+    // Optional indirect draw features, see vulkan_draw.h
+    bool multi_draw_indirect;
+    bool draw_indirect_first_instance;
+    bool draw_indirect_count;
+
+    VkRenderPass     renderpass; // Only for pipeline compatibility, none with dynamic rendering
     VkPipelineLayout pipeline_layout;
     VkPipeline       graphics_pipeline;
 
-    VkCommandPool   command_pool;
-    VkCommandBuffer command_buffer;
+    // The triangle, until there's real geometry to draw. It's spun around on the
+    // compute queue, from vertex_buffer into the frame's animated_vertex_buffer.
+    Vulkan_Buffer           vertex_buffer;
+    Vulkan_Buffer           animated_vertex_buffers[MAX_FRAMES_IN_FLIGHT];
+    Vulkan_Buffer           index_buffer;
+    u32                     vertex_count;
+    u32                     index_count;
+    u32                     triangle_mesh; // vulkan_draw.h mesh of the whole index buffer
+    Vulkan_Compute_Pipeline animate_pipeline;
+
+    VkPipelineCache pipeline_cache;
+    bool            pipeline_cache_warm; // Loaded a valid cache from disk
+
+    Vulkan_Frame_Commands frame_commands[MAX_FRAMES_IN_FLIGHT];
+    u32                   command_thread_count; // Job threads that can record
+
+    // Swapchain acquire and present only take binary semaphores, everything else
+    // waits on the timelines in vulkan_timeline.h
+    VkSemaphore  image_available_semaphores[MAX_FRAMES_IN_FLIGHT];
+    // One per swapchain image: a present can still be waiting on it after the frame
+    // slot that signaled it comes around again, but not after its image is reacquired
+    VkSemaphore *render_finished_semaphores;
+    u64          frame_values[MAX_FRAMES_IN_FLIGHT]; // Graphics timeline value of each slot's last frame
+    u64         *images_in_flight; // Graphics timeline value of the frame using each swapchain image, 0 = none
+    u32          current_frame;
+    u64          submitted_frame_count;
 
-    VkSemaphore image_available_semaphore;
-    VkSemaphore render_finished_semaphore;
-    VkFence     in_flight_fence;
+    Memory_Arena frame_arena;
+    Memory_Stack scratch_stack;
 } Vulkan_Context;
 
 #endif
\ No newline at end of file